@@ -11,47 +11,389 @@
 //-----------------------------------------------
 #include <stdio.h> //todo delete
 #include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <stddef.h>
 
 #include "sdrc.h"
+#include "sdrc_engine.h"
 
 //-----------------------------------------------
 // DEFINITION
 //-----------------------------------------------
+/* The ID hash table is at most half full. */
+#define SDCR_ID_TABLE_SIZE (2 * SDCR_MAX_NUMBER_OF_ROUTINE + 1)
+#define SDCR_WAKEUP_DEADLINES 8 //< The distinct deadlines of a pass told apart, for the stats.
+
+/* A compiled routine is a list of events.
+ * An event is a run of identical steps. Each step of the run
+ * is rearmed on the actual time of the previous step, just like
+ * consecutive chars of a plain routine string.
+ * A repeat event plays the group of events before it again: a repeated
+ * group costs its events once, whatever its number of copies. Its copy
+ * counter is the only event field written when the routine is played.
+ */
+typedef struct
+{
+    union
+    {
+        uint32_t holdMs; //< The time for each step of the run.
+        struct
+        {
+            uint16_t body;   //< Repeat: the number of events of the group, just before this one.
+            uint16_t played; //< Repeat: the copies of the group played in this cycle.
+        };
+    };
+    uint16_t steps; //< The number of steps in the run. Repeat: the number of copies of the group.
+    bool isCall;    //< The steps call the callback.
+    bool isRepeat;  //< Repeats the group before it: not a step.
+} sdcr_event;
+
+/* Routine hot state.
+ * Everything `sdcr_task` reads to know if a routine is due.
+ * Kept to 16 bytes: 4 routines per 64 bytes cache line.
+ */
 typedef struct
 {
-    /* user config */
-    sdcr_routine_configuration config;
-    /* flags */
-    bool isEnable;
-    bool isInfinite;
     /* State and time variables */
-    int32_t cyclesLeft;
     uint32_t timestampLastAction;
-    char *routineCursor;
+    uint32_t holdMs; //< The time to wait after the last action.
+    union
+    {
+        struct
+        {
+            uint16_t eventCursor; //< The next event, relative to `eventBegin`.
+            uint16_t runCursor;   //< The next step in the event run.
+        };
+        uint32_t textCursor; //< The next char of a text routine.
+    };
+    uint16_t cyclesLeft;
+    /* flags */
+    unsigned isUsed : 1; //< Same as `routineIDs[i] != NULL`, without reading the IDs.
+    unsigned isEnable : 1;
+    unsigned isInfinite : 1;
+    unsigned hasOutput : 1;  //< Bound to `outputBit` in `sdcr_render`.
+    unsigned isFollower : 1; //< Follows the timeline of `groupLeader`: not scheduled on its own.
+    unsigned hasSlack : 1;   //< Has a `slackMs` tolerance.
+    unsigned hasStartTime : 1; //< `firstStepMs` is known: the routine can be queried.
 } sdcr_routine_state_machine;
 
+/* Routine compiled configuration.
+ * What the configuration and the routine string define. Only written when
+ * the routine is stored, cleared or restored, and when its events are moved
+ * by `sdcr_events_free`: the other functions read it through a const pointer.
+ * The ID is only kept in `gMemory.routineIDs`.
+ */
+typedef struct
+{
+    sdcr_callback_function callbackFunction;
+    union
+    {
+        const char *text; //< The routine string of a text routine, played char by char.
+        struct
+        {
+            uint16_t eventBegin; //< Index of the first event in `gMemory.events`.
+            uint16_t eventCount;
+        };
+    };
+    uint32_t routineStepTimeMs; //< The default time for each step.
+    uint8_t stream;             //< Index + 1 of the routine stream in `gMemory.streams`, 0 if none.
+    bool isText;                //< Played from `text`: the events didn't fit.
+} sdcr_routine_configuration_compiled;
+
+/* Routine cold state.
+ * Only read when a step is performed, or by the API functions.
+ * The fields are ordered by size, so there is no padding. The optional
+ * features used by few routines are in side tables: see `completion`.
+ */
+typedef struct
+{
+    uint32_t firstStepMs; //< The time of the first step, when started at a known time.
+    /* shared timeline */
+    uint16_t groupLeader; //< Index + 1 of the routine whose timeline this one follows, 0 if none.
+    uint16_t groupNext;   //< Index + 1 of the next follower in the leader's group, 0 if none.
+    /* pull query */
+    uint16_t startCycles; //< The number of cycles, when started at a known time. 0 if infinite.
+    /* render mode */
+    uint16_t outputBit;
+    /* completion */
+    uint16_t completion; //< Index + 1 of the routine completion in `gMemory.completions`, 0 if none.
+    /* timer slack */
+    uint16_t slackMs; //< A step can be performed up to `slackMs` early or late.
+} sdcr_routine_cold_state;
+
+/* Routine completion.
+ * What to do when a routine started for n cycles is complete.
+ */
+typedef struct
+{
+    sdcr_complete_function onComplete;
+    uint32_t chainOffsetMs; //< Time between the completion and the first step of the next routine.
+    uint16_t routine;       //< Index + 1 of the completed routine, 0 if the completion is free.
+    uint16_t chainNext;     //< Index + 1 of the routine started on completion, 0 if none.
+    uint16_t chainCycles;   //< 0 if infinite.
+} sdcr_completion;
+
+/* Routine stream.
+ * The events of a stream routine are a window of two halves: one half is
+ * played while the other one was already pulled from the source.
+ */
+typedef struct
+{
+    sdcr_stream_function source; //< NULL if the stream is free.
+    void *context;
+    uint16_t fill[2]; //< The events pulled in each half. 0 once the source ended.
+    uint16_t routine; //< The index of the routine playing the stream.
+    uint8_t refill;   //< Half + 1 to pull at the end of the pass, 0 if none.
+    bool isEnded;     //< The source returned no event.
+} sdcr_stream;
+
 typedef struct
 {
-    const char *routineIDs[SDCR_MAX_NUMBER_OF_ROUTINE];
     sdcr_routine_state_machine routines[SDCR_MAX_NUMBER_OF_ROUTINE];
+    _Atomic(const char *) routineIDs[SDCR_MAX_NUMBER_OF_ROUTINE]; //< Scanned by the lock-free readers: relaxed, the seqlocks order them.
+    sdcr_routine_configuration_compiled configs[SDCR_MAX_NUMBER_OF_ROUTINE];
+    sdcr_routine_cold_state coldStates[SDCR_MAX_NUMBER_OF_ROUTINE];
+    atomic_uint sequences[SDCR_MAX_NUMBER_OF_ROUTINE]; //< Seqlocks: odd while the state is being written.
+    sdcr_event events[SDCR_MAX_NUMBER_OF_EVENT];
+    uint16_t eventsUsed;
+    uint16_t idTable[SDCR_ID_TABLE_SIZE]; //< ID hash table, with linear probing: index + 1, 0 if empty.
+    uint16_t freeHint;                    //< There is no free routine before this index.
+    sdcr_stream streams[SDCR_MAX_NUMBER_OF_STREAM];
+    sdcr_completion completions[SDCR_MAX_NUMBER_OF_COMPLETION];
 } sdcr_memory;
 
+/* Scratch memory of the bulk functions. */
+typedef struct
+{
+    uint64_t marked[SDCR_ENGINE_WORDS];         //< The routines of the current bulk operation.
+    uint16_t leaders[SDCR_ID_TABLE_SIZE];       //< Timeline hash table of the group leaders: index + 1, 0 if empty.
+} sdcr_bulk;
+
+/* Snapshot blob header.
+ * The routine records, then the used events, follow the header.
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t routineCount; //< The number of routine records.
+    uint32_t size;         //< The blob size, header included.
+    uint32_t checksum;     //< Hash of the blob, with this field at 0.
+    uint16_t maxRoutines;  //< `SDCR_MAX_NUMBER_OF_ROUTINE` of the snapshot.
+    uint16_t eventsUsed;
+    uint16_t recordSize;
+    uint16_t eventSize;
+    uintptr_t dataAnchor; //< Address of `gSnapshotAnchor`: relocates the IDs.
+    uintptr_t codeAnchor; //< Address of `sdcr_task`: relocates the callbacks.
+} sdcr_snapshot_header;
+
+/* Snapshot routine record.
+ * Times are stored relative to the snapshot time.
+ */
+typedef struct
+{
+    uint16_t index;
+    const char *id;
+    sdcr_routine_state_machine hot;
+    sdcr_routine_configuration_compiled config;
+    sdcr_routine_cold_state cold;
+    sdcr_completion completion; //< Free if the routine has none.
+} sdcr_snapshot_record;
+
+/* Routines due at a `sdcr_task` pass.
+ * The engine finds the routines whose deadline passed. The ones it can't
+ * see are added here, so a pass performs the steps a check of every
+ * routine would perform.
+ */
+typedef struct
+{
+    uint64_t due[SDCR_ENGINE_WORDS];   //< To check in this pass, or the next one. Checked again before the step.
+    uint64_t early[SDCR_ENGINE_WORDS]; //< Last step in the future (ex: `sdcr_routine_start_at`): due until then.
+    uint64_t slack[SDCR_ENGINE_WORDS]; //< Has a `slackMs` tolerance.
+    uint64_t fanout[SDCR_ENGINE_WORDS];     //< Follower sharing its leader step: callback due at its own index.
+    uint64_t fanoutDone[SDCR_ENGINE_WORDS]; //< Follower sharing its leader last step: completion due at its own index.
+    uint32_t lastNow;                  //< The time of the last pass.
+    bool isRunning;                    //< A pass is performing the steps at `lastNow`.
+    bool hasFanout;                    //< A follower share is pending in this pass.
+} sdcr_schedule;
+
+/* Output frame of `sdcr_render`. */
+typedef struct
+{
+    uint8_t *bits;
+    size_t size; //< in bytes
+} sdcr_frame;
+
+/* Steps performed by a `sdcr_task` pass, for the stats. */
+typedef struct
+{
+    uint32_t steps;
+    int32_t maxLateness;                          //< Of the earliest deadline.
+    uint32_t slackDeadlines;                      //< The distinct deadlines of the steps of routines with slack.
+    int32_t slackLateness[SDCR_WAKEUP_DEADLINES]; //< Of the first distinct deadlines, to tell them apart.
+} sdcr_wakeup;
+
+/* Routine compiler.
+ * Compiles the routine string at the end of the used events.
+ */
+typedef struct
+{
+    const char *input;   //< The next char to compile.
+    uint32_t stepTimeMs; //< The default time for each step.
+    size_t begin;        //< The first compiled event.
+    size_t end;          //< One past the last compiled event.
+    bool canMerge;       //< A new step can be merged in the last event.
+    sdcr_status status;
+} sdcr_compiler;
+
+/* Length of events, with the copies of their repeated groups. */
+typedef struct
+{
+    uint64_t ms;
+    uint64_t steps;
+    uint64_t calls;
+} sdcr_span;
+
+#ifdef SDCR_ENABLE_TRACE
+typedef struct
+{
+    atomic_uint sequence; //< Event number + 1 once written, event number while written.
+    sdcr_trace_event event;
+} sdcr_trace_slot;
+
+typedef struct
+{
+    sdcr_get_tick_function clock; //< NULL when not recording.
+    atomic_uint head;             //< Next event number.
+    unsigned tail;                //< Next event number to read.
+    sdcr_trace_slot slots[SDCR_TRACE_BUFFER_SIZE];
+} sdcr_trace_buffer;
+#endif
+
 //-----------------------------------------------
 // MACROS
 //-----------------------------------------------
 #define ARRAY_LENGTH(arr) (sizeof(arr) / sizeof((arr)[0])) //< Wont work with ptr.
+#define SDCR_MAX_ROUTINE_NESTING 8                         //< Max depth of `(...)` groups.
+#define SDCR_SNAPSHOT_MAGIC 0x52434453u                    //< "SDCR"
+#define SDCR_SNAPSHOT_VERSION 5                            //< Change it with the records layout.
+
+_Static_assert(SDCR_MAX_NUMBER_OF_EVENT <= UINT16_MAX, "events are indexed with uint16_t");
+_Static_assert(sizeof(sdcr_event) == 8, "an event should stay 8 bytes");
+_Static_assert(sizeof(sdcr_routine_state_machine) == 16, "routine hot state should stay compact");
+_Static_assert(sizeof(sdcr_routine_configuration_compiled) <= 2 * sizeof(void *) + 8, "routine configuration should stay compact");
+_Static_assert(sizeof(sdcr_routine_cold_state) == 16, "routine cold state should stay compact");
+/* Per routine: hot state, ID, compiled configuration, cold state and seqlock.
+ * Was 4 * sizeof(void *) + 60 bytes, before the optional features moved to side tables. */
+_Static_assert(sizeof(sdcr_routine_state_machine) + sizeof(const char *) + sizeof(sdcr_routine_configuration_compiled) +
+                       sizeof(sdcr_routine_cold_state) + sizeof(atomic_uint) <= 3 * sizeof(void *) + 44,
+               "bytes per routine should go down, not up");
+_Static_assert(SDCR_MAX_NUMBER_OF_ROUTINE < UINT16_MAX, "routines are indexed with uint16_t");
+_Static_assert(SDCR_MAX_NUMBER_OF_COMPLETION < UINT16_MAX, "completions are indexed with uint16_t");
+_Static_assert(SDCR_MAX_NUMBER_OF_STREAM < UINT8_MAX, "streams are indexed with uint8_t");
+_Static_assert(SDCR_STREAM_CHUNK_SIZE > 0 && 2 * SDCR_STREAM_CHUNK_SIZE <= SDCR_MAX_NUMBER_OF_EVENT,
+               "a stream window must fit in the events");
+
+#ifdef SDCR_ENABLE_TRACE
+_Static_assert((SDCR_TRACE_BUFFER_SIZE & (SDCR_TRACE_BUFFER_SIZE - 1)) == 0, "trace buffer size must be a power of 2");
+#define SDCR_TRACE(type, index, arg) sdcr_trace_record((type), (index), (arg))
+#define SDCR_TRACE_STEP(index, lateness, holdMs) sdcr_trace_step((index), (lateness), (holdMs))
+#else
+#define SDCR_TRACE(type, index, arg) ((void)0)
+#define SDCR_TRACE_STEP(index, lateness, holdMs) ((void)0)
+#endif
 
 //-----------------------------------------------
 // GLOBAL VARIABLES
 //-----------------------------------------------
 static sdcr_memory gMemory = {0};
+static sdcr_stats gStats = {0};
+static sdcr_bulk gBulk = {0};
+static const uint8_t gSnapshotAnchor = 0; //< Only its address is used.
+static sdcr_schedule gSchedule = {0};
+#if SDCR_ENGINE == SDCR_ENGINE_HEAP
+static const sdcr_engine *gEngine = &sdcr_engine_heap;
+#elif SDCR_ENGINE == SDCR_ENGINE_WHEEL
+static const sdcr_engine *gEngine = &sdcr_engine_wheel;
+#else
+static const sdcr_engine *gEngine = &sdcr_engine_linear;
+#endif
+#ifdef SDCR_ENABLE_TRACE
+static sdcr_trace_buffer gTrace = {0};
+#endif
 
 //-----------------------------------------------
 // INTERNAL PROTOTYPES
 //-----------------------------------------------
-static sdcr_routine_state_machine *sdcr_get_routine_from_id(const char *id);
-static char sdcr_get_action(sdcr_routine_state_machine *routine);
-static uint32_t sdcr_get_elapsed_time(uint32_t then, sdcr_get_tick_function getTickMs);
+static bool sdcr_get_index_from_id(const char *id, size_t *index);
+static void sdcr_run(uint32_t now, const sdcr_frame *frame);
+static void sdcr_schedule_collect(uint32_t now);
+static void sdcr_schedule_update(size_t index);
+static size_t sdcr_schedule_next(const uint64_t *bits, size_t index);
+static void sdcr_schedule_cancel(size_t index);
+static void sdcr_run_fanout(size_t index, uint32_t now, const sdcr_frame *frame);
+static void sdcr_routine_perform_step(size_t index, uint32_t now, uint32_t elapsed, const sdcr_frame *frame);
+static void sdcr_routine_perform_action(size_t index, const sdcr_frame *frame);
+static void sdcr_routine_keep_deadline(size_t index, uint32_t deadlineMs, uint32_t elapsed);
+static void sdcr_wakeup_add(sdcr_wakeup *wakeup, size_t index, int32_t lateness);
+static bool sdcr_routine_wakeup_window(size_t index, uint32_t nowMs, uint64_t *deadline, uint64_t *limit);
+static void sdcr_wakeup_account(const sdcr_wakeup *wakeup);
+static void sdcr_routine_complete(size_t index, uint32_t now, const sdcr_frame *frame);
+static sdcr_completion *sdcr_completion_get(size_t index, bool isNeeded);
+static void sdcr_completion_release(size_t index);
+static void sdcr_group_merge(size_t index);
+static void sdcr_group_split(size_t index);
+static void sdcr_group_detach(size_t index, size_t leader);
+static bool sdcr_group_can_follow(size_t index, size_t leader);
+static size_t sdcr_group_follow(size_t index, size_t leader);
+static void sdcr_group_split_marked();
+static void sdcr_group_merge_marked();
+static uint32_t sdcr_group_key(size_t index);
+static size_t sdcr_id_hash(const char *id);
+static void sdcr_id_insert(size_t index);
+static void sdcr_id_remove(size_t index);
+static sdcr_status sdcr_bulk_mark(const char *const *ids, size_t count, sdcr_status *statuses);
+static bool sdcr_get_action(size_t index);
+static void sdcr_events_repeat(size_t index);
+static void sdcr_routine_rewind(size_t index);
+static bool sdcr_stream_get_action(size_t index);
+static void sdcr_stream_refill(void);
+static void sdcr_stream_pull(size_t index, size_t half);
+static bool sdcr_stream_can_start(size_t index, bool isFromBeginning);
+static sdcr_status sdcr_routine_store(sdcr_routine_configuration config, uint16_t eventCount, size_t *index);
+static uint32_t sdcr_get_elapsed_time(uint32_t then, uint32_t now);
+static void sdcr_routine_write_begin(size_t index);
+static void sdcr_routine_write_end(size_t index);
+static void sdcr_routine_write_end_unscheduled(size_t index);
+static void sdcr_routine_reset(size_t index);
+static bool sdcr_routine_read_state(size_t index, sdcr_routine_state *state);
+static void sdcr_routine_read_timeline(size_t index, sdcr_routine_state_machine *timeline, uint32_t *cursorPosition);
+static uint32_t sdcr_routine_cursor_position(size_t index, const sdcr_routine_state_machine *timeline);
+static bool sdcr_routine_read_query(size_t index, const char *id, uint32_t atMs,
+                                    sdcr_routine_query_result *result, sdcr_status *status);
+static sdcr_status sdcr_query_timeline(const sdcr_routine_configuration_compiled *config, size_t eventCount, uint32_t firstStepMs,
+                                       uint16_t cycles, uint32_t atMs, sdcr_routine_query_result *result);
+static sdcr_status sdcr_compile(const char *routine, uint32_t stepTimeMs, uint16_t *eventCount);
+static bool sdcr_compile_is_plain(const char *routine);
+static sdcr_event sdcr_routine_event(const sdcr_routine_configuration_compiled *config, size_t i);
+static bool sdcr_compile_sequence(sdcr_compiler *compiler, unsigned depth);
+static bool sdcr_compile_item(sdcr_compiler *compiler, unsigned depth);
+static bool sdcr_compile_is_repeated(const sdcr_compiler *compiler);
+static bool sdcr_compile_repeat(sdcr_compiler *compiler, size_t groupBegin, uint32_t repeat);
+static bool sdcr_compile_number(sdcr_compiler *compiler, uint32_t *number);
+static bool sdcr_compile_append(sdcr_compiler *compiler, bool isCall, uint32_t holdMs, uint32_t steps);
+static void sdcr_compile_skip_spaces(sdcr_compiler *compiler);
+static void sdcr_events_free(size_t index);
+static uint32_t sdcr_events_hash(size_t begin, size_t count);
+static sdcr_span sdcr_events_measure(const sdcr_routine_configuration_compiled *config, size_t begin, size_t end, unsigned depth);
+static uint32_t sdcr_snapshot_hash(const uint8_t *buffer, size_t size);
+static bool sdcr_snapshot_is_valid(const uint8_t *buffer, size_t size);
+static uintptr_t sdcr_snapshot_relocate(uintptr_t address, uintptr_t from, uintptr_t to);
+#ifdef SDCR_ENABLE_TRACE
+static void sdcr_trace_record(sdcr_trace_type type, size_t index, uint32_t arg);
+static void sdcr_trace_step(size_t index, uint32_t lateness, uint32_t holdMs);
+#endif
 
 //-----------------------------------------------
 // API FUNCTIONS
@@ -61,32 +403,25 @@ sdcr_status sdcr_task(sdcr_get_tick_function getTickMs)
     if (getTickMs == NULL)
         return SDCR_ERROR_NULL_PTR;
 
-    for (size_t routineIndex = 0;
-         routineIndex < ARRAY_LENGTH(gMemory.routineIDs);
-         routineIndex++)
-    {
-        const char *currentId = gMemory.routineIDs[routineIndex];
-        sdcr_routine_state_machine *currentroutine = &gMemory.routines[routineIndex];
+    return sdcr_task_at(getTickMs());
+}
 
-        const bool routineIsEnable = (currentroutine->isEnable == true);
-        const bool routineExist = (currentId != 0);
-        const bool routineIsActive = (routineExist && routineIsEnable);
-        if (routineIsActive)
-        {
-            const bool actionIsNeeded = (sdcr_get_elapsed_time(currentroutine->timestampLastAction, getTickMs) >=
-                                         currentroutine->config.routineStepTimeMs);
-            if (actionIsNeeded)
-            {
-                const char action = sdcr_get_action(currentroutine);
-                if (action != '.')
-                {
-                    currentroutine->config.callbackFunction();
-                }
-                // update timestamp
-                currentroutine->timestampLastAction = getTickMs();
-            }
-        }
-    }
+sdcr_status sdcr_task_at(uint32_t nowMs)
+{
+    sdcr_run(nowMs, NULL);
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_render(uint32_t nowMs, uint8_t *frame, size_t frameSize)
+{
+    if (frame == NULL)
+        return SDCR_ERROR_NULL_PTR;
+
+    const sdcr_frame output = {
+        .bits = frame,
+        .size = frameSize,
+    };
+    sdcr_run(nowMs, &output);
     return SDCR_SUCCESS;
 }
 
@@ -97,14 +432,9 @@ sdcr_status sdcr_routine_new_base(sdcr_routine_configuration config)
         return SDCR_ERROR_INVALID_ROUTINE_CONFIG;
 
     // Check if ID doesnt already exist
-    for (size_t i = 0;
-         i < ARRAY_LENGTH(gMemory.routineIDs);
-         i++)
-    {
-        const bool idFound = (gMemory.routineIDs[i] == config.id);
-        if (idFound)
-            return SDCR_ERROR_ID_ALREADY_EXIST;
-    }
+    size_t existing;
+    if (sdcr_get_index_from_id(config.id, &existing))
+        return SDCR_ERROR_ID_ALREADY_EXIST;
     // Check if config is valid
     if (config.routineStepTimeMs <= 0)
         return SDCR_ERROR_INVALID_ROUTINE_CONFIG;
@@ -112,38 +442,75 @@ sdcr_status sdcr_routine_new_base(sdcr_routine_configuration config)
         return SDCR_ERROR_INVALID_ROUTINE_CONFIG;
     if (config.routine == NULL)
         return SDCR_ERROR_INVALID_ROUTINE_CONFIG;
-    char *routineToCheck = config.routine;
-    while (*routineToCheck != '\0') //todo dangeureux ?
+    // Compile the routine after the used events
+    uint16_t eventCount = 0;
+    const sdcr_status compileStatus = sdcr_compile(config.routine, config.routineStepTimeMs, &eventCount);
+    // A plain routine always fits: it's played from the string when the events are full.
+    const bool isText = (compileStatus == SDCR_ERROR_EVENT_MEMORY_IS_FULL && sdcr_compile_is_plain(config.routine));
+    if (compileStatus != SDCR_SUCCESS && !isText)
+        return compileStatus;
+
+    // Everything seems fine: Store new id, config and compiled routine
+    size_t index;
+    const sdcr_status status = sdcr_routine_store(config, isText ? 0 : eventCount, &index);
+    if (status == SDCR_SUCCESS && isText)
     {
-        char unit = *routineToCheck++;
-        switch (unit)
-        {
-        case '.':
-            break;
-        case 'C':
-            break;
-        case 'c':
-            break;
-        default: //< config contains invalid char.
-            return SDCR_ERROR_INVALID_ROUTINE_CONFIG;
-        }
+        sdcr_routine_write_begin(index);
+        gMemory.configs[index].text = config.routine;
+        gMemory.configs[index].isText = true; //< never shares a timeline
+        sdcr_routine_write_end_unscheduled(index);
     }
-    // Everything seems fine: Store new id and config
-    for (size_t i = 0;
-         i < ARRAY_LENGTH(gMemory.routineIDs);
-         i++)
+    return status;
+}
+
+sdcr_status sdcr_routine_new_stream_base(sdcr_stream_configuration config)
+{
+    if (config.id == NULL)
+        return SDCR_ERROR_INVALID_ROUTINE_CONFIG;
+
+    size_t existing;
+    if (sdcr_get_index_from_id(config.id, &existing))
+        return SDCR_ERROR_ID_ALREADY_EXIST;
+    if (config.routineStepTimeMs <= 0)
+        return SDCR_ERROR_INVALID_ROUTINE_CONFIG;
+    if (config.callbackFunction == NULL)
+        return SDCR_ERROR_INVALID_ROUTINE_CONFIG;
+    if (config.source == NULL)
+        return SDCR_ERROR_INVALID_ROUTINE_CONFIG;
+
+    size_t streamIndex = 0;
+    while (streamIndex < ARRAY_LENGTH(gMemory.streams) && gMemory.streams[streamIndex].source != NULL)
     {
-        const bool memoryIsFree = (gMemory.routineIDs[i] == 0);
-        if (memoryIsFree)
-        {           
-            gMemory.routines[i].config = config;                    //< Stores routine's configuration
-            gMemory.routineIDs[i] = config.id;                      //< Stores routine's id
-            gMemory.routines[i].routineCursor = config.routine;     //< Point routine cursor to the routine's start 
-            gMemory.routines[i].isEnable = false;                  //< Routine is not enabled yet.
-            return SDCR_SUCCESS; //< stored this configuration succesfully
-        }
+        streamIndex++;
     }
-    return SDCR_ERROR_ROUTINE_MEMORY_IS_FULL;
+    if (streamIndex == ARRAY_LENGTH(gMemory.streams))
+        return SDCR_ERROR_ROUTINE_MEMORY_IS_FULL;
+    if (gMemory.eventsUsed + 2u * SDCR_STREAM_CHUNK_SIZE > ARRAY_LENGTH(gMemory.events))
+        return SDCR_ERROR_EVENT_MEMORY_IS_FULL;
+
+    // Store the routine with an empty window, then pull both halves.
+    const sdcr_routine_configuration routineConfig = {
+        .id = config.id,
+        .routine = NULL,
+        .routineStepTimeMs = config.routineStepTimeMs,
+        .callbackFunction = config.callbackFunction,
+    };
+    size_t index;
+    const sdcr_status status = sdcr_routine_store(routineConfig, 2u * SDCR_STREAM_CHUNK_SIZE, &index);
+    if (status != SDCR_SUCCESS)
+        return status;
+
+    sdcr_stream *stream = &gMemory.streams[streamIndex];
+    *stream = (sdcr_stream){.source = config.source, .context = config.context, .routine = (uint16_t)index};
+    gMemory.configs[index].stream = (uint8_t)(streamIndex + 1u); //< the events change: never shares a timeline
+    sdcr_stream_pull(index, 0);
+    sdcr_stream_pull(index, 1);
+    if (stream->fill[0] == 0)
+    {
+        sdcr_routine_reset(index); //< an empty stream
+        return SDCR_ERROR_INVALID_ROUTINE_CONFIG;
+    }
+    return SDCR_SUCCESS;
 }
 
 sdcr_status sdcr_routine_clear(const char *id)
@@ -151,19 +518,104 @@ sdcr_status sdcr_routine_clear(const char *id)
     if (id == NULL)
         return SDCR_ERROR_NULL_PTR;
 
-    for (size_t i = 0;
-         i < ARRAY_LENGTH(gMemory.routineIDs);
-         i++)
+    size_t index;
+    if (!sdcr_get_index_from_id(id, &index))
+        return SDCR_ERROR_ID_DOESNT_EXIST;
+
+    // id found, erase this routine from memory
+    sdcr_routine_reset(index);
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_routine_new_many(const sdcr_routine_configuration *configs, size_t count, sdcr_status *statuses)
+{
+    if (configs == NULL && count != 0)
+        return SDCR_ERROR_NULL_PTR;
+
+    // IDs are found with the hash table, free memory from the last stored routine.
+    // The new routines are stopped: the engine only learns them when started.
+    sdcr_status result = SDCR_SUCCESS;
+    for (size_t i = 0; i < count; i++)
     {
-        if (gMemory.routineIDs[i] == id)
+        const sdcr_status status = sdcr_routine_new_base(configs[i]);
+        if (statuses != NULL)
+            statuses[i] = status;
+        if (result == SDCR_SUCCESS)
+            result = status;
+    }
+    return result;
+}
+
+sdcr_status sdcr_routine_start_many(const char *const *ids, size_t count, uint16_t n, const uint32_t *startMs, sdcr_status *statuses)
+{
+    if (ids == NULL && count != 0)
+        return SDCR_ERROR_NULL_PTR;
+
+    sdcr_status result = sdcr_bulk_mark(ids, count, statuses);
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t index;
+        const bool isStartable = (ids[i] == NULL || !sdcr_get_index_from_id(ids[i], &index) ||
+                                  sdcr_stream_can_start(index, startMs != NULL));
+        if (isStartable)
+            continue;
+
+        sdcr_bits_clear(gBulk.marked, index);
+        if (statuses != NULL)
+            statuses[i] = SDCR_ERROR_INVALID_API_USAGE;
+        if (result == SDCR_SUCCESS)
+            result = SDCR_ERROR_INVALID_API_USAGE;
+    }
+    sdcr_group_split_marked();
+    for (size_t i = sdcr_bits_next(gBulk.marked, 0);
+         i < ARRAY_LENGTH(gMemory.routines);
+         i = sdcr_bits_next(gBulk.marked, i + 1u))
+    {
+        sdcr_routine_state_machine *routine = &gMemory.routines[i];
+        const sdcr_routine_configuration_compiled *config = &gMemory.configs[i];
+        sdcr_routine_cold_state *cold = &gMemory.coldStates[i];
+        sdcr_routine_write_begin(i);
+        routine->isEnable = true;
+        routine->isInfinite = (n == 0);
+        routine->cyclesLeft = n;
+        routine->hasStartTime = false; //< continues from its current phase
+        if (startMs != NULL)
         {
-            // id found, erase this routine from memory
-            gMemory.routineIDs[i] = NULL;
-            gMemory.routines[i] = (sdcr_routine_state_machine){0};
-            return SDCR_SUCCESS;
+            // same as `sdcr_routine_start_at`
+            sdcr_schedule_cancel(i);
+            sdcr_routine_rewind(i);
+            routine->timestampLastAction = *startMs;
+            routine->holdMs = config->routineStepTimeMs;
+            routine->hasStartTime = true;
+            cold->firstStepMs = *startMs + config->routineStepTimeMs;
+            cold->startCycles = n;
         }
+        sdcr_routine_write_end(i);
+        SDCR_TRACE(SDCR_TRACE_START, i, n);
     }
-    return SDCR_ERROR_ID_DOESNT_EXIST;
+    sdcr_group_merge_marked();
+    return result;
+}
+
+sdcr_status sdcr_routine_stop_many(const char *const *ids, size_t count, sdcr_status *statuses)
+{
+    if (ids == NULL && count != 0)
+        return SDCR_ERROR_NULL_PTR;
+
+    const sdcr_status result = sdcr_bulk_mark(ids, count, statuses);
+    sdcr_group_split_marked();
+    for (size_t i = sdcr_bits_next(gBulk.marked, 0);
+         i < ARRAY_LENGTH(gMemory.routines);
+         i = sdcr_bits_next(gBulk.marked, i + 1u))
+    {
+        sdcr_schedule_cancel(i);
+        sdcr_routine_write_begin(i);
+        gMemory.routines[i].isEnable = false;
+        gMemory.routines[i].hasStartTime = false;
+        sdcr_routine_write_end(i);
+        SDCR_TRACE(SDCR_TRACE_STOP, i, 0);
+    }
+    return result;
 }
 
 sdcr_status sdcr_routine_start_inf(const char *id)
@@ -171,12 +623,22 @@ sdcr_status sdcr_routine_start_inf(const char *id)
     if (id == NULL)
         return SDCR_ERROR_NULL_PTR;
 
-    sdcr_routine_state_machine *routine = sdcr_get_routine_from_id(id);
-    if (routine == NULL)
+    size_t index;
+    if (!sdcr_get_index_from_id(id, &index))
         return SDCR_ERROR_ID_DOESNT_EXIST;
 
+    if (!sdcr_stream_can_start(index, false))
+        return SDCR_ERROR_INVALID_API_USAGE;
+
+    sdcr_routine_state_machine *routine = &gMemory.routines[index];
+    sdcr_group_split(index);
+    sdcr_routine_write_begin(index);
     routine->isEnable = true;
     routine->isInfinite = true;
+    routine->hasStartTime = false; //< continues from its current phase
+    sdcr_routine_write_end(index);
+    sdcr_group_merge(index);
+    SDCR_TRACE(SDCR_TRACE_START, index, 0);
     return SDCR_SUCCESS;
 }
 
@@ -187,13 +649,56 @@ sdcr_status sdcr_routine_start_for_n_cycles(const char *id, uint16_t n)
     if (n <= 0)
         return SDCR_ERROR_INVALID_API_USAGE;
 
-    sdcr_routine_state_machine *routine = sdcr_get_routine_from_id(id);
-    if (routine == NULL)
+    size_t index;
+    if (!sdcr_get_index_from_id(id, &index))
         return SDCR_ERROR_ID_DOESNT_EXIST;
 
+    if (!sdcr_stream_can_start(index, false))
+        return SDCR_ERROR_INVALID_API_USAGE;
+
+    sdcr_routine_state_machine *routine = &gMemory.routines[index];
+    sdcr_group_split(index);
+    sdcr_routine_write_begin(index);
     routine->isEnable = true;
     routine->isInfinite = false;
     routine->cyclesLeft = n;
+    routine->hasStartTime = false; //< continues from its current phase
+    sdcr_routine_write_end(index);
+    sdcr_group_merge(index);
+    SDCR_TRACE(SDCR_TRACE_START, index, n);
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_routine_start_at(const char *id, uint16_t n, uint32_t startMs)
+{
+    if (id == NULL)
+        return SDCR_ERROR_NULL_PTR;
+
+    size_t index;
+    if (!sdcr_get_index_from_id(id, &index))
+        return SDCR_ERROR_ID_DOESNT_EXIST;
+
+    if (!sdcr_stream_can_start(index, true))
+        return SDCR_ERROR_INVALID_API_USAGE;
+
+    sdcr_routine_state_machine *routine = &gMemory.routines[index];
+    const sdcr_routine_configuration_compiled *config = &gMemory.configs[index];
+    sdcr_routine_cold_state *cold = &gMemory.coldStates[index];
+    sdcr_group_split(index);
+    sdcr_schedule_cancel(index); //< restarted: its share of a step is dropped
+    sdcr_routine_write_begin(index);
+    routine->isEnable = true;
+    routine->isInfinite = (n == 0);
+    routine->cyclesLeft = n;
+    sdcr_routine_rewind(index); //< start from the begining
+    routine->timestampLastAction = startMs;
+    routine->holdMs = config->routineStepTimeMs; //< First step happens after one step time.
+    routine->hasStartTime = true;
+    cold->firstStepMs = startMs + config->routineStepTimeMs;
+    cold->startCycles = n;
+    sdcr_routine_write_end(index);
+    sdcr_group_merge(index);
+    SDCR_TRACE(SDCR_TRACE_START, index, n);
     return SDCR_SUCCESS;
 }
 
@@ -202,60 +707,2225 @@ sdcr_status sdcr_routine_stop(const char *id)
     if (id == NULL)
         return SDCR_ERROR_NULL_PTR;
 
-    sdcr_routine_state_machine *routine = sdcr_get_routine_from_id(id);
-    if (routine == NULL)
+    size_t index;
+    if (!sdcr_get_index_from_id(id, &index))
         return SDCR_ERROR_ID_DOESNT_EXIST;
 
+    sdcr_routine_state_machine *routine = &gMemory.routines[index];
+    sdcr_group_split(index);
+    sdcr_schedule_cancel(index); //< stopped: its share of a step is dropped
+    sdcr_routine_write_begin(index);
     routine->isEnable = false;
+    routine->hasStartTime = false;
+    sdcr_routine_write_end(index);
+    SDCR_TRACE(SDCR_TRACE_STOP, index, 0);
     return SDCR_SUCCESS;
 }
 
-sdcr_status sdcr_routine_clear_all()
+sdcr_status sdcr_routine_bind_output(const char *id, uint16_t bit)
 {
-    gMemory = (sdcr_memory){0}; //< reset everything
+    if (id == NULL)
+        return SDCR_ERROR_NULL_PTR;
+
+    size_t index;
+    if (!sdcr_get_index_from_id(id, &index))
+        return SDCR_ERROR_ID_DOESNT_EXIST;
+
+    gMemory.coldStates[index].outputBit = bit;
+    gMemory.routines[index].hasOutput = true;
     return SDCR_SUCCESS;
 }
 
-//-----------------------------------------------
-// INTERNAL FUNCTIONS
-//-----------------------------------------------
-static sdcr_routine_state_machine *sdcr_get_routine_from_id(const char *id)
+sdcr_status sdcr_routine_unbind_output(const char *id)
 {
-    for (size_t i = 0;
-         i < ARRAY_LENGTH(gMemory.routineIDs);
-         i++)
+    if (id == NULL)
+        return SDCR_ERROR_NULL_PTR;
+
+    size_t index;
+    if (!sdcr_get_index_from_id(id, &index))
+        return SDCR_ERROR_ID_DOESNT_EXIST;
+
+    gMemory.routines[index].hasOutput = false;
+    return SDCR_SUCCESS;
+}
+
+void sdcr_callback_none()
+{
+}
+
+sdcr_status sdcr_routine_on_complete(const char *id, sdcr_complete_function onComplete)
+{
+    if (id == NULL)
+        return SDCR_ERROR_NULL_PTR;
+
+    size_t index;
+    if (!sdcr_get_index_from_id(id, &index))
+        return SDCR_ERROR_ID_DOESNT_EXIST;
+
+    sdcr_completion *completion = sdcr_completion_get(index, onComplete != NULL);
+    if (completion == NULL)
+        return (onComplete != NULL) ? SDCR_ERROR_ROUTINE_MEMORY_IS_FULL : SDCR_SUCCESS;
+
+    completion->onComplete = onComplete;
+    sdcr_completion_release(index);
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_routine_chain(const char *id, const char *nextId, uint16_t n, uint32_t phaseOffsetMs)
+{
+    if (id == NULL)
+        return SDCR_ERROR_NULL_PTR;
+
+    size_t index;
+    if (!sdcr_get_index_from_id(id, &index))
+        return SDCR_ERROR_ID_DOESNT_EXIST;
+
+    if (nextId == NULL)
     {
-        if (gMemory.routineIDs[i] == id)
-            return &gMemory.routines[i];
+        sdcr_completion *completion = sdcr_completion_get(index, false);
+        if (completion != NULL)
+            completion->chainNext = 0; //< unchain
+        sdcr_completion_release(index);
+        return SDCR_SUCCESS;
     }
-    return NULL;
+    size_t nextIndex;
+    if (!sdcr_get_index_from_id(nextId, &nextIndex))
+        return SDCR_ERROR_ID_DOESNT_EXIST;
+    if (gMemory.configs[nextIndex].stream != 0)
+        return SDCR_ERROR_INVALID_API_USAGE; //< a chain starts from the begining
+
+    sdcr_completion *completion = sdcr_completion_get(index, true);
+    if (completion == NULL)
+        return SDCR_ERROR_ROUTINE_MEMORY_IS_FULL;
+
+    completion->chainNext = (uint16_t)(nextIndex + 1u);
+    completion->chainCycles = n;
+    completion->chainOffsetMs = phaseOffsetMs;
+    return SDCR_SUCCESS;
 }
 
-static char sdcr_get_action(sdcr_routine_state_machine *routine)
+sdcr_status sdcr_routine_set_slack(const char *id, uint32_t slackMs)
 {
-    const bool routineNeedToLoop = (*routine->routineCursor == '\0');
-    if (routineNeedToLoop)
+    if (id == NULL)
+        return SDCR_ERROR_NULL_PTR;
+
+    size_t index;
+    if (!sdcr_get_index_from_id(id, &index))
+        return SDCR_ERROR_ID_DOESNT_EXIST;
+    if (slackMs > UINT16_MAX)
+        return SDCR_ERROR_INVALID_API_USAGE;
+
+    // routines sharing a timeline have the same slack
+    sdcr_group_split(index);
+    sdcr_routine_write_begin(index);
+    gMemory.coldStates[index].slackMs = (uint16_t)slackMs;
+    gMemory.routines[index].hasSlack = (slackMs != 0);
+    sdcr_routine_write_end(index);
+    sdcr_group_merge(index);
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_get_next_wakeup(uint32_t nowMs, uint32_t *delayMs)
+{
+    if (delayMs == NULL)
+        return SDCR_ERROR_NULL_PTR;
+
+    // Wake up at the first deadline. It is only delayed, within the slack of
+    // every routine, to be performed with a later deadline: then the steps
+    // due before it are performed late, and the steps due soon after it early.
+    uint64_t first = UINT64_MAX;
+    uint64_t latest = UINT64_MAX;
+    for (size_t i = 0;
+         i < ARRAY_LENGTH(gMemory.routines);
+         i++)
     {
-        routine->routineCursor = routine->config.routine; //< return to the begining
-        if (!!!routine->isInfinite)
-        {
-            routine->cyclesLeft--;
+        uint64_t deadline;
+        uint64_t limit;
+        if (!sdcr_routine_wakeup_window(i, nowMs, &deadline, &limit))
+            continue;
+        first = (deadline < first) ? deadline : first;
+        latest = (limit < latest) ? limit : latest;
+    }
 
-            const bool isThisTheLastCycle = (routine->cyclesLeft <= 1);
-            if (isThisTheLastCycle)
-            {
-                routine->isEnable = false;
-            }
-        }
+    uint64_t delay = first;
+    for (size_t i = 0;
+         i < ARRAY_LENGTH(gMemory.routines) && latest > first;
+         i++)
+    {
+        uint64_t deadline;
+        uint64_t limit;
+        if (sdcr_routine_wakeup_window(i, nowMs, &deadline, &limit) && deadline > delay && deadline <= latest)
+            delay = deadline;
     }
-    char action = *routine->routineCursor;
-    routine->routineCursor++; //< Advance the cursor
-    return action;
+    *delayMs = (delay < UINT32_MAX) ? (uint32_t)delay : UINT32_MAX;
+    return SDCR_SUCCESS;
 }
 
-static uint32_t sdcr_get_elapsed_time(uint32_t then, sdcr_get_tick_function getTickMs)
+sdcr_status sdcr_get_stats(sdcr_stats *stats)
 {
-    uint32_t now = getTickMs();
-    uint32_t elapsed = now - then;
-    return elapsed;
-}
\ No newline at end of file
+    if (stats == NULL)
+        return SDCR_ERROR_NULL_PTR;
+
+    *stats = gStats;
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_clear_stats()
+{
+    gStats = (sdcr_stats){0};
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_routine_clear_all()
+{
+    // reset everything at once, but keep the seqlocks counting
+    for (size_t i = 0;
+         i < ARRAY_LENGTH(gMemory.routineIDs);
+         i++)
+    {
+        if (gMemory.routineIDs[i] == NULL)
+            continue;
+        sdcr_routine_write_begin(i);
+        atomic_store_explicit(&gMemory.routineIDs[i], NULL, memory_order_relaxed);
+        gMemory.configs[i] = (sdcr_routine_configuration_compiled){0};
+        gMemory.coldStates[i] = (sdcr_routine_cold_state){0};
+        gMemory.routines[i] = (sdcr_routine_state_machine){0};
+        sdcr_routine_write_end_unscheduled(i);
+    }
+    memset(gMemory.idTable, 0, sizeof(gMemory.idTable));
+    memset(gMemory.streams, 0, sizeof(gMemory.streams));
+    memset(gMemory.completions, 0, sizeof(gMemory.completions));
+    gMemory.eventsUsed = 0;
+    gMemory.freeHint = 0;
+
+    // the engine and the pass forget every routine
+    gEngine->clear();
+    memset(gSchedule.due, 0, sizeof(gSchedule.due));
+    memset(gSchedule.early, 0, sizeof(gSchedule.early));
+    memset(gSchedule.slack, 0, sizeof(gSchedule.slack));
+    memset(gSchedule.fanout, 0, sizeof(gSchedule.fanout));
+    memset(gSchedule.fanoutDone, 0, sizeof(gSchedule.fanoutDone));
+    gSchedule.hasFanout = false;
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_routine_get_state(const char *id, sdcr_routine_state *state)
+{
+    if (id == NULL || state == NULL)
+        return SDCR_ERROR_NULL_PTR;
+
+    for (size_t i = 0;
+         i < ARRAY_LENGTH(gMemory.routineIDs);
+         i++)
+    {
+        if (atomic_load_explicit(&gMemory.routineIDs[i], memory_order_relaxed) == id)
+        {
+            // The routine could be cleared before the copy: check the id again.
+            const bool stateIsValid = sdcr_routine_read_state(i, state);
+            if (stateIsValid && state->id == id)
+                return SDCR_SUCCESS;
+        }
+    }
+    return SDCR_ERROR_ID_DOESNT_EXIST;
+}
+
+sdcr_status sdcr_routine_query(const char *id, uint32_t atMs, sdcr_routine_query_result *result)
+{
+    if (id == NULL || result == NULL)
+        return SDCR_ERROR_NULL_PTR;
+
+    // Lock-free reader: the ID hash table is only for the writer thread.
+    for (size_t i = 0;
+         i < ARRAY_LENGTH(gMemory.routineIDs);
+         i++)
+    {
+        if (atomic_load_explicit(&gMemory.routineIDs[i], memory_order_relaxed) == id)
+        {
+            // The routine could be cleared before the query: check the id again.
+            sdcr_status status;
+            const bool isSameRoutine = sdcr_routine_read_query(i, id, atMs, result, &status);
+            if (isSameRoutine)
+            {
+                result->id = id;
+                return status;
+            }
+        }
+    }
+    return SDCR_ERROR_ID_DOESNT_EXIST;
+}
+
+sdcr_status sdcr_routine_get_state_all(sdcr_routine_state *states, size_t capacity, size_t *count)
+{
+    if (states == NULL || count == NULL)
+        return SDCR_ERROR_NULL_PTR;
+
+    size_t copied = 0;
+    for (size_t i = 0;
+         i < ARRAY_LENGTH(gMemory.routineIDs) && copied < capacity;
+         i++)
+    {
+        const bool stateIsValid = sdcr_routine_read_state(i, &states[copied]);
+        if (stateIsValid)
+            copied++;
+    }
+    *count = copied;
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_snapshot(uint32_t nowMs, uint8_t *buffer, size_t capacity, size_t *size)
+{
+    if (size == NULL)
+        return SDCR_ERROR_NULL_PTR;
+
+    size_t routineCount = 0;
+    for (size_t i = 0; i < ARRAY_LENGTH(gMemory.routines); i++)
+    {
+        if (gMemory.configs[i].stream != 0)
+            return SDCR_ERROR_INVALID_API_USAGE; //< the source state is not known
+        if (gMemory.configs[i].isText)
+            return SDCR_ERROR_INVALID_API_USAGE; //< the string may not outlive the program
+        routineCount += gMemory.routines[i].isUsed;
+    }
+    *size = sizeof(sdcr_snapshot_header) +
+            routineCount * sizeof(sdcr_snapshot_record) +
+            gMemory.eventsUsed * sizeof(sdcr_event);
+    if (buffer == NULL)
+        return SDCR_SUCCESS; //< only the size
+    if (capacity < *size)
+        return SDCR_ERROR_INVALID_API_USAGE;
+
+    const sdcr_snapshot_header header = {
+        .magic = SDCR_SNAPSHOT_MAGIC,
+        .version = SDCR_SNAPSHOT_VERSION,
+        .routineCount = (uint16_t)routineCount,
+        .size = (uint32_t)*size,
+        .checksum = 0,
+        .maxRoutines = SDCR_MAX_NUMBER_OF_ROUTINE,
+        .eventsUsed = gMemory.eventsUsed,
+        .recordSize = sizeof(sdcr_snapshot_record),
+        .eventSize = sizeof(sdcr_event),
+        .dataAnchor = (uintptr_t)&gSnapshotAnchor,
+        .codeAnchor = (uintptr_t)sdcr_task,
+    };
+    memcpy(buffer, &header, sizeof(header));
+    size_t offset = sizeof(header);
+    for (size_t i = 0; i < ARRAY_LENGTH(gMemory.routines); i++)
+    {
+        if (!gMemory.routines[i].isUsed)
+            continue;
+
+        sdcr_snapshot_record record = {
+            .index = (uint16_t)i,
+            .id = gMemory.routineIDs[i],
+            .hot = gMemory.routines[i],
+            .config = gMemory.configs[i],
+            .cold = gMemory.coldStates[i],
+        };
+        if (record.cold.completion != 0)
+            record.completion = gMemory.completions[record.cold.completion - 1u];
+        record.hot.timestampLastAction = nowMs - record.hot.timestampLastAction;
+        record.cold.firstStepMs = nowMs - record.cold.firstStepMs;
+        memcpy(&buffer[offset], &record, sizeof(record));
+        offset += sizeof(record);
+    }
+    memcpy(&buffer[offset], gMemory.events, gMemory.eventsUsed * sizeof(sdcr_event));
+
+    const uint32_t checksum = sdcr_snapshot_hash(buffer, *size);
+    memcpy(&buffer[offsetof(sdcr_snapshot_header, checksum)], &checksum, sizeof(checksum));
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_restore(uint32_t nowMs, const uint8_t *buffer, size_t size)
+{
+    if (buffer == NULL)
+        return SDCR_ERROR_NULL_PTR;
+    if (!sdcr_snapshot_is_valid(buffer, size))
+        return SDCR_ERROR_INVALID_SNAPSHOT;
+
+    sdcr_snapshot_header header;
+    memcpy(&header, buffer, sizeof(header));
+    const uintptr_t dataAnchor = (uintptr_t)&gSnapshotAnchor;
+    const uintptr_t codeAnchor = (uintptr_t)sdcr_task;
+
+    sdcr_routine_clear_all();
+    size_t offset = sizeof(header);
+    for (size_t i = 0; i < header.routineCount; i++)
+    {
+        sdcr_snapshot_record record;
+        memcpy(&record, &buffer[offset], sizeof(record));
+        offset += sizeof(record);
+
+        // The program can be loaded at another address: move the pointers with it.
+        record.id = (const char *)sdcr_snapshot_relocate((uintptr_t)record.id, header.dataAnchor, dataAnchor);
+        record.config.callbackFunction = (sdcr_callback_function)sdcr_snapshot_relocate(
+            (uintptr_t)record.config.callbackFunction, header.codeAnchor, codeAnchor);
+        record.completion.onComplete = (sdcr_complete_function)sdcr_snapshot_relocate(
+            (uintptr_t)record.completion.onComplete, header.codeAnchor, codeAnchor);
+        record.hot.timestampLastAction = nowMs - record.hot.timestampLastAction;
+        record.cold.firstStepMs = nowMs - record.cold.firstStepMs;
+
+        const size_t index = record.index;
+        sdcr_routine_write_begin(index);
+        atomic_store_explicit(&gMemory.routineIDs[index], record.id, memory_order_relaxed);
+        gMemory.configs[index] = record.config;
+        gMemory.coldStates[index] = record.cold;
+        gMemory.routines[index] = record.hot;
+        sdcr_routine_write_end(index);
+        sdcr_id_insert(index);
+        if (record.completion.routine != 0)
+            gMemory.completions[record.cold.completion - 1u] = record.completion;
+    }
+    memcpy(gMemory.events, &buffer[offset], header.eventsUsed * sizeof(sdcr_event));
+    gMemory.eventsUsed = header.eventsUsed;
+    gMemory.freeHint = 0;
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_engine_select(const sdcr_engine *engine)
+{
+    if (engine == NULL)
+        return SDCR_ERROR_NULL_PTR;
+
+    gEngine = engine;
+    return sdcr_routine_clear_all(); //< the new engine starts empty
+}
+
+const sdcr_engine *sdcr_engine_get()
+{
+    return gEngine;
+}
+
+#ifdef SDCR_ENABLE_TRACE
+sdcr_status sdcr_trace_enable(sdcr_get_tick_function traceClock)
+{
+    if (traceClock == NULL)
+        return SDCR_ERROR_NULL_PTR;
+
+    gTrace.clock = traceClock;
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_trace_disable()
+{
+    gTrace.clock = NULL;
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_trace_read(sdcr_trace_event *events, size_t capacity, size_t *count, uint32_t *lost)
+{
+    if (events == NULL || count == NULL)
+        return SDCR_ERROR_NULL_PTR;
+
+    const unsigned head = atomic_load_explicit(&gTrace.head, memory_order_acquire);
+    unsigned tail = gTrace.tail;
+    uint32_t lostEvents = 0;
+    if (head - tail > SDCR_TRACE_BUFFER_SIZE)
+    {
+        // the writer lapped the reader
+        lostEvents = head - tail - SDCR_TRACE_BUFFER_SIZE;
+        tail = head - SDCR_TRACE_BUFFER_SIZE;
+    }
+
+    size_t copied = 0;
+    while (tail != head && copied < capacity)
+    {
+        const sdcr_trace_slot *slot = &gTrace.slots[tail & (SDCR_TRACE_BUFFER_SIZE - 1)];
+        const unsigned sequenceBefore = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (sequenceBefore != tail + 1)
+        {
+            const bool isOverwritten = ((int)(sequenceBefore - (tail + 1)) > 0);
+            if (!isOverwritten)
+                break; //< still being written, read it next time
+            lostEvents++;
+            tail++;
+            continue;
+        }
+        const sdcr_trace_event event = slot->event;
+        atomic_thread_fence(memory_order_acquire);
+        const unsigned sequenceAfter = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+        if (sequenceAfter == sequenceBefore)
+            events[copied++] = event;
+        else
+            lostEvents++; //< overwritten during the copy
+        tail++;
+    }
+    gTrace.tail = tail;
+
+    *count = copied;
+    if (lost != NULL)
+        *lost = lostEvents;
+    return SDCR_SUCCESS;
+}
+#endif // SDCR_ENABLE_TRACE
+
+//-----------------------------------------------
+// INTERNAL FUNCTIONS
+//-----------------------------------------------
+/* Will perform the due steps of every routine.
+ * param: now - the current tick, shared by all routines.
+ * param: frame - where to toggle the routine outputs. NULL to only call callbacks.
+ */
+static void sdcr_run(uint32_t now, const sdcr_frame *frame)
+{
+    sdcr_wakeup wakeup = {0};
+    sdcr_schedule_collect(now);
+    gSchedule.isRunning = true;
+    for (size_t routineIndex = sdcr_schedule_next(gSchedule.due, 0);
+         routineIndex < ARRAY_LENGTH(gMemory.routines);
+         routineIndex = sdcr_schedule_next(gSchedule.due, routineIndex + 1u))
+    {
+        sdcr_run_fanout(routineIndex, now, frame);
+        if (!sdcr_bits_test(gSchedule.due, routineIndex))
+            continue;
+        sdcr_bits_clear(gSchedule.due, routineIndex);
+        const sdcr_routine_state_machine *currentroutine = &gMemory.routines[routineIndex];
+
+        const bool routineIsEnable = (currentroutine->isEnable == true);
+        const bool routineExist = (currentroutine->isUsed == true);
+        const bool routineIsActive = (routineExist && routineIsEnable && !currentroutine->isFollower);
+        const uint32_t elapsed = sdcr_get_elapsed_time(currentroutine->timestampLastAction, now);
+        const bool actionIsNeeded = (routineIsActive && elapsed >= currentroutine->holdMs);
+        if (actionIsNeeded)
+        {
+            sdcr_wakeup_add(&wakeup, routineIndex, (int32_t)(elapsed - currentroutine->holdMs));
+            sdcr_routine_perform_step(routineIndex, now, elapsed, frame);
+        }
+        else
+        {
+            sdcr_schedule_update(routineIndex); //< the engine forgot it
+        }
+    }
+    gSchedule.isRunning = false;
+
+    // Something woke us up: perform the steps due soon, within their slack.
+    if (wakeup.steps != 0)
+    {
+        for (size_t routineIndex = sdcr_schedule_next(gSchedule.slack, 0);
+             routineIndex < ARRAY_LENGTH(gMemory.routines);
+             routineIndex = sdcr_schedule_next(gSchedule.slack, routineIndex + 1u))
+        {
+            sdcr_run_fanout(routineIndex, now, frame);
+            if (!sdcr_bits_test(gSchedule.slack, routineIndex))
+                continue;
+            const sdcr_routine_state_machine *currentroutine = &gMemory.routines[routineIndex];
+            const bool routineCanCoalesce = (currentroutine->isUsed && currentroutine->isEnable &&
+                                             currentroutine->hasSlack && !currentroutine->isFollower &&
+                                             currentroutine->timestampLastAction != now); //< not just performed
+            if (routineCanCoalesce)
+            {
+                const uint32_t elapsed = sdcr_get_elapsed_time(currentroutine->timestampLastAction, now);
+                const uint32_t slackMs = gMemory.coldStates[routineIndex].slackMs;
+                const bool isWithinSlack = (elapsed < currentroutine->holdMs &&
+                                            currentroutine->holdMs - elapsed <= slackMs);
+                if (isWithinSlack)
+                {
+                    sdcr_wakeup_add(&wakeup, routineIndex, -(int32_t)(currentroutine->holdMs - elapsed));
+                    gStats.coalescedSteps++;
+                    sdcr_routine_perform_step(routineIndex, now, elapsed, frame);
+                }
+            }
+        }
+    }
+    gSchedule.hasFanout = false; //< the followers are after their leader: all shared
+    sdcr_stream_refill();
+    sdcr_wakeup_account(&wakeup);
+}
+
+/* Will find the routines to check in this pass.
+ * The elapsed time is unsigned (see `sdcr_get_elapsed_time`): a last step
+ * in the future is due right away. The engine deadlines don't see it.
+ */
+static void sdcr_schedule_collect(uint32_t now)
+{
+    if ((int32_t)(now - gSchedule.lastNow) < 0)
+    {
+        // The time went back: every last step may be in the future.
+        for (size_t i = 0; i < ARRAY_LENGTH(gMemory.routines); i++)
+        {
+            if (gMemory.routines[i].isUsed && gMemory.routines[i].isEnable)
+                sdcr_bits_set(gSchedule.due, i);
+        }
+    }
+    else
+    {
+        for (size_t i = sdcr_bits_next(gSchedule.early, 0);
+             i < ARRAY_LENGTH(gMemory.routines);
+             i = sdcr_bits_next(gSchedule.early, i + 1u))
+        {
+            sdcr_bits_set(gSchedule.due, i);
+            if ((int32_t)(now - gMemory.routines[i].timestampLastAction) >= 0)
+                sdcr_bits_clear(gSchedule.early, i); //< now only due at its deadline
+        }
+    }
+    gEngine->collect(now, gSchedule.due);
+    gSchedule.lastNow = now;
+}
+
+/* Will give the engine the new deadline of a routine.
+ * During a pass, a routine due now is checked in this pass if it is after
+ * the current one, like a check of every routine in order would do.
+ */
+static void sdcr_schedule_update(size_t index)
+{
+    const sdcr_routine_state_machine *routine = &gMemory.routines[index];
+    const bool routineIsActive = (routine->isUsed && routine->isEnable && !routine->isFollower);
+    gEngine->update(index, routine->timestampLastAction + routine->holdMs, routineIsActive);
+
+    const bool isEarly = (routineIsActive && (int32_t)(routine->timestampLastAction - gSchedule.lastNow) > 0);
+    if (isEarly)
+        sdcr_bits_set(gSchedule.early, index);
+    else
+        sdcr_bits_clear(gSchedule.early, index);
+    if (routine->isUsed && routine->hasSlack)
+        sdcr_bits_set(gSchedule.slack, index);
+    else
+        sdcr_bits_clear(gSchedule.slack, index);
+
+    const bool isDueNow = (gSchedule.isRunning && routineIsActive &&
+                           sdcr_get_elapsed_time(routine->timestampLastAction, gSchedule.lastNow) >= routine->holdMs);
+    if (isDueNow)
+        sdcr_bits_set(gSchedule.due, index);
+}
+
+/* return: The next routine to visit in this pass, from `index`: set in `bits`, or with a pending share. */
+static size_t sdcr_schedule_next(const uint64_t *bits, size_t index)
+{
+    size_t next = sdcr_bits_next(bits, index);
+    if (gSchedule.hasFanout)
+    {
+        const size_t call = sdcr_bits_next(gSchedule.fanout, index);
+        const size_t done = sdcr_bits_next(gSchedule.fanoutDone, index);
+        next = (call < next) ? call : next;
+        next = (done < next) ? done : next;
+    }
+    return next;
+}
+
+/* Will drop the pending share of a routine: it no longer steps in this pass. */
+static void sdcr_schedule_cancel(size_t index)
+{
+    sdcr_bits_clear(gSchedule.fanout, index);
+    sdcr_bits_clear(gSchedule.fanoutDone, index);
+}
+
+/* Will perform the share of a follower in its leader step, at its own index.
+ * The routines act in their order, like routines not sharing a timeline.
+ */
+static void sdcr_run_fanout(size_t index, uint32_t now, const sdcr_frame *frame)
+{
+    if (!gSchedule.hasFanout)
+        return;
+
+    const bool isCall = sdcr_bits_test(gSchedule.fanout, index);
+    const bool isComplete = sdcr_bits_test(gSchedule.fanoutDone, index);
+    sdcr_schedule_cancel(index);
+    if (isCall)
+        sdcr_routine_perform_action(index, frame);
+    if (isComplete)
+        sdcr_routine_complete(index, now, frame);
+}
+
+/* Will find when the next step of a routine is due, and until when it can wait.
+ * param: deadline, limit - where to write the times, from `nowMs`. 0 if overdue.
+ * return: false if the routine isn't scheduled on its own.
+ */
+static bool sdcr_routine_wakeup_window(size_t index, uint32_t nowMs, uint64_t *deadline, uint64_t *limit)
+{
+    const sdcr_routine_state_machine *routine = &gMemory.routines[index];
+    const bool routineIsActive = (routine->isUsed && routine->isEnable && !routine->isFollower);
+    if (!routineIsActive)
+        return false;
+
+    const uint32_t elapsed = sdcr_get_elapsed_time(routine->timestampLastAction, nowMs);
+    const uint32_t slackMs = routine->hasSlack ? gMemory.coldStates[index].slackMs : 0;
+    const uint64_t latest = (uint64_t)routine->holdMs + slackMs; //< since the last step
+    *deadline = (routine->holdMs > elapsed) ? routine->holdMs - elapsed : 0;
+    *limit = (latest > elapsed) ? latest - elapsed : 0;
+    return true;
+}
+
+/* Will remember a step performed in this pass.
+ * The deadlines of the steps with slack are counted as they are recorded.
+ * Past `SDCR_WAKEUP_DEADLINES` of them, each step counts as a deadline of its own.
+ * param: lateness - the time since the step deadline, negative when early.
+ */
+static void sdcr_wakeup_add(sdcr_wakeup *wakeup, size_t index, int32_t lateness)
+{
+    wakeup->steps++;
+    if (wakeup->steps == 1 || lateness > wakeup->maxLateness)
+        wakeup->maxLateness = lateness;
+    if (!gMemory.routines[index].hasSlack)
+        return;
+
+    const size_t known = (wakeup->slackDeadlines < SDCR_WAKEUP_DEADLINES) ? wakeup->slackDeadlines
+                                                                           : SDCR_WAKEUP_DEADLINES;
+    for (size_t i = 0; i < known; i++)
+    {
+        if (wakeup->slackLateness[i] == lateness)
+            return; //< not a new deadline
+    }
+    if (known < SDCR_WAKEUP_DEADLINES)
+        wakeup->slackLateness[known] = lateness;
+    wakeup->slackDeadlines++;
+}
+
+/* Will update the stats with the steps performed in this pass.
+ * The earliest deadline woke `sdcr_task` up. Each other deadline of a
+ * routine with slack would have needed a wakeup of its own.
+ */
+static void sdcr_wakeup_account(const sdcr_wakeup *wakeup)
+{
+    if (wakeup->steps == 0)
+        return;
+
+    gStats.wakeups++;
+    gStats.steps += wakeup->steps;
+    bool isWakeupDeadline = false; //< a routine with slack was due at the earliest deadline
+    for (size_t i = 0; i < wakeup->slackDeadlines && i < SDCR_WAKEUP_DEADLINES; i++)
+    {
+        isWakeupDeadline |= (wakeup->slackLateness[i] == wakeup->maxLateness);
+    }
+    gStats.savedWakeups += wakeup->slackDeadlines - isWakeupDeadline;
+}
+
+static void sdcr_routine_perform_step(size_t index, uint32_t now, uint32_t elapsed, const sdcr_frame *frame)
+{
+    sdcr_routine_state_machine *routine = &gMemory.routines[index];
+    SDCR_TRACE_STEP(index, (elapsed > routine->holdMs) ? elapsed - routine->holdMs : 0, routine->holdMs);
+    const uint32_t deadlineMs = routine->holdMs; //< since the last step
+
+    // The state is updated before the callback: readers never wait on user code.
+    sdcr_routine_write_begin(index);
+    const bool isCall = sdcr_get_action(index);
+    routine->timestampLastAction = now; //< update timestamp
+    if (routine->hasSlack)
+        sdcr_routine_keep_deadline(index, deadlineMs, elapsed);
+    sdcr_routine_write_end(index);
+    const bool isComplete = (routine->isEnable == false); //< the last cycle started
+
+    // The followers are after their leader: their share is performed at their own index.
+    if (isCall || isComplete)
+    {
+        for (size_t member = gMemory.coldStates[index].groupNext;
+             member != 0;
+             member = gMemory.coldStates[member - 1u].groupNext)
+        {
+            if (isCall)
+                sdcr_bits_set(gSchedule.fanout, member - 1u);
+            if (isComplete)
+                sdcr_bits_set(gSchedule.fanoutDone, member - 1u);
+            gSchedule.hasFanout = true;
+        }
+    }
+    if (isCall)
+    {
+        sdcr_routine_perform_action(index, frame);
+    }
+    if (isComplete)
+    {
+        // The group is split first: the completions may restart its routines.
+        while (gMemory.coldStates[index].groupNext != 0)
+        {
+            sdcr_group_split(gMemory.coldStates[index].groupNext - 1u);
+        }
+        sdcr_routine_complete(index, now, frame);
+    }
+}
+
+/* Will time the next step from the deadline of a step performed within its slack.
+ * Steps performed early or late to share a wakeup don't move the routine timeline.
+ * The last step time stays the actual one: only the time to wait changes.
+ * param: deadlineMs - the time the step was due, since the previous step.
+ * param: elapsed - the time the step was performed, since the previous step.
+ */
+static void sdcr_routine_keep_deadline(size_t index, uint32_t deadlineMs, uint32_t elapsed)
+{
+    sdcr_routine_state_machine *routine = &gMemory.routines[index];
+    const uint32_t slackMs = gMemory.coldStates[index].slackMs;
+    if (elapsed < deadlineMs && deadlineMs - elapsed <= slackMs)
+    {
+        routine->holdMs += deadlineMs - elapsed; //< early
+    }
+    else if (elapsed >= deadlineMs && elapsed - deadlineMs <= slackMs)
+    {
+        const uint32_t lateness = elapsed - deadlineMs;
+        if (routine->holdMs >= lateness)
+        {
+            routine->holdMs -= lateness;
+        }
+        else
+        {
+            routine->timestampLastAction -= lateness - routine->holdMs; //< the next step is overdue already
+            routine->holdMs = 0;
+        }
+    }
+}
+
+static void sdcr_routine_perform_action(size_t index, const sdcr_frame *frame)
+{
+    if (frame != NULL && gMemory.routines[index].hasOutput)
+    {
+        // render mode: a single memory write, no indirect call
+        const size_t outputBit = gMemory.coldStates[index].outputBit;
+        const size_t byte = outputBit >> 3;
+        if (byte < frame->size)
+            frame->bits[byte] ^= (uint8_t)(1u << (outputBit & 7u));
+    }
+    else
+    {
+        SDCR_TRACE(SDCR_TRACE_CALLBACK_BEGIN, index, 0);
+        gMemory.configs[index].callbackFunction();
+        SDCR_TRACE(SDCR_TRACE_CALLBACK_END, index, 0);
+    }
+}
+
+/* Will notify the completion of a routine, and start the chained routine.
+ * The chained routine is resolved when chained: no lookup here.
+ * Without offset, its first step is performed right away, in the same pass.
+ */
+static void sdcr_routine_complete(size_t index, uint32_t now, const sdcr_frame *frame)
+{
+    const size_t completionIndex = gMemory.coldStates[index].completion;
+    if (completionIndex == 0)
+        return;
+
+    const sdcr_completion *completion = &gMemory.completions[completionIndex - 1u];
+    if (completion->onComplete != NULL)
+    {
+        completion->onComplete(gMemory.routineIDs[index]);
+    }
+    if (completion->chainNext == 0)
+        return;
+
+    const size_t nextIndex = completion->chainNext - 1u;
+    sdcr_routine_state_machine *next = &gMemory.routines[nextIndex];
+    sdcr_group_split(nextIndex);
+    sdcr_schedule_cancel(nextIndex);
+    sdcr_routine_write_begin(nextIndex);
+    next->isEnable = true;
+    next->isInfinite = (completion->chainCycles == 0);
+    next->cyclesLeft = completion->chainCycles;
+    sdcr_routine_rewind(nextIndex); //< start from the begining
+    next->timestampLastAction = now;
+    next->holdMs = completion->chainOffsetMs; //< first step is due after the offset
+    next->hasStartTime = true;
+    gMemory.coldStates[nextIndex].firstStepMs = now + completion->chainOffsetMs;
+    gMemory.coldStates[nextIndex].startCycles = completion->chainCycles;
+    sdcr_routine_write_end(nextIndex);
+    SDCR_TRACE(SDCR_TRACE_START, nextIndex, completion->chainCycles);
+
+    // A fresh routine can't complete on its first step: no deeper recursion.
+    if (next->holdMs == 0)
+    {
+        sdcr_routine_perform_step(nextIndex, now, 0, frame);
+    }
+    sdcr_group_merge(nextIndex);
+}
+
+/* Will find the completion of a routine, or take a free one for it.
+ * param: isNeeded - take a free completion if the routine has none.
+ * return: NULL if the routine has none, or if every completion is taken.
+ */
+static sdcr_completion *sdcr_completion_get(size_t index, bool isNeeded)
+{
+    sdcr_routine_cold_state *cold = &gMemory.coldStates[index];
+    if (cold->completion != 0)
+        return &gMemory.completions[cold->completion - 1u];
+    if (!isNeeded)
+        return NULL;
+
+    for (size_t i = 0; i < ARRAY_LENGTH(gMemory.completions); i++)
+    {
+        if (gMemory.completions[i].routine == 0)
+        {
+            gMemory.completions[i] = (sdcr_completion){.routine = (uint16_t)(index + 1u)};
+            cold->completion = (uint16_t)(i + 1u);
+            return &gMemory.completions[i];
+        }
+    }
+    return NULL;
+}
+
+/* Will give back the completion of a routine once it does nothing. */
+static void sdcr_completion_release(size_t index)
+{
+    sdcr_routine_cold_state *cold = &gMemory.coldStates[index];
+    if (cold->completion == 0)
+        return;
+
+    sdcr_completion *completion = &gMemory.completions[cold->completion - 1u];
+    if (completion->onComplete == NULL && completion->chainNext == 0)
+    {
+        *completion = (sdcr_completion){0};
+        cold->completion = 0;
+    }
+}
+
+/* Will make a routine follow the timeline of an identical routine, if any.
+ * Routines are identical when they have the same compiled events (so the
+ * same step time) and the same state: same phase, same cycles left.
+ * note: The routine must not be in a group.
+ */
+static void sdcr_group_merge(size_t index)
+{
+    if (!gMemory.routines[index].isEnable)
+        return;
+
+    for (size_t leader = 0;
+         leader < ARRAY_LENGTH(gMemory.routines);
+         leader++)
+    {
+        if (sdcr_group_can_follow(index, leader))
+        {
+            (void)sdcr_group_follow(index, leader);
+            return;
+        }
+    }
+}
+
+/* Will add a routine to a group, in the routines order.
+ * The first routine leads: the followers share its step after it, at their own index.
+ * return: The leader of the group.
+ */
+static size_t sdcr_group_follow(size_t index, size_t leader)
+{
+    sdcr_routine_cold_state *cold = &gMemory.coldStates[index];
+    if (index < leader)
+    {
+        // the routine leads the group now
+        cold->groupNext = (uint16_t)(leader + 1u);
+        for (size_t member = cold->groupNext;
+             member != 0;
+             member = gMemory.coldStates[member - 1u].groupNext)
+        {
+            sdcr_routine_write_begin(member - 1u);
+            gMemory.routines[member - 1u].isFollower = true;
+            gMemory.coldStates[member - 1u].groupLeader = (uint16_t)(index + 1u);
+            sdcr_routine_write_end(member - 1u);
+        }
+        return index;
+    }
+
+    sdcr_routine_write_begin(index);
+    gMemory.routines[index].isFollower = true;
+    cold->groupLeader = (uint16_t)(leader + 1u);
+    sdcr_routine_write_end(index);
+    uint16_t *link = &gMemory.coldStates[leader].groupNext;
+    while (*link != 0 && *link - 1u < index)
+    {
+        link = &gMemory.coldStates[*link - 1u].groupNext;
+    }
+    cold->groupNext = *link;
+    *link = (uint16_t)(index + 1u);
+    return leader;
+}
+
+/* Will take the marked routines out of their group, in one pass.
+ * Same as `sdcr_group_split` for each marked routine, without walking
+ * the groups again for each routine.
+ */
+static void sdcr_group_split_marked()
+{
+    for (size_t leader = 0;
+         leader < ARRAY_LENGTH(gMemory.routines);
+         leader++)
+    {
+        sdcr_routine_cold_state *leaderCold = &gMemory.coldStates[leader];
+        if (gMemory.routines[leader].isFollower || leaderCold->groupNext == 0)
+            continue; //< not a group leader
+
+        // detach the marked followers, keep the others in order
+        uint16_t *tail = &leaderCold->groupNext;
+        size_t member = leaderCold->groupNext;
+        while (member != 0)
+        {
+            const size_t follower = member - 1u;
+            member = gMemory.coldStates[follower].groupNext;
+            if (sdcr_bits_test(gBulk.marked, follower))
+            {
+                sdcr_group_detach(follower, leader);
+                gMemory.coldStates[follower].groupNext = 0;
+            }
+            else
+            {
+                *tail = (uint16_t)(follower + 1u);
+                tail = &gMemory.coldStates[follower].groupNext;
+            }
+        }
+        *tail = 0;
+
+        // a marked leader hands the group to its first follower
+        if (sdcr_bits_test(gBulk.marked, leader) && leaderCold->groupNext != 0)
+        {
+            const size_t newLeader = leaderCold->groupNext - 1u;
+            sdcr_group_detach(newLeader, leader);
+            for (size_t follower = gMemory.coldStates[newLeader].groupNext;
+                 follower != 0;
+                 follower = gMemory.coldStates[follower - 1u].groupNext)
+            {
+                gMemory.coldStates[follower - 1u].groupLeader = (uint16_t)(newLeader + 1u);
+            }
+            leaderCold->groupNext = 0;
+        }
+    }
+}
+
+/* Will merge the marked routines with identical routines, in one pass.
+ * The group leaders are indexed by timeline in a hash table first, so each
+ * marked routine only compares its timeline with the leaders of the same hash.
+ */
+static void sdcr_group_merge_marked()
+{
+    memset(gBulk.leaders, 0, sizeof(gBulk.leaders));
+    for (size_t pass = 0; pass < 2; pass++)
+    {
+        // first the running routines, then the marked routines in order
+        for (size_t index = 0;
+             index < ARRAY_LENGTH(gMemory.routines);
+             index++)
+        {
+            const sdcr_routine_state_machine *routine = &gMemory.routines[index];
+            const bool isCandidate = (routine->isUsed && routine->isEnable && !routine->isFollower &&
+                                      sdcr_bits_test(gBulk.marked, index) == (pass == 1));
+            if (!isCandidate)
+                continue;
+
+            size_t slot = sdcr_group_key(index) % SDCR_ID_TABLE_SIZE;
+            bool isMerged = false;
+            while (gBulk.leaders[slot] != 0 && !isMerged)
+            {
+                const size_t leader = gBulk.leaders[slot] - 1u;
+                isMerged = (pass == 1 && sdcr_group_can_follow(index, leader));
+                if (isMerged)
+                    gBulk.leaders[slot] = (uint16_t)(sdcr_group_follow(index, leader) + 1u);
+                slot = (slot + 1u) % SDCR_ID_TABLE_SIZE;
+            }
+            if (!isMerged)
+                gBulk.leaders[slot] = (uint16_t)(index + 1u);
+        }
+    }
+}
+
+/* Will hash what must be equal to share a timeline. See `sdcr_group_can_follow`. */
+static uint32_t sdcr_group_key(size_t index)
+{
+    const sdcr_routine_state_machine *routine = &gMemory.routines[index];
+    const sdcr_routine_configuration_compiled *config = &gMemory.configs[index];
+    const uint32_t fields[] = {
+        (config->isText || config->stream != 0) ? 0u : sdcr_events_hash(config->eventBegin, config->eventCount),
+        gMemory.coldStates[index].slackMs,
+        routine->timestampLastAction,
+        routine->holdMs,
+        routine->eventCursor,
+        routine->runCursor,
+        routine->isInfinite ? UINT32_MAX : routine->cyclesLeft,
+    };
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < ARRAY_LENGTH(fields); i++)
+    {
+        hash ^= fields[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Will take a routine out of its group.
+ * It keeps the state of the group timeline: its behavior doesn't change.
+ * If the routine leads the group, its first follower becomes the leader.
+ */
+static void sdcr_group_split(size_t index)
+{
+    sdcr_routine_cold_state *cold = &gMemory.coldStates[index];
+    if (gMemory.routines[index].isFollower)
+    {
+        const size_t leader = cold->groupLeader - 1u;
+        uint16_t *link = &gMemory.coldStates[leader].groupNext;
+        while (*link != index + 1u)
+        {
+            link = &gMemory.coldStates[*link - 1u].groupNext;
+        }
+        *link = cold->groupNext; //< unlink
+        sdcr_group_detach(index, leader);
+    }
+    else if (cold->groupNext != 0)
+    {
+        const size_t newLeader = cold->groupNext - 1u;
+        sdcr_group_detach(newLeader, index);
+        for (size_t member = gMemory.coldStates[newLeader].groupNext;
+             member != 0;
+             member = gMemory.coldStates[member - 1u].groupNext)
+        {
+            gMemory.coldStates[member - 1u].groupLeader = (uint16_t)(newLeader + 1u);
+        }
+    }
+    cold->groupLeader = 0;
+    cold->groupNext = 0;
+}
+
+/* Will give a follower its own copy of the leader timeline, with the copy counters of its events. */
+static void sdcr_group_detach(size_t index, size_t leader)
+{
+    sdcr_routine_state_machine *routine = &gMemory.routines[index];
+    const sdcr_routine_state_machine *timeline = &gMemory.routines[leader];
+    const sdcr_routine_configuration_compiled *config = &gMemory.configs[index];
+    const sdcr_routine_configuration_compiled *leaderConfig = &gMemory.configs[leader];
+    sdcr_routine_write_begin(index);
+    for (size_t i = 0; i < config->eventCount; i++)
+    {
+        sdcr_event *event = &gMemory.events[config->eventBegin + i];
+        if (event->isRepeat)
+            event->played = gMemory.events[leaderConfig->eventBegin + i].played;
+    }
+    routine->timestampLastAction = timeline->timestampLastAction;
+    routine->holdMs = timeline->holdMs;
+    routine->eventCursor = timeline->eventCursor;
+    routine->runCursor = timeline->runCursor;
+    routine->cyclesLeft = timeline->cyclesLeft;
+    routine->isEnable = timeline->isEnable;
+    routine->isInfinite = timeline->isInfinite;
+    routine->isFollower = false;
+    gMemory.coldStates[index].groupLeader = 0;
+    sdcr_routine_write_end(index);
+}
+
+static bool sdcr_group_can_follow(size_t index, size_t leader)
+{
+    const sdcr_routine_state_machine *routine = &gMemory.routines[index];
+    const sdcr_routine_state_machine *timeline = &gMemory.routines[leader];
+    const sdcr_routine_configuration_compiled *config = &gMemory.configs[index];
+    const sdcr_routine_configuration_compiled *leaderConfig = &gMemory.configs[leader];
+
+    const bool isCandidate = (leader != index &&
+                              timeline->isUsed && timeline->isEnable && !timeline->isFollower &&
+                              leaderConfig->stream == 0 && config->stream == 0 &&
+                              !leaderConfig->isText && !config->isText &&
+                              leaderConfig->eventCount == config->eventCount);
+    if (!isCandidate)
+        return false;
+
+    const bool isSamePhase = (timeline->timestampLastAction == routine->timestampLastAction &&
+                              timeline->holdMs == routine->holdMs &&
+                              timeline->eventCursor == routine->eventCursor &&
+                              timeline->runCursor == routine->runCursor &&
+                              timeline->isInfinite == routine->isInfinite &&
+                              gMemory.coldStates[leader].slackMs == gMemory.coldStates[index].slackMs &&
+                              (routine->isInfinite || timeline->cyclesLeft == routine->cyclesLeft));
+    if (!isSamePhase)
+        return false;
+
+    for (size_t i = 0; i < config->eventCount; i++)
+    {
+        const sdcr_event *event = &gMemory.events[config->eventBegin + i];
+        const sdcr_event *leaderEvent = &gMemory.events[leaderConfig->eventBegin + i];
+        if (event->holdMs != leaderEvent->holdMs || //< and the copy counters of a repeat
+            event->steps != leaderEvent->steps ||
+            event->isCall != leaderEvent->isCall ||
+            event->isRepeat != leaderEvent->isRepeat)
+            return false;
+    }
+    return true;
+}
+
+/* Will find a routine with the ID hash table.
+ * note: Only for the thread writing the routines: the lock-free readers
+ *       scan `routineIDs` instead.
+ */
+static bool sdcr_get_index_from_id(const char *id, size_t *index)
+{
+    for (size_t slot = sdcr_id_hash(id);
+         gMemory.idTable[slot] != 0;
+         slot = (slot + 1u) % SDCR_ID_TABLE_SIZE)
+    {
+        const size_t i = gMemory.idTable[slot] - 1u;
+        if (gMemory.routineIDs[i] == id)
+        {
+            *index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Will hash an ID address. IDs are compared by address, not by value. */
+static size_t sdcr_id_hash(const char *id)
+{
+    uint64_t hash = (uint64_t)(uintptr_t)id;
+    hash ^= hash >> 29;
+    hash *= 0xbf58476d1ce4e5b9u;
+    hash ^= hash >> 32;
+    return (size_t)(hash % SDCR_ID_TABLE_SIZE);
+}
+
+static void sdcr_id_insert(size_t index)
+{
+    size_t slot = sdcr_id_hash(gMemory.routineIDs[index]);
+    while (gMemory.idTable[slot] != 0)
+    {
+        slot = (slot + 1u) % SDCR_ID_TABLE_SIZE;
+    }
+    gMemory.idTable[slot] = (uint16_t)(index + 1u);
+}
+
+/* Will remove an ID from the hash table.
+ * The next entries of the probe sequence are moved back in the hole,
+ * so no "deleted" marker is needed.
+ */
+static void sdcr_id_remove(size_t index)
+{
+    size_t hole = sdcr_id_hash(gMemory.routineIDs[index]);
+    while (gMemory.idTable[hole] != index + 1u)
+    {
+        if (gMemory.idTable[hole] == 0)
+            return; //< not in the table
+        hole = (hole + 1u) % SDCR_ID_TABLE_SIZE;
+    }
+
+    for (size_t slot = (hole + 1u) % SDCR_ID_TABLE_SIZE;
+         gMemory.idTable[slot] != 0;
+         slot = (slot + 1u) % SDCR_ID_TABLE_SIZE)
+    {
+        // the entry can move back if the hole is between its home and its slot
+        const size_t home = sdcr_id_hash(gMemory.routineIDs[gMemory.idTable[slot] - 1u]);
+        const size_t distanceFromHome = (slot + SDCR_ID_TABLE_SIZE - home) % SDCR_ID_TABLE_SIZE;
+        const size_t distanceFromHole = (slot + SDCR_ID_TABLE_SIZE - hole) % SDCR_ID_TABLE_SIZE;
+        if (distanceFromHome >= distanceFromHole)
+        {
+            gMemory.idTable[hole] = gMemory.idTable[slot];
+            hole = slot;
+        }
+    }
+    gMemory.idTable[hole] = 0;
+}
+
+/* Will mark the routines of a bulk operation, and write the status of each ID.
+ * return: The first error, or success.
+ */
+static sdcr_status sdcr_bulk_mark(const char *const *ids, size_t count, sdcr_status *statuses)
+{
+    memset(gBulk.marked, 0, sizeof(gBulk.marked));
+    sdcr_status result = SDCR_SUCCESS;
+    for (size_t i = 0; i < count; i++)
+    {
+        sdcr_status status = SDCR_ERROR_NULL_PTR;
+        size_t index;
+        if (ids[i] != NULL)
+            status = sdcr_get_index_from_id(ids[i], &index) ? SDCR_SUCCESS : SDCR_ERROR_ID_DOESNT_EXIST;
+        if (status == SDCR_SUCCESS)
+            sdcr_bits_set(gBulk.marked, index);
+        if (statuses != NULL)
+            statuses[i] = status;
+        if (result == SDCR_SUCCESS)
+            result = status;
+    }
+    return result;
+}
+
+static bool sdcr_get_action(size_t index)
+{
+    sdcr_routine_state_machine *routine = &gMemory.routines[index];
+    const sdcr_routine_configuration_compiled *config = &gMemory.configs[index];
+    if (config->stream != 0)
+        return sdcr_stream_get_action(index);
+
+    const char *text = config->isText ? config->text : NULL;
+    const bool routineNeedToLoop = (text != NULL) ? (text[routine->textCursor] == '\0')
+                                                  : (routine->eventCursor >= config->eventCount);
+    if (routineNeedToLoop)
+    {
+        routine->eventCursor = 0; //< return to the begining
+        routine->runCursor = 0;
+        if (!!!routine->isInfinite)
+        {
+            routine->cyclesLeft--;
+
+            const bool isThisTheLastCycle = (routine->cyclesLeft <= 1);
+            if (isThisTheLastCycle)
+            {
+                routine->isEnable = false;
+                SDCR_TRACE(SDCR_TRACE_STOP, index, 0);
+            }
+        }
+        SDCR_TRACE(SDCR_TRACE_CYCLE_WRAP, index, routine->isInfinite ? 0 : routine->cyclesLeft);
+    }
+    if (text != NULL)
+    {
+        const char action = text[routine->textCursor];
+        routine->textCursor++; //< Advance the cursor
+        routine->holdMs = config->routineStepTimeMs;
+        return (action != '.');
+    }
+    const sdcr_event *event = &gMemory.events[config->eventBegin + routine->eventCursor];
+    routine->holdMs = event->holdMs;
+    routine->runCursor++; //< Advance the cursor
+    if (routine->runCursor >= event->steps)
+    {
+        routine->eventCursor++;
+        routine->runCursor = 0;
+        sdcr_events_repeat(index);
+    }
+    return event->isCall;
+}
+
+/* Will move the cursor of a routine past the repeat events it reached.
+ * A group not played for all its copies yet is played again from its first event.
+ */
+static void sdcr_events_repeat(size_t index)
+{
+    sdcr_routine_state_machine *routine = &gMemory.routines[index];
+    const sdcr_routine_configuration_compiled *config = &gMemory.configs[index];
+    while (routine->eventCursor < config->eventCount)
+    {
+        sdcr_event *repeat = &gMemory.events[config->eventBegin + routine->eventCursor];
+        if (!repeat->isRepeat)
+            return;
+        repeat->played++;
+        if (repeat->played < repeat->steps)
+        {
+            routine->eventCursor = (uint16_t)(routine->eventCursor - repeat->body);
+            return;
+        }
+        repeat->played = 0; //< every copy played: the next cycle, or the enclosing group, starts over
+        routine->eventCursor++;
+    }
+}
+
+/* Will put a routine back on its first step, with its repeated groups on their first copy. */
+static void sdcr_routine_rewind(size_t index)
+{
+    sdcr_routine_state_machine *routine = &gMemory.routines[index];
+    const sdcr_routine_configuration_compiled *config = &gMemory.configs[index];
+    routine->eventCursor = 0;
+    routine->runCursor = 0;
+    if (config->isText || config->stream != 0)
+        return;
+    for (size_t i = config->eventBegin; i < config->eventBegin + config->eventCount; i++)
+    {
+        if (gMemory.events[i].isRepeat)
+            gMemory.events[i].played = 0;
+    }
+}
+
+/* Will advance a stream routine by one step.
+ * The window is played half by half. Leaving a half marks it to be pulled
+ * again at the end of the pass: the source has a whole half of lead time.
+ * A stream has no cycles: it completes with the last step of its source.
+ */
+static bool sdcr_stream_get_action(size_t index)
+{
+    sdcr_routine_state_machine *routine = &gMemory.routines[index];
+    const sdcr_routine_configuration_compiled *config = &gMemory.configs[index];
+    sdcr_stream *stream = &gMemory.streams[config->stream - 1u];
+
+    const sdcr_event *event = &gMemory.events[config->eventBegin + routine->eventCursor];
+    routine->holdMs = event->holdMs;
+    routine->runCursor++; //< Advance the cursor
+    if (routine->runCursor >= event->steps)
+    {
+        const size_t half = routine->eventCursor / SDCR_STREAM_CHUNK_SIZE;
+        routine->eventCursor++;
+        routine->runCursor = 0;
+        if (routine->eventCursor - half * SDCR_STREAM_CHUNK_SIZE >= stream->fill[half])
+        {
+            const size_t otherHalf = 1u - half;
+            routine->eventCursor = (uint16_t)(otherHalf * SDCR_STREAM_CHUNK_SIZE);
+            stream->refill = (uint8_t)(half + 1u);
+            if (stream->fill[otherHalf] == 0)
+            {
+                routine->isEnable = false; //< the source ended: this is the last step
+                SDCR_TRACE(SDCR_TRACE_STOP, index, 0);
+            }
+        }
+    }
+    return event->isCall;
+}
+
+/* Will pull the next events of each stream in the half played last.
+ * Called at the end of the pass: the sources never delay a step.
+ */
+static void sdcr_stream_refill(void)
+{
+    for (size_t i = 0; i < ARRAY_LENGTH(gMemory.streams); i++)
+    {
+        sdcr_stream *stream = &gMemory.streams[i];
+        if (stream->source == NULL || stream->refill == 0)
+            continue;
+
+        const size_t half = stream->refill - 1u;
+        stream->refill = 0;
+        sdcr_stream_pull(stream->routine, half);
+    }
+}
+
+/* Will pull up to a half of events from the stream source.
+ * The source writes in a local chunk: the seqlock is only held to copy it,
+ * readers never wait on user code.
+ */
+static void sdcr_stream_pull(size_t index, size_t half)
+{
+    const sdcr_routine_configuration_compiled *config = &gMemory.configs[index];
+    sdcr_stream *stream = &gMemory.streams[config->stream - 1u];
+    sdcr_stream_event chunk[SDCR_STREAM_CHUNK_SIZE];
+    size_t count = 0;
+    if (!stream->isEnded)
+    {
+        count = stream->source(stream->context, chunk, ARRAY_LENGTH(chunk));
+        if (count > ARRAY_LENGTH(chunk))
+            count = ARRAY_LENGTH(chunk);
+        stream->isEnded = (count == 0);
+    }
+
+    const size_t eventIndex = config->eventBegin + half * SDCR_STREAM_CHUNK_SIZE;
+    const uint32_t stepTimeMs = config->routineStepTimeMs;
+    sdcr_routine_write_begin(index); //< the readers count the steps of the window
+    for (size_t i = 0; i < count; i++)
+    {
+        gMemory.events[eventIndex + i] = (sdcr_event){
+            .holdMs = (chunk[i].holdMs != 0) ? chunk[i].holdMs : stepTimeMs,
+            .steps = (chunk[i].steps != 0) ? chunk[i].steps : 1u,
+            .isCall = chunk[i].isCall,
+        };
+    }
+    stream->fill[half] = (uint16_t)count; //< 0 once the source ended
+    sdcr_routine_write_end(index);
+}
+
+/* Streams can't rewind: they can't start from their begining,
+ * and can't start again once their source ended.
+ */
+static bool sdcr_stream_can_start(size_t index, bool isFromBeginning)
+{
+    const size_t stream = gMemory.configs[index].stream;
+    if (stream == 0)
+        return true;
+
+    const size_t half = gMemory.routines[index].eventCursor / SDCR_STREAM_CHUNK_SIZE;
+    return !isFromBeginning && gMemory.streams[stream - 1u].fill[half] != 0;
+}
+
+static uint32_t sdcr_get_elapsed_time(uint32_t then, uint32_t now)
+{
+    uint32_t elapsed = now - then;
+    return elapsed;
+}
+
+/* Seqlock writer side.
+ * Only `sdcr_task` and the API functions write a routine state,
+ * so writers never contend and never wait on readers.
+ */
+static void sdcr_routine_write_begin(size_t index)
+{
+    atomic_uint *sequence = &gMemory.sequences[index];
+    const unsigned value = atomic_load_explicit(sequence, memory_order_relaxed);
+    atomic_store_explicit(sequence, value + 1, memory_order_relaxed); //< odd: write in progress
+    atomic_thread_fence(memory_order_release);
+}
+
+static void sdcr_routine_write_end(size_t index)
+{
+    atomic_uint *sequence = &gMemory.sequences[index];
+    const unsigned value = atomic_load_explicit(sequence, memory_order_relaxed);
+    atomic_store_explicit(sequence, value + 1, memory_order_release); //< even: state is stable
+    sdcr_schedule_update(index); //< every state change ends here
+}
+
+/* Seqlock writer side, for a routine the engine doesn't know: a new
+ * routine (stopped), or every routine at once (the engine is cleared).
+ */
+static void sdcr_routine_write_end_unscheduled(size_t index)
+{
+    atomic_uint *sequence = &gMemory.sequences[index];
+    const unsigned value = atomic_load_explicit(sequence, memory_order_relaxed);
+    atomic_store_explicit(sequence, value + 1, memory_order_release); //< even: state is stable
+}
+
+/* Will store a new routine, with its events at the end of the used events.
+ * param: index - where to write the routine index.
+ */
+static sdcr_status sdcr_routine_store(sdcr_routine_configuration config, uint16_t eventCount, size_t *index)
+{
+    for (size_t i = gMemory.freeHint;
+         i < ARRAY_LENGTH(gMemory.routineIDs);
+         i++)
+    {
+        const bool memoryIsFree = (gMemory.routineIDs[i] == 0);
+        if (memoryIsFree)
+        {
+            sdcr_routine_state_machine *routine = &gMemory.routines[i];
+            sdcr_routine_configuration_compiled *compiled = &gMemory.configs[i];
+            sdcr_routine_write_begin(i);
+            compiled->callbackFunction = config.callbackFunction; //< Stores routine's configuration
+            compiled->routineStepTimeMs = config.routineStepTimeMs;
+            atomic_store_explicit(&gMemory.routineIDs[i], config.id, memory_order_relaxed); //< Stores routine's id, only there
+            compiled->eventBegin = gMemory.eventsUsed;            //< Stores routine's compiled events
+            compiled->eventCount = eventCount;
+            gMemory.eventsUsed += eventCount;
+            routine->eventCursor = 0;                       //< Point routine cursor to the routine's start 
+            routine->runCursor = 0;
+            routine->holdMs = config.routineStepTimeMs;     //< First step happens after one step time.
+            routine->isUsed = true;
+            routine->isEnable = false;                      //< Routine is not enabled yet.
+            routine->hasOutput = false;
+            sdcr_routine_write_end_unscheduled(i);          //< Stopped: nothing to schedule yet.
+            sdcr_id_insert(i);
+            gMemory.freeHint = (uint16_t)(i + 1u);
+            *index = i;
+            return SDCR_SUCCESS; //< stored this configuration succesfully
+        }
+    }
+    return SDCR_ERROR_ROUTINE_MEMORY_IS_FULL;
+}
+
+static void sdcr_routine_reset(size_t index)
+{
+    sdcr_routine_state_machine *routine = &gMemory.routines[index];
+    sdcr_routine_configuration_compiled *config = &gMemory.configs[index];
+    sdcr_routine_cold_state *cold = &gMemory.coldStates[index];
+    if (gMemory.routineIDs[index] != NULL)
+    {
+        sdcr_group_split(index);
+        sdcr_schedule_cancel(index);
+        sdcr_events_free(index);
+        sdcr_id_remove(index);
+        if (config->stream != 0)
+            gMemory.streams[config->stream - 1u] = (sdcr_stream){0};
+        if (cold->completion != 0)
+            gMemory.completions[cold->completion - 1u] = (sdcr_completion){0};
+        if (index < gMemory.freeHint)
+            gMemory.freeHint = (uint16_t)index;
+    }
+
+    // unchain the routines starting this one
+    for (size_t i = 0; i < ARRAY_LENGTH(gMemory.completions); i++)
+    {
+        if (gMemory.completions[i].chainNext == index + 1u)
+        {
+            gMemory.completions[i].chainNext = 0;
+            sdcr_completion_release(gMemory.completions[i].routine - 1u);
+        }
+    }
+
+    sdcr_routine_write_begin(index);
+    atomic_store_explicit(&gMemory.routineIDs[index], NULL, memory_order_relaxed);
+    *config = (sdcr_routine_configuration_compiled){0};
+    *cold = (sdcr_routine_cold_state){0};
+    routine->isUsed = false;
+    routine->isEnable = false;
+    routine->isInfinite = false;
+    routine->hasOutput = false;
+    routine->isFollower = false;
+    routine->hasSlack = false;
+    routine->hasStartTime = false;
+    routine->cyclesLeft = 0;
+    routine->timestampLastAction = 0;
+    routine->holdMs = 0;
+    routine->eventCursor = 0;
+    routine->runCursor = 0;
+    sdcr_routine_write_end(index);
+}
+
+/* Seqlock reader side.
+ * Copy the state, then retry if a writer was active during the copy.
+ * return: false if there is no routine at this index.
+ */
+static bool sdcr_routine_read_state(size_t index, sdcr_routine_state *state)
+{
+    const sdcr_routine_state_machine *routine = &gMemory.routines[index];
+    atomic_uint *sequence = &gMemory.sequences[index];
+    unsigned sequenceBefore;
+    unsigned sequenceAfter;
+    do
+    {
+        sequenceBefore = atomic_load_explicit(sequence, memory_order_acquire);
+        if (sequenceBefore & 1u)
+        {
+            sequenceAfter = sequenceBefore + 1; //< write in progress, try again
+            continue;
+        }
+        // a follower's state is the timeline of its leader, on the leader's events
+        sdcr_routine_state_machine timeline = *routine;
+        uint32_t cursorPosition = sdcr_routine_cursor_position(index, &timeline);
+        const size_t groupLeader = gMemory.coldStates[index].groupLeader;
+        if (timeline.isFollower && groupLeader != 0)
+            sdcr_routine_read_timeline(groupLeader - 1u, &timeline, &cursorPosition);
+
+        state->id = atomic_load_explicit(&gMemory.routineIDs[index], memory_order_relaxed);
+        state->isEnable = timeline.isEnable;
+        state->isInfinite = timeline.isInfinite;
+        state->cyclesLeft = timeline.cyclesLeft;
+        state->timestampLastAction = timeline.timestampLastAction;
+        state->cursorPosition = cursorPosition;
+        atomic_thread_fence(memory_order_acquire);
+        sequenceAfter = atomic_load_explicit(sequence, memory_order_relaxed);
+    } while (sequenceBefore != sequenceAfter);
+
+    return (state->id != NULL);
+}
+
+/* Seqlock reader side, for the hot state and its cursor position only. */
+static void sdcr_routine_read_timeline(size_t index, sdcr_routine_state_machine *timeline, uint32_t *cursorPosition)
+{
+    atomic_uint *sequence = &gMemory.sequences[index];
+    unsigned sequenceBefore;
+    unsigned sequenceAfter;
+    do
+    {
+        sequenceBefore = atomic_load_explicit(sequence, memory_order_acquire);
+        if (sequenceBefore & 1u)
+        {
+            sequenceAfter = sequenceBefore + 1; //< write in progress, try again
+            continue;
+        }
+        *timeline = gMemory.routines[index];
+        *cursorPosition = sdcr_routine_cursor_position(index, timeline);
+        atomic_thread_fence(memory_order_acquire);
+        sequenceAfter = atomic_load_explicit(sequence, memory_order_relaxed);
+    } while (sequenceBefore != sequenceAfter);
+}
+
+/* return: The cursor of a routine on its timeline, in steps from the start of the cycle.
+ * note: It reads the copy counters of the events: call it under the routine seqlock.
+ */
+static uint32_t sdcr_routine_cursor_position(size_t index, const sdcr_routine_state_machine *timeline)
+{
+    const sdcr_routine_configuration_compiled *config = &gMemory.configs[index];
+    if (config->isText)
+        return timeline->textCursor; //< a char is a step
+    const size_t eventBegin = config->eventBegin;
+    const size_t eventCount = config->eventCount;
+    if (eventBegin + eventCount > ARRAY_LENGTH(gMemory.events))
+        return 0; //< read while written: tried again
+    const size_t eventCursor = (timeline->eventCursor < eventCount) ? timeline->eventCursor : eventCount;
+    uint64_t position = timeline->runCursor + sdcr_events_measure(config, 0, eventCursor, 0).steps;
+
+    // the copies already played of the groups the cursor is in
+    for (size_t i = eventCursor; i < eventCount; i++)
+    {
+        const sdcr_event *repeat = &gMemory.events[eventBegin + i];
+        if (repeat->isRepeat && repeat->body <= i && i - repeat->body <= eventCursor)
+            position += repeat->played * sdcr_events_measure(config, i - repeat->body, i, 0).steps;
+    }
+    return (position > UINT32_MAX) ? UINT32_MAX : (uint32_t)position;
+}
+
+/* Seqlock reader side, for `sdcr_routine_query`.
+ * param: status - where to write the query status.
+ * return: false if the routine at this index is not `id` anymore.
+ */
+static bool sdcr_routine_read_query(size_t index, const char *id, uint32_t atMs,
+                                    sdcr_routine_query_result *result, sdcr_status *status)
+{
+    const sdcr_routine_configuration_compiled *config = &gMemory.configs[index];
+    const sdcr_routine_cold_state *cold = &gMemory.coldStates[index];
+    atomic_uint *sequence = &gMemory.sequences[index];
+    bool isSameRoutine;
+    unsigned sequenceBefore;
+    unsigned sequenceAfter;
+    do
+    {
+        sequenceBefore = atomic_load_explicit(sequence, memory_order_acquire);
+        if (sequenceBefore & 1u)
+        {
+            sequenceAfter = sequenceBefore + 1; //< write in progress, try again
+            continue;
+        }
+        isSameRoutine = (atomic_load_explicit(&gMemory.routineIDs[index], memory_order_relaxed) == id);
+        const sdcr_routine_configuration_compiled copy = *config;
+        const size_t eventCount = copy.isText ? strlen(copy.text) : copy.eventCount;
+        *status = SDCR_ERROR_INVALID_API_USAGE; //< not started at a known time
+        if (isSameRoutine && gMemory.routines[index].hasStartTime &&
+            (copy.isText || copy.eventBegin + eventCount <= ARRAY_LENGTH(gMemory.events)))
+        {
+            *status = sdcr_query_timeline(&copy, eventCount, cold->firstStepMs, cold->startCycles, atMs, result);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        sequenceAfter = atomic_load_explicit(sequence, memory_order_relaxed);
+    } while (sequenceBefore != sequenceAfter);
+
+    return isSameRoutine;
+}
+
+/* Will compute the state of a routine at a given time, from its first step time.
+ * The routine is assumed to be performed on time: the cost depends on the
+ * number of events, not on the elapsed time.
+ * Like `sdcr_get_action`, a routine started for n cycles stops on the first
+ * step of its n-th cycle (of its second cycle if n is 1).
+ */
+static sdcr_status sdcr_query_timeline(const sdcr_routine_configuration_compiled *config, size_t eventCount, uint32_t firstStepMs,
+                                       uint16_t cycles, uint32_t atMs, sdcr_routine_query_result *result)
+{
+    const sdcr_span cycleSpan = sdcr_events_measure(config, 0, eventCount, 0);
+    const uint64_t cycleMs = cycleSpan.ms;
+    const uint64_t cycleCalls = cycleSpan.calls;
+    if (eventCount == 0 || cycleMs == 0)
+        return SDCR_ERROR_INVALID_API_USAGE; //< the routine has no duration
+
+    *result = (sdcr_routine_query_result){
+        .isEnable = true,
+        .nextTransitionMs = firstStepMs,
+    };
+    const int32_t sinceFirstStep = (int32_t)(atMs - firstStepMs);
+    if (sinceFirstStep < 0)
+        return SDCR_SUCCESS; //< the first step is not performed yet
+
+    uint64_t cycle = (uint32_t)sinceFirstStep / cycleMs;
+    uint64_t offset = (uint32_t)sinceFirstStep % cycleMs; //< in the cycle
+    const uint64_t lastCycle = (cycles < 3) ? 1u : cycles - 1u;
+    const bool isStopped = (cycles != 0 && cycle >= lastCycle);
+    if (isStopped)
+    {
+        cycle = lastCycle;
+        offset = 0;
+    }
+
+    // find the last performed step of the cycle
+    uint64_t eventOffset = 0;
+    uint64_t nextOffset = 0;
+    bool isInEvent = false;
+    uint64_t steps = 0;
+    uint64_t calls = 0;
+    size_t replays = 0;
+    for (size_t i = 0; i < eventCount && eventOffset <= offset; i++)
+    {
+        const sdcr_event copy = sdcr_routine_event(config, i);
+        const sdcr_event *event = &copy;
+        if (event->isRepeat)
+        {
+            // the group was played once: skip the copies played in full, then replay the next one
+            // (each group is replayed once at most: a walk read while written stops)
+            if (event->body > i || event->steps == 0)
+                break;
+            const sdcr_span group = sdcr_events_measure(config, i - event->body, i, 0);
+            const uint64_t copies = event->steps - 1u;
+            const uint64_t passed = (group.ms == 0) ? copies : (offset - eventOffset) / group.ms;
+            const uint64_t skipped = (passed < copies) ? passed : copies;
+            eventOffset += skipped * group.ms;
+            steps += skipped * group.steps;
+            calls += skipped * group.calls;
+            if (skipped < copies)
+            {
+                if (replays++ >= eventCount)
+                    break;
+                i -= event->body + 1u; //< the offset is in this copy
+            }
+            continue;
+        }
+        uint64_t performed = event->steps;
+        if (event->holdMs != 0)
+        {
+            const uint64_t reached = (offset - eventOffset) / event->holdMs + 1u;
+            performed = (reached < performed) ? reached : performed;
+        }
+        if (isStopped)
+            performed = 1; //< only the first step of the last cycle
+
+        steps += performed;
+        calls += event->isCall ? performed : 0u;
+        result->isCall = event->isCall;
+        if (isStopped || performed < event->steps)
+        {
+            nextOffset = eventOffset + performed * event->holdMs;
+            isInEvent = true;
+            break;
+        }
+        eventOffset += (uint64_t)event->holdMs * event->steps;
+    }
+    if (!isInEvent)
+        nextOffset = eventOffset; //< the next event, or the next cycle
+
+    const uint64_t totalCalls = cycle * cycleCalls + calls;
+    result->isEnable = !isStopped;
+    result->isOutputOn = (totalCalls & 1u);
+    result->cursorPosition = (steps > UINT32_MAX) ? UINT32_MAX : (uint32_t)steps;
+    result->cyclesCompleted = (uint32_t)cycle;
+    result->nextTransitionMs = isStopped ? 0 : (uint32_t)(firstStepMs + cycle * cycleMs + nextOffset);
+    return SDCR_SUCCESS;
+}
+
+/* Will compile a routine string in events.
+ * The events are written after the used events, but not reserved.
+ * grammar:
+ *      routine := item*
+ *      item    := ('C' | 'c' | '.' | '(' routine ')') suffix*
+ *      suffix  := '{' n '}' | '*' n | '@' ms
+ * return: A sdcr status. 0 is success.
+ */
+static sdcr_status sdcr_compile(const char *routine, uint32_t stepTimeMs, uint16_t *eventCount)
+{
+    sdcr_compiler compiler = {
+        .input = routine,
+        .stepTimeMs = stepTimeMs,
+        .begin = gMemory.eventsUsed,
+        .end = gMemory.eventsUsed,
+        .canMerge = false,
+        .status = SDCR_SUCCESS,
+    };
+    const bool isCompiled = sdcr_compile_sequence(&compiler, 0);
+    if (!isCompiled)
+        return compiler.status;
+    if (*compiler.input != '\0') //< unbalanced ')'
+        return SDCR_ERROR_INVALID_ROUTINE_CONFIG;
+    if (compiler.end == compiler.begin) //< empty routine
+        return SDCR_ERROR_INVALID_ROUTINE_CONFIG;
+
+    *eventCount = (uint16_t)(compiler.end - compiler.begin);
+    return SDCR_SUCCESS;
+}
+
+/* return: true if the routine only has 'C', 'c' and '.' chars, so it can be played from the string. */
+static bool sdcr_compile_is_plain(const char *routine)
+{
+    for (const char *unit = routine; *unit != '\0'; unit++)
+    {
+        if (*unit != '.' && *unit != 'C' && *unit != 'c')
+            return false;
+    }
+    return true;
+}
+
+static bool sdcr_compile_sequence(sdcr_compiler *compiler, unsigned depth)
+{
+    if (depth > SDCR_MAX_ROUTINE_NESTING)
+    {
+        compiler->status = SDCR_ERROR_INVALID_ROUTINE_CONFIG;
+        return false;
+    }
+    sdcr_compile_skip_spaces(compiler);
+    while (*compiler->input != '\0' && *compiler->input != ')')
+    {
+        if (!sdcr_compile_item(compiler, depth))
+            return false;
+        sdcr_compile_skip_spaces(compiler);
+    }
+    return true;
+}
+
+static bool sdcr_compile_item(sdcr_compiler *compiler, unsigned depth)
+{
+    const char unit = *compiler->input++;
+    const bool isGroup = (unit == '(');
+    const size_t groupBegin = compiler->end;
+    const bool couldMerge = compiler->canMerge;
+    if (isGroup)
+    {
+        // the copies of a repeated group start on their own event
+        if (sdcr_compile_is_repeated(compiler))
+            compiler->canMerge = false;
+        if (!sdcr_compile_sequence(compiler, depth + 1))
+            return false;
+        if (*compiler->input++ != ')')
+        {
+            compiler->status = SDCR_ERROR_INVALID_ROUTINE_CONFIG;
+            return false;
+        }
+    }
+    else if (unit != '.' && unit != 'C' && unit != 'c') //< config contains invalid char.
+    {
+        compiler->status = SDCR_ERROR_INVALID_ROUTINE_CONFIG;
+        return false;
+    }
+
+    // suffixes
+    uint32_t repeat = 1;
+    uint32_t holdMs = compiler->stepTimeMs;
+    bool hasRepeat = false;
+    bool hasHold = false;
+    for (;;)
+    {
+        sdcr_compile_skip_spaces(compiler);
+        const char suffix = *compiler->input;
+        if ((suffix == '{' || suffix == '*') && !hasRepeat)
+        {
+            compiler->input++;
+            hasRepeat = true;
+            if (!sdcr_compile_number(compiler, &repeat))
+                return false;
+            if (suffix == '{' && *compiler->input++ != '}')
+            {
+                compiler->status = SDCR_ERROR_INVALID_ROUTINE_CONFIG;
+                return false;
+            }
+        }
+        else if (suffix == '@' && !hasHold && !isGroup)
+        {
+            compiler->input++;
+            hasHold = true;
+            if (!sdcr_compile_number(compiler, &holdMs))
+                return false;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (isGroup)
+    {
+        const size_t groupEnd = compiler->end;
+        if (groupEnd == groupBegin || repeat == 1)
+            return true;
+        if (groupEnd - groupBegin == 1)
+        {
+            // a single run: every copy is merged in it, and it in the previous run when it can
+            const sdcr_event run = gMemory.events[groupBegin];
+            if (run.steps > UINT32_MAX / repeat)
+            {
+                compiler->status = SDCR_ERROR_EVENT_MEMORY_IS_FULL;
+                return false;
+            }
+            compiler->end = groupBegin;
+            compiler->canMerge = couldMerge;
+            return sdcr_compile_append(compiler, run.isCall, run.holdMs, (uint32_t)run.steps * repeat);
+        }
+        return sdcr_compile_repeat(compiler, groupBegin, repeat);
+    }
+    if (unit == '.')
+    {
+        // No action: a counted wait is folded in a single step
+        if (holdMs > UINT32_MAX / repeat)
+        {
+            compiler->status = SDCR_ERROR_INVALID_ROUTINE_CONFIG;
+            return false;
+        }
+        return sdcr_compile_append(compiler, false, holdMs * repeat, 1);
+    }
+    return sdcr_compile_append(compiler, true, holdMs, repeat);
+}
+
+/* return: true if the group at the input, after its '(', has a repeat suffix above 1. */
+static bool sdcr_compile_is_repeated(const sdcr_compiler *compiler)
+{
+    sdcr_compiler peek = *compiler;
+    for (unsigned depth = 1; depth > 0 && *peek.input != '\0'; peek.input++)
+    {
+        if (*peek.input == '(')
+            depth++;
+        else if (*peek.input == ')')
+            depth--;
+    }
+    sdcr_compile_skip_spaces(&peek);
+    if (*peek.input != '{' && *peek.input != '*')
+        return false;
+    peek.input++;
+    uint32_t repeat = 1;
+    return sdcr_compile_number(&peek, &repeat) && repeat > 1;
+}
+
+/* Will end a repeated group with a repeat event: the group is compiled once,
+ * the interpreter plays its copies.
+ */
+static bool sdcr_compile_repeat(sdcr_compiler *compiler, size_t groupBegin, uint32_t repeat)
+{
+    const size_t body = compiler->end - groupBegin;
+    const sdcr_routine_configuration_compiled group = {
+        .eventBegin = (uint16_t)groupBegin,
+        .eventCount = (uint16_t)body,
+    };
+    const sdcr_span span = sdcr_events_measure(&group, 0, body, 0);
+    // a cycle must fit the 64 bits timeline: a repeated group lasts up to UINT32_MAX steps and ms
+    if (repeat > UINT16_MAX || span.steps > UINT32_MAX / repeat || span.ms > UINT32_MAX / repeat)
+    {
+        compiler->status = SDCR_ERROR_INVALID_ROUTINE_CONFIG;
+        return false;
+    }
+    if (compiler->end >= ARRAY_LENGTH(gMemory.events))
+    {
+        compiler->status = SDCR_ERROR_EVENT_MEMORY_IS_FULL;
+        return false;
+    }
+    gMemory.events[compiler->end++] = (sdcr_event){
+        .body = (uint16_t)body,
+        .played = 0,
+        .steps = (uint16_t)repeat,
+        .isRepeat = true,
+    };
+    compiler->canMerge = false;
+    return true;
+}
+
+static bool sdcr_compile_number(sdcr_compiler *compiler, uint32_t *number)
+{
+    sdcr_compile_skip_spaces(compiler);
+    uint32_t value = 0;
+    const char *digits = compiler->input;
+    while (*compiler->input >= '0' && *compiler->input <= '9')
+    {
+        const uint32_t digit = (uint32_t)(*compiler->input++ - '0');
+        if (value > (UINT32_MAX - digit) / 10)
+        {
+            compiler->status = SDCR_ERROR_INVALID_ROUTINE_CONFIG;
+            return false;
+        }
+        value = value * 10 + digit;
+    }
+    sdcr_compile_skip_spaces(compiler);
+    if (compiler->input == digits || value == 0)
+    {
+        compiler->status = SDCR_ERROR_INVALID_ROUTINE_CONFIG;
+        return false;
+    }
+    *number = value;
+    return true;
+}
+
+static bool sdcr_compile_append(sdcr_compiler *compiler, bool isCall, uint32_t holdMs, uint32_t steps)
+{
+    while (steps > 0)
+    {
+        sdcr_event *last = &gMemory.events[(compiler->end > 0) ? compiler->end - 1 : 0];
+        const bool canMerge = (compiler->canMerge &&
+                               compiler->end > compiler->begin &&
+                               !last->isRepeat &&
+                               last->isCall == isCall &&
+                               last->holdMs == holdMs &&
+                               last->steps < UINT16_MAX);
+        if (canMerge)
+        {
+            const uint32_t room = UINT16_MAX - last->steps;
+            const uint32_t merged = (steps < room) ? steps : room;
+            last->steps += (uint16_t)merged;
+            steps -= merged;
+            continue;
+        }
+        if (compiler->end >= ARRAY_LENGTH(gMemory.events))
+        {
+            compiler->status = SDCR_ERROR_EVENT_MEMORY_IS_FULL;
+            return false;
+        }
+        gMemory.events[compiler->end++] = (sdcr_event){
+            .holdMs = holdMs,
+            .steps = 0,
+            .isCall = isCall,
+        };
+        compiler->canMerge = true;
+    }
+    return true;
+}
+
+static void sdcr_compile_skip_spaces(sdcr_compiler *compiler)
+{
+    while (*compiler->input == ' ' || *compiler->input == '\t' || *compiler->input == '\n')
+    {
+        compiler->input++;
+    }
+}
+
+/* Will give back the events of a routine.
+ * The following events are moved down. Their routines are rewritten
+ * under their seqlock: a reader never sees a half moved routine.
+ */
+static void sdcr_events_free(size_t index)
+{
+    const sdcr_routine_configuration_compiled *freed = &gMemory.configs[index];
+    if (freed->isText)
+        return;
+    const size_t begin = freed->eventBegin;
+    const size_t count = freed->eventCount;
+    if (count == 0)
+        return;
+
+    for (size_t i = 0; i < ARRAY_LENGTH(gMemory.configs); i++)
+    {
+        if (gMemory.routineIDs[i] != NULL && !gMemory.configs[i].isText && gMemory.configs[i].eventBegin > begin)
+            sdcr_routine_write_begin(i);
+    }
+    memmove(&gMemory.events[begin],
+            &gMemory.events[begin + count],
+            (gMemory.eventsUsed - begin - count) * sizeof(gMemory.events[0]));
+    gMemory.eventsUsed -= (uint16_t)count;
+    for (size_t i = 0; i < ARRAY_LENGTH(gMemory.configs); i++)
+    {
+        if (gMemory.routineIDs[i] != NULL && !gMemory.configs[i].isText && gMemory.configs[i].eventBegin > begin)
+        {
+            gMemory.configs[i].eventBegin -= (uint16_t)count;
+            sdcr_routine_write_end(i);
+        }
+    }
+}
+/* return: The event `i` of a routine. Each char of a text routine is a single step event. */
+static sdcr_event sdcr_routine_event(const sdcr_routine_configuration_compiled *config, size_t i)
+{
+    if (config->isText)
+    {
+        return (sdcr_event){
+            .holdMs = config->routineStepTimeMs,
+            .steps = 1,
+            .isCall = (config->text[i] != '.'),
+        };
+    }
+    return gMemory.events[config->eventBegin + i];
+}
+
+/* Will hash compiled events (FNV-1a). */
+static uint32_t sdcr_events_hash(size_t begin, size_t count)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = begin; i < begin + count; i++)
+    {
+        const sdcr_event *event = &gMemory.events[i];
+        const uint32_t fields[] = {event->holdMs, event->steps, event->isCall, event->isRepeat}; //< with the copy counters
+        for (size_t j = 0; j < ARRAY_LENGTH(fields); j++)
+        {
+            hash ^= fields[j];
+            hash *= 16777619u;
+        }
+    }
+    return hash;
+}
+
+/* Will measure the events [begin, end) of a routine, with the copies of their repeated groups.
+ * A group is measured once, then multiplied: the cost is its number of events.
+ * The events may be read while written (see `sdcr_routine_read_query`): a bad group stops the measure.
+ */
+static sdcr_span sdcr_events_measure(const sdcr_routine_configuration_compiled *config, size_t begin, size_t end, unsigned depth)
+{
+    sdcr_span span = {0};
+    size_t i = end;
+    while (i > begin)
+    {
+        const sdcr_event event = sdcr_routine_event(config, --i);
+        if (!event.isRepeat)
+        {
+            span.ms += (uint64_t)event.holdMs * event.steps;
+            span.steps += event.steps;
+            span.calls += event.isCall ? event.steps : 0u;
+            continue;
+        }
+        if (event.body > i - begin || depth >= SDCR_MAX_ROUTINE_NESTING)
+            break;
+        const sdcr_span group = sdcr_events_measure(config, i - event.body, i, depth + 1u);
+        span.ms += group.ms * event.steps;
+        span.steps += group.steps * event.steps;
+        span.calls += group.calls * event.steps;
+        i -= event.body;
+    }
+    return span;
+}
+
+/* Will hash a snapshot blob (FNV-1a), with its checksum field at 0. */
+static uint32_t sdcr_snapshot_hash(const uint8_t *buffer, size_t size)
+{
+    const size_t checksumBegin = offsetof(sdcr_snapshot_header, checksum);
+    const size_t checksumEnd = checksumBegin + sizeof(uint32_t);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++)
+    {
+        const bool isChecksum = (i >= checksumBegin && i < checksumEnd);
+        hash ^= isChecksum ? 0u : buffer[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Will check a snapshot blob before anything is restored.
+ * A blob from another build, or damaged in retained memory, is rejected.
+ */
+static bool sdcr_snapshot_is_valid(const uint8_t *buffer, size_t size)
+{
+    sdcr_snapshot_header header;
+    if (size < sizeof(header))
+        return false;
+    memcpy(&header, buffer, sizeof(header));
+
+    const bool isSameBuild = (header.magic == SDCR_SNAPSHOT_MAGIC &&
+                              header.version == SDCR_SNAPSHOT_VERSION &&
+                              header.maxRoutines == SDCR_MAX_NUMBER_OF_ROUTINE &&
+                              header.recordSize == sizeof(sdcr_snapshot_record) &&
+                              header.eventSize == sizeof(sdcr_event));
+    const size_t expectedSize = sizeof(header) +
+                                header.routineCount * sizeof(sdcr_snapshot_record) +
+                                header.eventsUsed * sizeof(sdcr_event);
+    if (!isSameBuild ||
+        header.routineCount > SDCR_MAX_NUMBER_OF_ROUTINE ||
+        header.eventsUsed > SDCR_MAX_NUMBER_OF_EVENT ||
+        header.size != size || expectedSize != size ||
+        header.checksum != sdcr_snapshot_hash(buffer, size))
+        return false;
+
+    // every record is a distinct routine, with its events and its own completion
+    bool isUsed[SDCR_MAX_NUMBER_OF_ROUTINE] = {0};
+    bool isCompletionUsed[SDCR_MAX_NUMBER_OF_COMPLETION + 1] = {0};
+    sdcr_snapshot_record record;
+    for (size_t i = 0; i < header.routineCount; i++)
+    {
+        memcpy(&record, &buffer[sizeof(header) + i * sizeof(record)], sizeof(record));
+        const bool isRecordValid = (record.index < SDCR_MAX_NUMBER_OF_ROUTINE &&
+                                    !isUsed[record.index] &&
+                                    record.hot.isUsed &&
+                                    record.id != NULL &&
+                                    record.config.callbackFunction != NULL &&
+                                    record.config.stream == 0 &&
+                                    !record.config.isText &&
+                                    record.config.eventBegin + record.config.eventCount <= header.eventsUsed &&
+                                    record.cold.completion <= SDCR_MAX_NUMBER_OF_COMPLETION &&
+                                    (record.cold.completion == 0 || !isCompletionUsed[record.cold.completion]) &&
+                                    record.completion.routine == ((record.cold.completion != 0) ? record.index + 1u : 0u));
+        if (!isRecordValid)
+            return false;
+        // a repeat only plays again the events of its routine
+        const size_t eventsOffset = sizeof(header) + header.routineCount * sizeof(record);
+        for (size_t j = 0; j < record.config.eventCount; j++)
+        {
+            sdcr_event event;
+            memcpy(&event, &buffer[eventsOffset + (record.config.eventBegin + j) * sizeof(event)], sizeof(event));
+            if (event.isRepeat && (event.body == 0 || event.body > j || event.played >= event.steps))
+                return false;
+        }
+        isUsed[record.index] = true;
+        isCompletionUsed[record.cold.completion] = (record.cold.completion != 0);
+    }
+
+    // links only point to restored routines
+    for (size_t i = 0; i < header.routineCount; i++)
+    {
+        memcpy(&record, &buffer[sizeof(header) + i * sizeof(record)], sizeof(record));
+        const uint16_t links[] = {record.completion.chainNext, record.cold.groupLeader, record.cold.groupNext};
+        for (size_t j = 0; j < ARRAY_LENGTH(links); j++)
+        {
+            if (links[j] != 0 && (links[j] > SDCR_MAX_NUMBER_OF_ROUTINE || !isUsed[links[j] - 1u]))
+                return false;
+        }
+        if (record.hot.isFollower && record.cold.groupLeader == 0)
+            return false;
+    }
+    return true;
+}
+
+/* Will move an address from the `from` anchor to the `to` anchor. NULL stays NULL. */
+static uintptr_t sdcr_snapshot_relocate(uintptr_t address, uintptr_t from, uintptr_t to)
+{
+    if (address == 0)
+        return 0;
+    return address - from + to;
+}
+
+#ifdef SDCR_ENABLE_TRACE
+/* Will write one event in the trace ring buffer.
+ * Lock-free: a slot is claimed with an atomic increment, then
+ * published with its sequence number.
+ */
+static void sdcr_trace_record(sdcr_trace_type type, size_t index, uint32_t arg)
+{
+    const sdcr_get_tick_function clock = gTrace.clock;
+    if (clock == NULL)
+        return;
+
+    const unsigned number = atomic_fetch_add_explicit(&gTrace.head, 1, memory_order_relaxed);
+    sdcr_trace_slot *slot = &gTrace.slots[number & (SDCR_TRACE_BUFFER_SIZE - 1)];
+    atomic_store_explicit(&slot->sequence, number, memory_order_relaxed); //< write in progress
+    atomic_thread_fence(memory_order_release);
+    slot->event = (sdcr_trace_event){
+        .id = gMemory.routineIDs[index],
+        .timestamp = clock(),
+        .type = (uint16_t)type,
+        .arg = (arg > UINT16_MAX) ? UINT16_MAX : (uint16_t)arg,
+    };
+    atomic_store_explicit(&slot->sequence, number + 1, memory_order_release);
+}
+
+static void sdcr_trace_step(size_t index, uint32_t lateness, uint32_t holdMs)
+{
+    sdcr_trace_record(SDCR_TRACE_STEP, index, lateness);
+    if (lateness >= holdMs)
+        sdcr_trace_record(SDCR_TRACE_DEADLINE_MISSED, index, lateness);
+}
+#endif // SDCR_ENABLE_TRACE
@@ -55,6 +55,8 @@
 //-----------------------------------------------
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 //-----------------------------------------------
 // USER CONFIG
@@ -68,6 +70,48 @@
 #define SDCR_MAX_NUMBER_OF_ROUTINE 10
 #endif
 
+/* This library compiled routine memory size definition.
+ * Routines are compiled into events, shared by all routines.
+ * An event is a run of identical steps: ".CC..." is 3 events.
+ * A repeated group is its events and one more: "(C.)*30" is 3 events.
+ * Each event use 8 bytes.
+ * A plain routine (only 'C', 'c' and '.') that doesn't fit is played from
+ * its string instead: only the compact syntax can run out of events.
+ */
+#ifndef SDCR_MAX_NUMBER_OF_EVENT
+#define SDCR_MAX_NUMBER_OF_EVENT (SDCR_MAX_NUMBER_OF_ROUTINE * 4)
+#endif
+
+/* This library stream routine memory size definition.
+ * A stream routine pulls its events from a user function, a chunk at a time.
+ * Each stream use `2 * SDCR_STREAM_CHUNK_SIZE` events, whatever its length.
+ */
+#ifndef SDCR_MAX_NUMBER_OF_STREAM
+#define SDCR_MAX_NUMBER_OF_STREAM 4
+#endif
+
+#ifndef SDCR_STREAM_CHUNK_SIZE
+#define SDCR_STREAM_CHUNK_SIZE 8
+#endif
+
+/* This library completion memory size definition.
+ * A routine with a completion function or a chained routine uses one
+ * completion (24 bytes on 64-bit CPUs) until it has neither.
+ */
+#ifndef SDCR_MAX_NUMBER_OF_COMPLETION
+#define SDCR_MAX_NUMBER_OF_COMPLETION (SDCR_MAX_NUMBER_OF_ROUTINE / 4 + 1)
+#endif
+
+/* Event tracing.
+ * Define `SDCR_ENABLE_TRACE` (for the library and the user code) to record
+ * what `sdcr_task` does in a ring buffer. See `sdcr_trace_enable`.
+ * When it is not defined, tracing is compiled out and costs nothing.
+ * The ring buffer size must be a power of 2.
+ */
+#ifndef SDCR_TRACE_BUFFER_SIZE
+#define SDCR_TRACE_BUFFER_SIZE 256
+#endif
+
 //-----------------------------------------------
 // DEFINITIONS
 //-----------------------------------------------
@@ -87,6 +131,12 @@ typedef void (*sdcr_callback_function)(void);
  */
 typedef uint32_t (*sdcr_get_tick_function)(void);
 
+/* User defined callback function called when a routine
+ * started for n cycles is complete.
+ * param: id - the completed routine ID.
+ */
+typedef void (*sdcr_complete_function)(const char *id);
+
 /* Enumarates all possible sdcr return messages.
  * !0 value are errors.
  */
@@ -102,10 +152,32 @@ typedef enum
     /* ERROR - Using routine */
     SDCR_ERROR_ID_DOESNT_EXIST,          //< Error: User tried to use a non-created routine. Check `id` for typos.
     SDCR_ERROR_INVALID_API_USAGE,        //< Error: User tried to use the API with invalid parameter.
+    /* ERROR - Building new routine */
+    SDCR_ERROR_EVENT_MEMORY_IS_FULL,     //< Error: User routines need more than `SDCR_MAX_NUMBER_OF_EVENT` events (compact syntax only).
+    /* ERROR - Shared memory control plane */
+    SDCR_ERROR_SHARED_MEMORY,            //< Error: The shared memory segment can't be created, or opened. Check its name.
+    SDCR_ERROR_COMMAND_QUEUE_IS_FULL,    //< Error: User sent more than `SDCR_SHM_COMMAND_QUEUE_SIZE` commands between updates.
+    /* ERROR - Snapshot */
+    SDCR_ERROR_INVALID_SNAPSHOT,         //< Error: The snapshot is damaged, or was made by another build of the program.
+    /* ERROR - Real-time thread */
+    SDCR_ERROR_REAL_TIME,                //< Error: The real-time thread can't be set up. Check the process privileges.
 } sdcr_status;
 
 /* routine configurations
  * User will use this structure to configure the routine behavior.
+ *
+ * The routine string is a list of steps:
+ *      'C' or 'c'  - Call the callback, then wait one step time.
+ *      '.'         - Wait one step time.
+ * Long routines can be written with a compact syntax:
+ *      ".{999}"    - A count. Wait 999 step times, in a single step.
+ *      "C{3}"      - A count. Same as "CCC".
+ *      "(C.)*3"    - A repeated group. Same as "C.C.C.", up to 65535 copies.
+ *      "C@50"      - An explicit step time in ms. Call, then wait 50 ms.
+ *      ".@2000"    - Wait 2000 ms.
+ * Spaces are ignored, groups can be nested and suffixes combined (ex: ".@10{5}").
+ * The routine is compiled when created. A plain routine is played from the
+ * string when the events are full: the string must outlive the routine.
  */
 typedef struct
 {
@@ -117,6 +189,107 @@ typedef struct
                                              //  defined as an function ptr.
 } sdcr_routine_configuration;
 
+/* stream event
+ * A run of identical steps, like a char of a routine string and its count:
+ * "C@50{3}" is {.holdMs = 50, .steps = 3, .isCall = true}.
+ */
+typedef struct
+{
+    uint32_t holdMs; //< The time for each step. 0 for the stream `routineStepTimeMs`.
+    uint16_t steps;  //< The number of steps. 0 counts as 1.
+    bool isCall;     //< The steps call the callback.
+} sdcr_stream_event;
+
+/* User defined function that generates the events of a stream routine.
+ * It is called by `sdcr_task`, at the end of the pass (after every step of
+ * the pass), a chunk ahead of the played events.
+ * param: context - the stream `context`.
+ * param: events - where to write the next events.
+ * param: capacity - the number of element in `events`.
+ * return: The number of written events. 0 ends the stream.
+ */
+typedef size_t (*sdcr_stream_function)(void *context, sdcr_stream_event *events, size_t capacity);
+
+/* stream routine configurations
+ * Like `sdcr_routine_configuration`, with a function instead of a string:
+ * long or generated routines use the memory of a chunk, not of the routine.
+ */
+typedef struct
+{
+    const char *id;                          //< The routine ID, defined as an inline string.
+    sdcr_stream_function source;             //< The function generating the routine events.
+    void *context;                           //< Given to `source`. Can be NULL.
+    uint32_t routineStepTimeMs;              //< The time before the first step, and the default
+                                             //  time for each step, in millisecond (ms).
+    sdcr_callback_function callbackFunction; //< The callback function that the routine will call.
+} sdcr_stream_configuration;
+
+/* routine state snapshot
+ * A consistent copy of a routine state, as seen by `sdcr_task`.
+ * See `sdcr_routine_get_state`.
+ */
+typedef struct
+{
+    const char *id;               //< The routine ID.
+    bool isEnable;                //< The routine is running.
+    bool isInfinite;              //< The routine will cycle infinitely.
+    int32_t cyclesLeft;           //< The number of cycles left. Only meaningful if `isInfinite` is false.
+    uint32_t timestampLastAction; //< The tick (ms) of the last performed step.
+    uint32_t cursorPosition;      //< The index of the next step. Same as the index in the routine string
+                                  //  when the compact syntax is not used.
+} sdcr_routine_state;
+
+/* routine state at a given time
+ * See `sdcr_routine_query`.
+ */
+typedef struct
+{
+    const char *id;            //< The routine ID.
+    bool isEnable;             //< The routine is running.
+    bool isCall;               //< The last performed step called the callback.
+    bool isOutputOn;           //< The callback was called an odd number of times: a `sdcr_render` bit is set.
+    uint32_t cursorPosition;   //< The index of the next step in the cycle. 0 before the first step.
+    uint32_t cyclesCompleted;  //< The number of cycles before the current one.
+    uint32_t nextTransitionMs; //< The time of the next step. Only meaningful if `isEnable` is true.
+} sdcr_routine_query_result;
+
+/* scheduler statistics
+ * See `sdcr_get_stats`.
+ */
+typedef struct
+{
+    uint32_t wakeups;        //< The `sdcr_task` calls which performed at least one step.
+    uint32_t steps;          //< The performed steps. Routines sharing a timeline count once.
+    uint32_t coalescedSteps; //< The steps performed early, within their slack, to share a wakeup.
+    uint32_t savedWakeups;   //< The wakeups avoided by the slack: steps of routines with slack
+                             //  performed with a step due at another time.
+} sdcr_stats;
+
+/* Enumarates all trace event types.
+ * The meaning of `sdcr_trace_event.arg` is given for each type.
+ */
+typedef enum
+{
+    SDCR_TRACE_STEP,            //< A step was performed.       arg: lateness, in ticks.
+    SDCR_TRACE_CALLBACK_BEGIN,  //< The callback is called.     arg: 0.
+    SDCR_TRACE_CALLBACK_END,    //< The callback returned.      arg: 0.
+    SDCR_TRACE_START,           //< The routine was started.    arg: number of cycles, 0 if infinite.
+    SDCR_TRACE_STOP,            //< The routine was stopped.    arg: 0.
+    SDCR_TRACE_CYCLE_WRAP,      //< The routine restarted.      arg: cycles left, 0 if infinite.
+    SDCR_TRACE_DEADLINE_MISSED, //< A whole step time was lost. arg: lateness, in ticks.
+} sdcr_trace_type;
+
+/* trace event
+ * A fixed size record of the trace ring buffer.
+ */
+typedef struct
+{
+    const char *id;     //< The routine ID.
+    uint32_t timestamp; //< The trace clock tick. See `sdcr_trace_enable`.
+    uint16_t type;      //< A `sdcr_trace_type`.
+    uint16_t arg;       //< Type dependent argument. Saturates at UINT16_MAX.
+} sdcr_trace_event;
+
 //-----------------------------------------------
 // API
 //-----------------------------------------------
@@ -131,6 +304,29 @@ typedef struct
  */
 sdcr_status sdcr_task(sdcr_get_tick_function getTickMs);
 
+/* Will do the call routine management, at a given time.
+ * Same as `sdcr_task`, for a caller that already knows the time.
+ * param:   nowMs - the number of milliseconds elapsed since startup.
+ * return:  A sdcr status. 0 is success. 
+ */
+sdcr_status sdcr_task_at(uint32_t nowMs);
+
+/* Will do the call routine management, and render the routines
+ * bound to an output in a frame.
+ * Instead of calling its callback, a routine bound to an output toggles
+ * its bit in the frame. The routines without output call their callback,
+ * like in `sdcr_task`.
+ * note: The whole frame is updated in a single pass, so it can be sent
+ *       to the hardware (ex: shift registers, DMA) in one transfer.
+ * note: Bits outside of the frame are ignored.
+ * param:   nowMs - the number of milliseconds elapsed since startup.
+ * param:   frame - the caller owned output buffer. Bit `n` is
+ *                  `frame[n / 8] & (1 << (n % 8))`.
+ * param:   frameSize - the number of bytes in `frame`.
+ * return:  A sdcr status. 0 is success. 
+ */
+sdcr_status sdcr_render(uint32_t nowMs, uint8_t *frame, size_t frameSize);
+
 /* Will create a new routine with the configuration.
  * note: The maximal number of routine is define in `sdcr_MAX_NUMBER_OF_routine`. 
  * note: See `sdcr_routine_new` for cleaner api.
@@ -152,6 +348,29 @@ sdcr_status sdcr_routine_new_base(sdcr_routine_configuration config);
  */
 #define sdcr_routine_new(...) sdcr_routine_new_base((sdcr_routine_configuration){__VA_ARGS__});
 
+/* Will create a new stream routine with the configuration.
+ * The first two chunks of events are pulled right away.
+ * note: A stream plays once: it completes with the last event of its source
+ *       (see `sdcr_routine_on_complete`). It can be stopped and started again,
+ *       but not from its begining (`sdcr_routine_start_at`, or a chain).
+ * note: Its `cursorPosition` counts the steps in the pulled chunks.
+ * note: The maximal number of stream is define in `SDCR_MAX_NUMBER_OF_STREAM`.
+ * param: config - a structure that will define the routine behavior.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_routine_new_stream_base(sdcr_stream_configuration config);
+
+/* Will create a new stream routine with the configuration.
+ * return: A sdcr status. 0 is success.
+ * usage:
+ *      sdcr_routine_new_stream(.id = "beacon",
+ *                              .source = morse_next_events,
+ *                              .context = &morseEncoder,
+ *                              .callbackFunction = toggle_red_led,
+ *                              .routineStepTimeMs = 100);
+ */
+#define sdcr_routine_new_stream(...) sdcr_routine_new_stream_base((sdcr_stream_configuration){__VA_ARGS__});
+
 /* Will clear a routine from memory.
  * The routine wont exist anymore and a new routine can
  * replace it in the library allocated memory.
@@ -174,6 +393,18 @@ sdcr_status sdcr_routine_start_inf(const char *id);
  */
 sdcr_status sdcr_routine_start_for_n_cycles(const char *id, uint16_t n);
 
+/* Will start a routine from its begining, at a known time.
+ * The routine can then be queried with `sdcr_routine_query`.
+ * note: Routines started at the same time are phase-locked.
+ * note: The first step happens one step time after `startMs`. It should not
+ *       be later than the next `sdcr_task` time.
+ * param: The routine id, an unique inline string.
+ * param: n - the number of cycle. 0 to cycle infinitely.
+ * param: startMs - the start time, in the `sdcr_task` time base.
+ * return: A sdcr status. 0 is success. 
+ */
+sdcr_status sdcr_routine_start_at(const char *id, uint16_t n, uint32_t startMs);
+
 /* Will stop a routine.
  * note: This function complementaty to `sdcr_routine_start_inf`.
  * param: The routine id, an unique inline string.
@@ -181,10 +412,212 @@ sdcr_status sdcr_routine_start_for_n_cycles(const char *id, uint16_t n);
  */
 sdcr_status sdcr_routine_stop(const char *id);
 
+/* Will create many routines.
+ * Same as `sdcr_routine_new_base` for each configuration, in linear time.
+ * param: configs - the routine configurations.
+ * param: count - the number of configurations.
+ * param: statuses - where to write the status of each configuration. Can be NULL.
+ * return: The first error of the configurations. 0 is success.
+ */
+sdcr_status sdcr_routine_new_many(const sdcr_routine_configuration *configs, size_t count, sdcr_status *statuses);
+
+/* Will start many routines, in linear time.
+ * note: With a start time, it is `sdcr_routine_start_at` for each routine:
+ *       the routines are phase-locked.
+ * param: ids - the routine ids.
+ * param: count - the number of ids.
+ * param: n - the number of cycle. 0 to cycle infinitely.
+ * param: startMs - the shared start time. NULL to continue each routine from
+ *        its current phase, like `sdcr_routine_start_for_n_cycles`.
+ * param: statuses - where to write the status of each id. Can be NULL.
+ * return: The first error of the ids. 0 is success.
+ */
+sdcr_status sdcr_routine_start_many(const char *const *ids, size_t count, uint16_t n, const uint32_t *startMs, sdcr_status *statuses);
+
+/* Will stop many routines, in linear time.
+ * param: ids - the routine ids.
+ * param: count - the number of ids.
+ * param: statuses - where to write the status of each id. Can be NULL.
+ * return: The first error of the ids. 0 is success.
+ */
+sdcr_status sdcr_routine_stop_many(const char *const *ids, size_t count, sdcr_status *statuses);
+
+/* Will bind a routine to a bit of the `sdcr_render` frame.
+ * param: The routine id, an unique inline string.
+ * param: bit - the bit index in the frame.
+ * return: A sdcr status. 0 is success. 
+ */
+sdcr_status sdcr_routine_bind_output(const char *id, uint16_t bit);
+
+/* Will unbind a routine from the `sdcr_render` frame.
+ * note: This function complementaty to `sdcr_routine_bind_output`.
+ * param: The routine id, an unique inline string.
+ * return: A sdcr status. 0 is success. 
+ */
+sdcr_status sdcr_routine_unbind_output(const char *id);
+
+/* Will set the function called when a routine started for n cycles is complete.
+ * note: It is called by `sdcr_task`, right after the step completing the routine.
+ * param: The routine id, an unique inline string.
+ * note: The maximal number of routines with a completion function or a chain
+ *       is define in `SDCR_MAX_NUMBER_OF_COMPLETION`.
+ * param: onComplete - the function to call. NULL to remove it.
+ * return: A sdcr status. 0 is success. 
+ */
+sdcr_status sdcr_routine_on_complete(const char *id, sdcr_complete_function onComplete);
+
+/* Will chain two routines: when a routine started for n cycles is complete,
+ * the next routine is started from its begining.
+ * note: The next routine is started by `sdcr_task`, in the same call. Without
+ *       offset, its first step is performed in the same call: there is no gap.
+ * param: The routine id, an unique inline string.
+ * param: nextId - the routine to start. NULL to remove the chain.
+ * param: n - the number of cycles of the next routine. 0 to cycle infinitely.
+ * param: phaseOffsetMs - the time between the completion and the first
+ *                        step of the next routine.
+ * return: A sdcr status. 0 is success. 
+ */
+sdcr_status sdcr_routine_chain(const char *id, const char *nextId, uint16_t n, uint32_t phaseOffsetMs);
+
+/* Will set the timer slack of a routine: its steps can be performed
+ * up to `slackMs` early or late, to share a wakeup with other routines.
+ * note: Early, when `sdcr_task` performs a step of another routine anyway.
+ *       Late, when the host sleeps until `sdcr_get_next_wakeup`.
+ * note: A step performed within its slack doesn't move the next steps: they
+ *       are timed from its deadline. Later steps are timed from the actual step time.
+ * param: The routine id, an unique inline string.
+ * param: slackMs - the tolerance in ms, up to 65535. 0 to disable it.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_routine_set_slack(const char *id, uint32_t slackMs);
+
+/* Will compute how long the host can sleep before calling `sdcr_task`.
+ * The first deadline is only delayed, within the routines slack, when a
+ * later deadline can be performed at the same wakeup.
+ * note: Useful for a tickless host, to save power.
+ * param: nowMs - the number of milliseconds elapsed since startup.
+ * param: delayMs - where to write the time to sleep. 0 if a step can't wait
+ *                  anymore, UINT32_MAX if no routine is running.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_get_next_wakeup(uint32_t nowMs, uint32_t *delayMs);
+
+/* Will copy the scheduler statistics, counted since startup or `sdcr_clear_stats`.
+ * note: Should be called from the thread running `sdcr_task`.
+ * param: stats - where to copy the statistics.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_get_stats(sdcr_stats *stats);
+
+/* Will reset the scheduler statistics.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_clear_stats();
+
+/* A callback doing nothing.
+ * Useful for routines only used with an output in `sdcr_render`.
+ */
+void sdcr_callback_none();
+
 /* Will clear all routine from memory.
  * return: A sdcr status. 0 is success. 
  */
 sdcr_status sdcr_routine_clear_all();
 
+/* Will copy the state of a routine.
+ * note: This function is lock-free. It can be called from another thread
+ *       (ex: a monitoring thread) while `sdcr_task` is running. It never
+ *       blocks `sdcr_task`: if the routine is updated during the copy,
+ *       the copy is retried. Routines can be created or cleared meanwhile.
+ * note: It can be called from a routine callback, but not from an interrupt
+ *       (or signal handler) preempting `sdcr_task`: it would spin forever.
+ * param: The routine id, an unique inline string.
+ * param: state - where to copy the routine state.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_routine_get_state(const char *id, sdcr_routine_state *state);
+
+/* Will compute the state of a routine at any time, without `sdcr_task`.
+ * The state is computed from the start time and the routine pattern, as if
+ * every step were performed on time: the cost doesn't depend on the time.
+ * note: The routine must be started by `sdcr_routine_start_at`, or by a chain.
+ *       A routine stopped, or started by another function, can't be queried.
+ * note: This function is lock-free, like `sdcr_routine_get_state`.
+ * param: The routine id, an unique inline string.
+ * param: atMs - the time, in the `sdcr_task` time base.
+ * param: result - where to write the routine state.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_routine_query(const char *id, uint32_t atMs, sdcr_routine_query_result *result);
+
+/* Will copy the state of every existing routine.
+ * note: Each copy is consistent on its own (see `sdcr_routine_get_state`),
+ *       but routines are not copied at the same instant.
+ * param: states - where to copy the routine states.
+ * param: capacity - the number of element in `states`.
+ * param: count - where to write the number of copied states.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_routine_get_state_all(sdcr_routine_state *states, size_t capacity, size_t *count);
+
+/* Will copy the whole scheduler state in a blob, to restart warm.
+ * The blob is versioned and holds the compiled routines: it can be kept in
+ * retained RAM, or in a file, and given to `sdcr_restore` after a restart.
+ * note: IDs and callbacks are stored as addresses. The blob can only be
+ *       restored by the same program, even if it is loaded at another
+ *       address (ex: ASLR), as long as IDs are inline strings.
+ * note: Should be called in the same thread as `sdcr_task`.
+ * note: Stream routines can't be copied: their source state is unknown.
+ * note: Plain routines played from their string (see `sdcr_routine_configuration`)
+ *       can't be copied either: the string may not be inline.
+ * param: nowMs - the snapshot time, in the `sdcr_task` time base.
+ * param: buffer - where to write the blob. NULL to only get its size.
+ * param: capacity - the size of `buffer`, in bytes.
+ * param: size - where to write the blob size, in bytes.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_snapshot(uint32_t nowMs, uint8_t *buffer, size_t capacity, size_t *size);
+
+/* Will replace every routine with the routines of a `sdcr_snapshot` blob.
+ * The routines continue where they were at the snapshot time: `nowMs`
+ * is the same instant in the new time base.
+ * note: A damaged blob is rejected before any routine is changed.
+ * note: Should be called in the same thread as `sdcr_task`.
+ * param: nowMs - the restore time, in the `sdcr_task` time base.
+ * param: buffer - the blob.
+ * param: size - the blob size, in bytes.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_restore(uint32_t nowMs, const uint8_t *buffer, size_t size);
+
+#ifdef SDCR_ENABLE_TRACE
+/* Will start recording trace events.
+ * note: The trace clock can have a better resolution than the `sdcr_task`
+ *       tick (ex: µs), to measure the callbacks duration.
+ * note: Recording is lock-free. The oldest events are overwritten
+ *       when the ring buffer is full.
+ * param: traceClock - function_ptr to a function that return the time.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_trace_enable(sdcr_get_tick_function traceClock);
+
+/* Will stop recording trace events.
+ * note: Recorded events can still be read.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_trace_disable();
+
+/* Will move the recorded events out of the ring buffer, oldest first.
+ * note: Only one reader at a time.
+ * param: events - where to copy the events.
+ * param: capacity - the number of element in `events`.
+ * param: count - where to write the number of copied events.
+ * param: lost - where to write the number of events overwritten before
+ *               being read. Can be NULL.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_trace_read(sdcr_trace_event *events, size_t capacity, size_t *count, uint32_t *lost);
+#endif // SDCR_ENABLE_TRACE
+
 
 #endif // _SDCR_H_
\ No newline at end of file
@@ -0,0 +1,355 @@
+/*
+ * srdc_engine.c
+ * String Defined Call Routine library - scheduling engines
+ *
+ * Copyright (c) 2019 G.Berthiaume , All rights reserved.
+ * BSD 3-Clause License (Revised)
+ */
+
+//-----------------------------------------------
+// INCLUDES
+//-----------------------------------------------
+#include <stdbool.h>
+
+#include "sdrc_engine.h"
+
+//-----------------------------------------------
+// MACROS
+//-----------------------------------------------
+#define SDCR_WHEEL_SIZE 256u //< Slots of 1 ms. Must be a power of 2.
+
+_Static_assert((SDCR_WHEEL_SIZE & (SDCR_WHEEL_SIZE - 1u)) == 0, "the wheel size must be a power of 2");
+_Static_assert(SDCR_MAX_NUMBER_OF_ROUTINE < UINT16_MAX, "routine indexes are stored on 16 bits");
+
+//-----------------------------------------------
+// DEFINITION
+//-----------------------------------------------
+#if SDCR_ENGINE == SDCR_ENGINE_LINEAR || defined(SDCR_ENGINE_ALL)
+/* Linear engine.
+ * Checks the deadline of every started routine, at each pass.
+ */
+typedef struct
+{
+    uint32_t deadlines[SDCR_MAX_NUMBER_OF_ROUTINE];
+    uint64_t isActive[SDCR_ENGINE_WORDS];
+} sdcr_linear;
+#endif
+
+#if SDCR_ENGINE == SDCR_ENGINE_HEAP || defined(SDCR_ENGINE_ALL)
+/* Heap engine.
+ * A binary min-heap of the started routines, by deadline.
+ * A pass only reads the routines due, and the top of the heap.
+ */
+typedef struct
+{
+    uint32_t deadlines[SDCR_MAX_NUMBER_OF_ROUTINE];
+    uint16_t heap[SDCR_MAX_NUMBER_OF_ROUTINE];      //< Routine indexes, the earliest deadline first.
+    uint16_t positions[SDCR_MAX_NUMBER_OF_ROUTINE]; //< Position in `heap` + 1, 0 if not in the heap.
+    size_t size;
+} sdcr_heap;
+#endif
+
+#if SDCR_ENGINE == SDCR_ENGINE_WHEEL || defined(SDCR_ENGINE_ALL)
+/* Timing wheel engine.
+ * Each started routine is in the slot of its deadline tick, modulo the
+ * wheel size. A pass only reads the slots of the ticks elapsed since the
+ * previous pass: the routines of a slot due in a later turn stay in it.
+ */
+typedef struct
+{
+    uint32_t deadlines[SDCR_MAX_NUMBER_OF_ROUTINE];
+    uint16_t heads[SDCR_WHEEL_SIZE];                //< First routine of each slot: index + 1, 0 if empty.
+    uint16_t next[SDCR_MAX_NUMBER_OF_ROUTINE];      //< Next routine in the slot: index + 1, 0 if none.
+    uint16_t previous[SDCR_MAX_NUMBER_OF_ROUTINE];  //< Previous routine in the slot: index + 1, 0 if first.
+    uint16_t slots[SDCR_MAX_NUMBER_OF_ROUTINE];     //< Slot + 1, 0 if not in the wheel.
+    uint32_t tick;                                  //< The last tick collected.
+} sdcr_wheel;
+#endif
+
+//-----------------------------------------------
+// GLOBAL VARIABLES
+//-----------------------------------------------
+#if SDCR_ENGINE == SDCR_ENGINE_LINEAR || defined(SDCR_ENGINE_ALL)
+static sdcr_linear gLinear = {0};
+#endif
+#if SDCR_ENGINE == SDCR_ENGINE_HEAP || defined(SDCR_ENGINE_ALL)
+static sdcr_heap gHeap = {0};
+#endif
+#if SDCR_ENGINE == SDCR_ENGINE_WHEEL || defined(SDCR_ENGINE_ALL)
+static sdcr_wheel gWheel = {0};
+#endif
+
+//-----------------------------------------------
+// INTERNAL PROTOTYPES
+//-----------------------------------------------
+static bool sdcr_engine_is_due(uint32_t deadlineMs, uint32_t nowMs);
+#if SDCR_ENGINE == SDCR_ENGINE_LINEAR || defined(SDCR_ENGINE_ALL)
+static void sdcr_linear_clear();
+static void sdcr_linear_update(size_t index, uint32_t deadlineMs, bool isActive);
+static void sdcr_linear_collect(uint32_t nowMs, uint64_t *due);
+#endif
+#if SDCR_ENGINE == SDCR_ENGINE_HEAP || defined(SDCR_ENGINE_ALL)
+static void sdcr_heap_clear();
+static void sdcr_heap_update(size_t index, uint32_t deadlineMs, bool isActive);
+static void sdcr_heap_collect(uint32_t nowMs, uint64_t *due);
+static void sdcr_heap_remove(size_t index);
+static bool sdcr_heap_is_before(size_t position, size_t otherPosition);
+static void sdcr_heap_swap(size_t position, size_t otherPosition);
+static void sdcr_heap_sift_up(size_t position);
+static void sdcr_heap_sift_down(size_t position);
+#endif
+#if SDCR_ENGINE == SDCR_ENGINE_WHEEL || defined(SDCR_ENGINE_ALL)
+static void sdcr_wheel_clear();
+static void sdcr_wheel_update(size_t index, uint32_t deadlineMs, bool isActive);
+static void sdcr_wheel_collect(uint32_t nowMs, uint64_t *due);
+static void sdcr_wheel_collect_slot(size_t slot, uint32_t nowMs, uint64_t *due);
+static void sdcr_wheel_remove(size_t index);
+#endif
+
+//-----------------------------------------------
+// ENGINES
+//-----------------------------------------------
+#if SDCR_ENGINE == SDCR_ENGINE_LINEAR || defined(SDCR_ENGINE_ALL)
+const sdcr_engine sdcr_engine_linear = {
+    .name = "linear",
+    .clear = sdcr_linear_clear,
+    .update = sdcr_linear_update,
+    .collect = sdcr_linear_collect,
+};
+#endif
+
+#if SDCR_ENGINE == SDCR_ENGINE_HEAP || defined(SDCR_ENGINE_ALL)
+const sdcr_engine sdcr_engine_heap = {
+    .name = "heap",
+    .clear = sdcr_heap_clear,
+    .update = sdcr_heap_update,
+    .collect = sdcr_heap_collect,
+};
+#endif
+
+#if SDCR_ENGINE == SDCR_ENGINE_WHEEL || defined(SDCR_ENGINE_ALL)
+const sdcr_engine sdcr_engine_wheel = {
+    .name = "wheel",
+    .clear = sdcr_wheel_clear,
+    .update = sdcr_wheel_update,
+    .collect = sdcr_wheel_collect,
+};
+#endif
+
+//-----------------------------------------------
+// INTERNAL FUNCTIONS
+//-----------------------------------------------
+static bool sdcr_engine_is_due(uint32_t deadlineMs, uint32_t nowMs)
+{
+    return (int32_t)(nowMs - deadlineMs) >= 0;
+}
+
+#if SDCR_ENGINE == SDCR_ENGINE_LINEAR || defined(SDCR_ENGINE_ALL)
+static void sdcr_linear_clear()
+{
+    gLinear = (sdcr_linear){0};
+}
+
+static void sdcr_linear_update(size_t index, uint32_t deadlineMs, bool isActive)
+{
+    gLinear.deadlines[index] = deadlineMs;
+    if (isActive)
+        sdcr_bits_set(gLinear.isActive, index);
+    else
+        sdcr_bits_clear(gLinear.isActive, index);
+}
+
+static void sdcr_linear_collect(uint32_t nowMs, uint64_t *due)
+{
+    for (size_t index = sdcr_bits_next(gLinear.isActive, 0);
+         index < SDCR_MAX_NUMBER_OF_ROUTINE;
+         index = sdcr_bits_next(gLinear.isActive, index + 1u))
+    {
+        if (sdcr_engine_is_due(gLinear.deadlines[index], nowMs))
+        {
+            sdcr_bits_set(due, index);
+            sdcr_bits_clear(gLinear.isActive, index);
+        }
+    }
+}
+#endif
+
+#if SDCR_ENGINE == SDCR_ENGINE_HEAP || defined(SDCR_ENGINE_ALL)
+static void sdcr_heap_clear()
+{
+    gHeap = (sdcr_heap){0};
+}
+
+static void sdcr_heap_update(size_t index, uint32_t deadlineMs, bool isActive)
+{
+    if (!isActive)
+    {
+        sdcr_heap_remove(index);
+        return;
+    }
+
+    gHeap.deadlines[index] = deadlineMs;
+    if (gHeap.positions[index] == 0)
+    {
+        // push at the bottom
+        gHeap.heap[gHeap.size] = (uint16_t)index;
+        gHeap.positions[index] = (uint16_t)(++gHeap.size);
+    }
+    // The deadline moved either way.
+    const size_t position = gHeap.positions[index] - 1u;
+    sdcr_heap_sift_up(position);
+    sdcr_heap_sift_down(gHeap.positions[index] - 1u);
+}
+
+static void sdcr_heap_collect(uint32_t nowMs, uint64_t *due)
+{
+    while (gHeap.size != 0 && sdcr_engine_is_due(gHeap.deadlines[gHeap.heap[0]], nowMs))
+    {
+        const size_t index = gHeap.heap[0];
+        sdcr_bits_set(due, index);
+        sdcr_heap_remove(index);
+    }
+}
+
+static void sdcr_heap_remove(size_t index)
+{
+    if (gHeap.positions[index] == 0)
+        return;
+
+    // the last routine takes its place
+    const size_t position = gHeap.positions[index] - 1u;
+    const size_t last = --gHeap.size;
+    sdcr_heap_swap(position, last);
+    gHeap.positions[index] = 0;
+    if (position < gHeap.size)
+    {
+        const size_t moved = gHeap.heap[position];
+        sdcr_heap_sift_up(position);
+        sdcr_heap_sift_down(gHeap.positions[moved] - 1u);
+    }
+}
+
+static bool sdcr_heap_is_before(size_t position, size_t otherPosition)
+{
+    const uint32_t deadline = gHeap.deadlines[gHeap.heap[position]];
+    const uint32_t otherDeadline = gHeap.deadlines[gHeap.heap[otherPosition]];
+    return (int32_t)(deadline - otherDeadline) < 0;
+}
+
+static void sdcr_heap_swap(size_t position, size_t otherPosition)
+{
+    const uint16_t index = gHeap.heap[position];
+    gHeap.heap[position] = gHeap.heap[otherPosition];
+    gHeap.heap[otherPosition] = index;
+    gHeap.positions[gHeap.heap[position]] = (uint16_t)(position + 1u);
+    gHeap.positions[gHeap.heap[otherPosition]] = (uint16_t)(otherPosition + 1u);
+}
+
+static void sdcr_heap_sift_up(size_t position)
+{
+    while (position > 0)
+    {
+        const size_t parent = (position - 1u) / 2u;
+        if (!sdcr_heap_is_before(position, parent))
+            return;
+        sdcr_heap_swap(position, parent);
+        position = parent;
+    }
+}
+
+static void sdcr_heap_sift_down(size_t position)
+{
+    while (true)
+    {
+        const size_t left = 2u * position + 1u;
+        const size_t right = left + 1u;
+        size_t earliest = position;
+        if (left < gHeap.size && sdcr_heap_is_before(left, earliest))
+            earliest = left;
+        if (right < gHeap.size && sdcr_heap_is_before(right, earliest))
+            earliest = right;
+        if (earliest == position)
+            return;
+        sdcr_heap_swap(position, earliest);
+        position = earliest;
+    }
+}
+#endif
+
+#if SDCR_ENGINE == SDCR_ENGINE_WHEEL || defined(SDCR_ENGINE_ALL)
+static void sdcr_wheel_clear()
+{
+    gWheel = (sdcr_wheel){0};
+}
+
+static void sdcr_wheel_update(size_t index, uint32_t deadlineMs, bool isActive)
+{
+    sdcr_wheel_remove(index);
+    if (!isActive)
+        return;
+
+    // A deadline already passed is collected with the last tick.
+    gWheel.deadlines[index] = deadlineMs;
+    const uint32_t tick = sdcr_engine_is_due(deadlineMs, gWheel.tick) ? gWheel.tick : deadlineMs;
+    const size_t slot = tick & (SDCR_WHEEL_SIZE - 1u);
+
+    const size_t head = gWheel.heads[slot];
+    gWheel.next[index] = (uint16_t)head;
+    gWheel.previous[index] = 0;
+    if (head != 0)
+        gWheel.previous[head - 1u] = (uint16_t)(index + 1u);
+    gWheel.heads[slot] = (uint16_t)(index + 1u);
+    gWheel.slots[index] = (uint16_t)(slot + 1u);
+}
+
+static void sdcr_wheel_collect(uint32_t nowMs, uint64_t *due)
+{
+    const uint32_t elapsed = nowMs - gWheel.tick;
+    if ((int32_t)elapsed < 0)
+    {
+        gWheel.tick = nowMs; //< the time went back: the slots are read again from there
+        return;
+    }
+
+    // The last tick is read again: it holds the deadlines passed since.
+    // After a whole turn, every slot is read once.
+    const uint32_t ticks = (elapsed < SDCR_WHEEL_SIZE) ? elapsed + 1u : SDCR_WHEEL_SIZE;
+    for (uint32_t i = 0; i < ticks; i++)
+    {
+        sdcr_wheel_collect_slot((gWheel.tick + i) & (SDCR_WHEEL_SIZE - 1u), nowMs, due);
+    }
+    gWheel.tick = nowMs;
+}
+
+static void sdcr_wheel_collect_slot(size_t slot, uint32_t nowMs, uint64_t *due)
+{
+    size_t member = gWheel.heads[slot];
+    while (member != 0)
+    {
+        const size_t index = member - 1u;
+        member = gWheel.next[index]; //< read first: the routine may be removed
+        if (sdcr_engine_is_due(gWheel.deadlines[index], nowMs))
+        {
+            sdcr_bits_set(due, index);
+            sdcr_wheel_remove(index);
+        }
+    }
+}
+
+static void sdcr_wheel_remove(size_t index)
+{
+    if (gWheel.slots[index] == 0)
+        return;
+
+    const size_t slot = gWheel.slots[index] - 1u;
+    const size_t next = gWheel.next[index];
+    const size_t previous = gWheel.previous[index];
+    if (previous != 0)
+        gWheel.next[previous - 1u] = (uint16_t)next;
+    else
+        gWheel.heads[slot] = (uint16_t)next;
+    if (next != 0)
+        gWheel.previous[next - 1u] = (uint16_t)previous;
+    gWheel.slots[index] = 0;
+}
+#endif
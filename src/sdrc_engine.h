@@ -0,0 +1,133 @@
+/*
+ * sdrc_engine.h
+ * String Defined Call Routine library - scheduling engines, internal
+ *
+ * Not part of the API: only the library and its tests include it.
+ *
+ * An engine keeps the deadline of each started routine, and finds the
+ * routines due at each `sdcr_task` pass. `sdcr_task` still checks each
+ * routine found before performing its step, in the routines order: the
+ * engine only changes how many routines are checked.
+ *
+ * The engine is selected with `SDCR_ENGINE` (see below). Define
+ * `SDCR_ENGINE_ALL` to build every engine, and switch with `sdcr_engine_select`.
+ *
+ * Copyright (c) 2019 G.Berthiaume, All rights reserved.
+ * BSD 3-Clause License
+ */
+#ifndef _SDCR_ENGINE_H_
+#define _SDCR_ENGINE_H_
+
+//-----------------------------------------------
+// INCLUDES
+//-----------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "sdrc.h"
+
+//-----------------------------------------------
+// DEFINITIONS
+//-----------------------------------------------
+
+/* Scheduling engine.
+ * The engine finds the routines due at each `sdcr_task` call. Every engine
+ * performs the same steps, in the same order: only the cost changes.
+ * - `SDCR_ENGINE_LINEAR` checks every started routine. The smallest one.
+ * - `SDCR_ENGINE_HEAP` keeps the deadlines in a min-heap. For many routines
+ *   with long step times.
+ * - `SDCR_ENGINE_WHEEL` keeps the deadlines in a timing wheel of 1 ms slots.
+ *   For many routines with short step times, and a frequent `sdcr_task`.
+ * Define `SDCR_ENGINE` for the library only.
+ */
+#define SDCR_ENGINE_LINEAR 1
+#define SDCR_ENGINE_HEAP 2
+#define SDCR_ENGINE_WHEEL 3
+
+#ifndef SDCR_ENGINE
+#define SDCR_ENGINE SDCR_ENGINE_LINEAR
+#endif
+
+/* The number of words of a routine bitmap: one bit per routine. */
+#define SDCR_ENGINE_WORDS ((SDCR_MAX_NUMBER_OF_ROUTINE + 63) / 64)
+
+/* Scheduling engine interface.
+ * Deadlines are ticks, compared with a wrap around: a deadline is due
+ * when `(int32_t)(nowMs - deadlineMs) >= 0`.
+ */
+typedef struct
+{
+    const char *name;
+    void (*clear)(void);                                             //< Forget every routine.
+    void (*update)(size_t index, uint32_t deadlineMs, bool isActive); //< The routine changed. Inactive routines are forgotten.
+    void (*collect)(uint32_t nowMs, uint64_t *due);                  //< Set the bit of each routine due, and forget it.
+} sdcr_engine;
+
+#if SDCR_ENGINE == SDCR_ENGINE_LINEAR || defined(SDCR_ENGINE_ALL)
+extern const sdcr_engine sdcr_engine_linear;
+#endif
+#if SDCR_ENGINE == SDCR_ENGINE_HEAP || defined(SDCR_ENGINE_ALL)
+extern const sdcr_engine sdcr_engine_heap;
+#endif
+#if SDCR_ENGINE == SDCR_ENGINE_WHEEL || defined(SDCR_ENGINE_ALL)
+extern const sdcr_engine sdcr_engine_wheel;
+#endif
+
+//-----------------------------------------------
+// API
+//-----------------------------------------------
+
+/* Will switch the scheduling engine.
+ * note: Every routine is cleared: the new engine starts empty.
+ * param: engine - one of the engines built.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_engine_select(const sdcr_engine *engine);
+
+/* return: The scheduling engine in use. */
+const sdcr_engine *sdcr_engine_get();
+
+//-----------------------------------------------
+// ROUTINE BITMAPS
+//-----------------------------------------------
+static inline void sdcr_bits_set(uint64_t *bits, size_t index)
+{
+    bits[index / 64] |= (uint64_t)1 << (index % 64);
+}
+
+static inline void sdcr_bits_clear(uint64_t *bits, size_t index)
+{
+    bits[index / 64] &= ~((uint64_t)1 << (index % 64));
+}
+
+static inline bool sdcr_bits_test(const uint64_t *bits, size_t index)
+{
+    return (bits[index / 64] >> (index % 64)) & 1u;
+}
+
+/* return: The first set bit from `index`, `SDCR_MAX_NUMBER_OF_ROUTINE` if none. */
+static inline size_t sdcr_bits_next(const uint64_t *bits, size_t index)
+{
+    while (index < SDCR_MAX_NUMBER_OF_ROUTINE)
+    {
+        const uint64_t word = bits[index / 64] >> (index % 64);
+        if (word == 0)
+        {
+            index = (index / 64 + 1) * 64; //< next word
+            continue;
+        }
+#if defined(__GNUC__)
+        index += (size_t)__builtin_ctzll(word);
+#else
+        for (uint64_t rest = word; (rest & 1u) == 0; rest >>= 1)
+        {
+            index++;
+        }
+#endif
+        return (index < SDCR_MAX_NUMBER_OF_ROUTINE) ? index : SDCR_MAX_NUMBER_OF_ROUTINE;
+    }
+    return SDCR_MAX_NUMBER_OF_ROUTINE;
+}
+
+#endif // _SDCR_ENGINE_H_
@@ -0,0 +1,296 @@
+/*
+ * srdc_rt.c
+ * String Defined Call Routine library - real-time thread, Linux only
+ *
+ * Copyright (c) 2019 G.Berthiaume , All rights reserved.
+ * BSD 3-Clause License (Revised)
+ */
+
+//-----------------------------------------------
+// INCLUDES
+//-----------------------------------------------
+#define _GNU_SOURCE //< pthread_attr_setaffinity_np, CPU_SET
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "sdrc_rt.h"
+#include "sdrc_shm.h"
+
+//-----------------------------------------------
+// DEFINITION
+//-----------------------------------------------
+typedef struct
+{
+    atomic_uint wakeups;
+    atomic_uint maxLatencyUs;
+    atomic_uint histogram[SDCR_RT_HISTOGRAM_SIZE];
+} sdcr_rt_counters;
+
+//-----------------------------------------------
+// MACROS
+//-----------------------------------------------
+#define ARRAY_LENGTH(arr) (sizeof(arr) / sizeof((arr)[0])) //< Wont work with ptr.
+#define SDCR_RT_DEFAULT_STACK_SIZE (256u * 1024u)
+#define SDCR_RT_DEFAULT_PREFAULT_SIZE (64u * 1024u)
+#define SDCR_RT_DEFAULT_SPIN_US 50u
+#define SDCR_RT_DEFAULT_MAX_SLEEP_MS 10u
+#define SDCR_RT_PAGE_SIZE 4096u //< The smallest page size: every page is touched.
+
+_Static_assert(SDCR_RT_HISTOGRAM_SIZE >= 2, "the histogram needs an overflow bucket");
+
+//-----------------------------------------------
+// GLOBAL VARIABLES
+//-----------------------------------------------
+static struct
+{
+    pthread_t thread;
+    sdcr_rt_configuration config;
+    bool isStarted;
+    bool isMemoryLocked; //< By `sdcr_rt_start`: unlocked by `sdcr_rt_stop`.
+    atomic_bool isRunning;
+} gThread = {0};
+
+static sdcr_rt_counters gCounters = {0};
+
+//-----------------------------------------------
+// INTERNAL PROTOTYPES
+//-----------------------------------------------
+static void *sdcr_rt_thread(void *argument);
+static void sdcr_rt_prefault_stack(size_t size);
+static bool sdcr_rt_memory_is_locked();
+static void sdcr_rt_memory_unlock();
+static uint64_t sdcr_rt_clock_ns();
+static void sdcr_rt_wait_until(uint64_t wakeupNs, uint64_t spinNs);
+static void sdcr_rt_record_latency(uint64_t latencyNs);
+
+//-----------------------------------------------
+// API FUNCTIONS
+//-----------------------------------------------
+sdcr_status sdcr_rt_start_base(sdcr_rt_configuration config)
+{
+    if (gThread.isStarted)
+        return SDCR_ERROR_INVALID_API_USAGE;
+    if (config.priority < 0 || config.priority > sched_get_priority_max(SCHED_FIFO))
+        return SDCR_ERROR_INVALID_API_USAGE;
+
+    // defaults
+    if (config.stackSize == 0)
+        config.stackSize = SDCR_RT_DEFAULT_STACK_SIZE;
+    if (config.stackSize < (size_t)PTHREAD_STACK_MIN)
+        config.stackSize = (size_t)PTHREAD_STACK_MIN;
+    if (config.prefaultStackBytes == 0)
+        config.prefaultStackBytes = SDCR_RT_DEFAULT_PREFAULT_SIZE;
+    if (config.prefaultStackBytes > config.stackSize / 2)
+        config.prefaultStackBytes = config.stackSize / 2; //< keep room for the callbacks
+    if (config.spinUs == 0)
+        config.spinUs = SDCR_RT_DEFAULT_SPIN_US;
+    if (config.maxSleepMs == 0)
+        config.maxSleepMs = SDCR_RT_DEFAULT_MAX_SLEEP_MS;
+
+    // Everything is set before the thread runs: it never runs untuned.
+    // Memory locked by the process before is left locked.
+    gThread.isMemoryLocked = (config.lockMemory && !sdcr_rt_memory_is_locked());
+    if (config.lockMemory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        return SDCR_ERROR_REAL_TIME;
+
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    int error = pthread_attr_setstacksize(&attributes, config.stackSize);
+    if (error == 0 && config.priority > 0)
+    {
+        const struct sched_param parameters = {.sched_priority = config.priority};
+        error = pthread_attr_setinheritsched(&attributes, PTHREAD_EXPLICIT_SCHED);
+        error = error ? error : pthread_attr_setschedpolicy(&attributes, SCHED_FIFO);
+        error = error ? error : pthread_attr_setschedparam(&attributes, &parameters);
+    }
+    if (error == 0 && config.cpuMask != 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int cpu = 0; cpu < 64; cpu++)
+        {
+            if (config.cpuMask & ((uint64_t)1 << cpu))
+                CPU_SET(cpu, &cpus);
+        }
+        error = pthread_attr_setaffinity_np(&attributes, sizeof(cpus), &cpus);
+    }
+
+    gThread.config = config;
+    atomic_store_explicit(&gThread.isRunning, true, memory_order_relaxed);
+    if (error == 0)
+        error = pthread_create(&gThread.thread, &attributes, sdcr_rt_thread, NULL);
+    pthread_attr_destroy(&attributes);
+    if (error != 0)
+    {
+        atomic_store_explicit(&gThread.isRunning, false, memory_order_relaxed);
+        sdcr_rt_memory_unlock();
+        return SDCR_ERROR_REAL_TIME;
+    }
+
+    gThread.isStarted = true;
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_rt_stop()
+{
+    if (!gThread.isStarted)
+        return SDCR_ERROR_INVALID_API_USAGE;
+
+    // The thread sleeps at most `maxSleepMs`.
+    atomic_store_explicit(&gThread.isRunning, false, memory_order_release);
+    pthread_join(gThread.thread, NULL);
+    sdcr_rt_memory_unlock();
+    gThread.isStarted = false;
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_rt_get_stats(sdcr_rt_stats *stats)
+{
+    if (stats == NULL)
+        return SDCR_ERROR_NULL_PTR;
+
+    stats->wakeups = atomic_load_explicit(&gCounters.wakeups, memory_order_relaxed);
+    stats->maxLatencyUs = atomic_load_explicit(&gCounters.maxLatencyUs, memory_order_relaxed);
+    for (size_t i = 0; i < ARRAY_LENGTH(gCounters.histogram); i++)
+    {
+        stats->histogram[i] = atomic_load_explicit(&gCounters.histogram[i], memory_order_relaxed);
+    }
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_rt_clear_stats()
+{
+    atomic_store_explicit(&gCounters.wakeups, 0, memory_order_relaxed);
+    atomic_store_explicit(&gCounters.maxLatencyUs, 0, memory_order_relaxed);
+    for (size_t i = 0; i < ARRAY_LENGTH(gCounters.histogram); i++)
+    {
+        atomic_store_explicit(&gCounters.histogram[i], 0, memory_order_relaxed);
+    }
+    return SDCR_SUCCESS;
+}
+
+//-----------------------------------------------
+// INTERNAL FUNCTIONS
+//-----------------------------------------------
+static void *sdcr_rt_thread(void *argument)
+{
+    (void)argument;
+    const sdcr_rt_configuration *config = &gThread.config;
+    const uint64_t spinNs = (uint64_t)config->spinUs * 1000u;
+    sdcr_rt_prefault_stack(config->prefaultStackBytes);
+
+    while (atomic_load_explicit(&gThread.isRunning, memory_order_acquire))
+    {
+        if (config->drainSharedMemory)
+            sdcr_shm_update();
+
+        const uint64_t nowMs = sdcr_rt_clock_ns() / 1000000u;
+        sdcr_task_at((uint32_t)nowMs);
+
+        // Sleep to the next step, or to the next command drain. The wakeup is
+        // only past a deadline to share it: the slack routines keep their period.
+        uint32_t delayMs;
+        sdcr_get_next_wakeup((uint32_t)nowMs, &delayMs);
+        if (delayMs > config->maxSleepMs)
+            delayMs = config->maxSleepMs;
+        if (delayMs == 0)
+            delayMs = 1; //< The steps due now are already performed.
+
+        const uint64_t wakeupNs = (nowMs + delayMs) * 1000000u;
+        sdcr_rt_wait_until(wakeupNs, spinNs);
+        sdcr_rt_record_latency(sdcr_rt_clock_ns() - wakeupNs);
+    }
+    return NULL;
+}
+
+/* return: true if some memory of the process is locked (`VmLck`), or if it can't be known. */
+static bool sdcr_rt_memory_is_locked()
+{
+    FILE *file = fopen("/proc/self/status", "r");
+    if (file == NULL)
+        return true;
+
+    bool isLocked = true;
+    char line[128];
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        unsigned long lockedKb;
+        if (sscanf(line, "VmLck: %lu", &lockedKb) == 1)
+        {
+            isLocked = (lockedKb != 0);
+            break;
+        }
+    }
+    fclose(file);
+    return isLocked;
+}
+
+/* Will unlock the memory, only if `sdcr_rt_start` locked it. */
+static void sdcr_rt_memory_unlock()
+{
+    if (gThread.isMemoryLocked)
+        munlockall();
+    gThread.isMemoryLocked = false;
+}
+
+/* Will touch the stack, so the thread doesn't page fault in a callback.
+ * With locked memory, the touched pages stay mapped.
+ */
+static void sdcr_rt_prefault_stack(size_t size)
+{
+    volatile uint8_t stack[size];
+    for (size_t i = 0; i < size; i += SDCR_RT_PAGE_SIZE)
+    {
+        stack[i] = 0;
+    }
+    (void)stack;
+}
+
+static uint64_t sdcr_rt_clock_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/* Will sleep until `spinNs` before the wakeup time, then spin.
+ * The sleep absorbs the scheduler latency, the spin the last microseconds.
+ */
+static void sdcr_rt_wait_until(uint64_t wakeupNs, uint64_t spinNs)
+{
+    const uint64_t sleepNs = (wakeupNs > spinNs) ? wakeupNs - spinNs : 0;
+    const struct timespec sleepUntil = {
+        .tv_sec = (time_t)(sleepNs / 1000000000u),
+        .tv_nsec = (long)(sleepNs % 1000000000u),
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &sleepUntil, NULL) == EINTR)
+    {
+    }
+    while (sdcr_rt_clock_ns() < wakeupNs)
+    {
+    }
+}
+
+static void sdcr_rt_record_latency(uint64_t latencyNs)
+{
+    const uint64_t latencyUs = latencyNs / 1000u;
+    size_t bucket = 0;
+    while (bucket < SDCR_RT_HISTOGRAM_SIZE - 1 && latencyUs >= ((uint64_t)1 << bucket))
+    {
+        bucket++;
+    }
+    atomic_fetch_add_explicit(&gCounters.histogram[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&gCounters.wakeups, 1, memory_order_relaxed);
+
+    const unsigned latency = (latencyUs > UINT32_MAX) ? UINT32_MAX : (unsigned)latencyUs;
+    if (latency > atomic_load_explicit(&gCounters.maxLatencyUs, memory_order_relaxed))
+        atomic_store_explicit(&gCounters.maxLatencyUs, latency, memory_order_relaxed);
+}
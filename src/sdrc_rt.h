@@ -0,0 +1,123 @@
+/*
+ * sdrc_rt.h
+ * String Defined Call Routine library - real-time thread, Linux only
+ *
+ * Runs `sdcr_task` in its own real-time thread: the thread sleeps until the
+ * next routine step (see `sdcr_get_next_wakeup`), spins the last microseconds
+ * to wake up on time, drains the shared memory commands, then performs the
+ * steps. The scheduling policy, the CPU affinity and the memory locking are
+ * set before the thread runs.
+ *
+ * USAGE:
+ *      // Create the routines first, then start the thread.
+ *      sdcr_routine_new(.id = "red led", ...);
+ *      sdcr_routine_start_inf("red led");
+ *      sdcr_rt_start(.priority = 80, .cpuMask = 1u << 3, .lockMemory = true);
+ *
+ *      // Other threads and processes control the routines through
+ *      // the shared memory control plane (see `sdrc_shm.h`).
+ *
+ *      sdcr_rt_stats stats;
+ *      sdcr_rt_get_stats(&stats);
+ *      sdcr_rt_stop();
+ *
+ * Copyright (c) 2019 G.Berthiaume, All rights reserved.
+ * BSD 3-Clause License
+ */
+#ifndef _SDCR_RT_H_
+#define _SDCR_RT_H_
+
+//-----------------------------------------------
+// INCLUDES
+//-----------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "sdrc.h"
+
+//-----------------------------------------------
+// USER CONFIG
+//-----------------------------------------------
+
+/* The number of buckets of the wakeup latency histogram.
+ * Bucket 0 counts the latencies under 1 µs, bucket i the latencies
+ * from 2^(i-1) to 2^i µs. The last bucket counts everything above.
+ */
+#ifndef SDCR_RT_HISTOGRAM_SIZE
+#define SDCR_RT_HISTOGRAM_SIZE 16
+#endif
+
+//-----------------------------------------------
+// DEFINITIONS
+//-----------------------------------------------
+
+/* real-time thread configuration
+ * Fields left to 0 keep the default behavior.
+ */
+typedef struct
+{
+    int priority;              //< The `SCHED_FIFO` priority, from 1 to 99. 0 keeps the default scheduler.
+    uint64_t cpuMask;          //< The CPUs the thread can run on, one bit per CPU. 0 for any CPU.
+    bool lockMemory;           //< Lock the process memory (`mlockall`): no page fault in the thread. Unlocked by `sdcr_rt_stop`, unless the process locked memory before.
+    size_t stackSize;          //< The thread stack size, in bytes. 0 for 256 KiB.
+    size_t prefaultStackBytes; //< The stack touched before the first step, in bytes. 0 for 64 KiB.
+    uint32_t spinUs;           //< The time spent spinning before each wakeup, in µs. 0 for 50 µs.
+    uint32_t maxSleepMs;       //< The longest sleep, to drain commands when no step is due. 0 for 10 ms.
+    bool drainSharedMemory;    //< Call `sdcr_shm_update` at each wakeup. See `sdcr_shm_create`.
+} sdcr_rt_configuration;
+
+/* real-time thread statistics
+ * See `sdcr_rt_get_stats`.
+ */
+typedef struct
+{
+    uint32_t wakeups;                             //< The number of wakeups.
+    uint32_t maxLatencyUs;                        //< The worst wakeup latency, in µs.
+    uint32_t histogram[SDCR_RT_HISTOGRAM_SIZE];   //< The wakeups by latency. See `SDCR_RT_HISTOGRAM_SIZE`.
+} sdcr_rt_stats;
+
+//-----------------------------------------------
+// API
+//-----------------------------------------------
+
+/* Will start the real-time thread running `sdcr_task`.
+ * note: See `sdcr_rt_start` for cleaner api.
+ * note: Once started, only the thread changes the routines. Other threads
+ *       must use the lock-free functions (ex: `sdcr_routine_get_state`),
+ *       or the shared memory control plane.
+ * note: The `sdcr_task` time base is `CLOCK_MONOTONIC`, in ms.
+ * note: A real-time priority, or the memory locking, needs privileges
+ *       (ex: `CAP_SYS_NICE`, `CAP_IPC_LOCK`, or `ulimit -r` and `ulimit -l`).
+ * param: config - a structure that will define the thread behavior.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_rt_start_base(sdcr_rt_configuration config);
+
+/* Will start the real-time thread running `sdcr_task`.
+ * return: A sdcr status. 0 is success.
+ * usage:
+ *      sdcr_rt_start(.priority = 80,
+ *                    .lockMemory = true);
+ */
+#define sdcr_rt_start(...) sdcr_rt_start_base((sdcr_rt_configuration){__VA_ARGS__})
+
+/* Will stop the real-time thread, and wait for it.
+ * note: This function complementaty to `sdcr_rt_start`.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_rt_stop();
+
+/* Will copy the wakeup statistics of the real-time thread.
+ * note: It can be called from any thread. Counters are not copied at the same instant.
+ * param: stats - where to copy the statistics.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_rt_get_stats(sdcr_rt_stats *stats);
+
+/* Will reset the wakeup statistics of the real-time thread.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_rt_clear_stats();
+
+#endif // _SDCR_RT_H_
@@ -0,0 +1,525 @@
+/*
+ * srdc_shm.c
+ * String Defined Call Routine library - shared memory control plane
+ *
+ * Copyright (c) 2019 G.Berthiaume , All rights reserved.
+ * BSD 3-Clause License (Revised)
+ */
+
+//-----------------------------------------------
+// INCLUDES
+//-----------------------------------------------
+#define _POSIX_C_SOURCE 200809L //< shm_open, ftruncate, fstat, sysconf, clock_gettime
+
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sdrc_shm.h"
+
+//-----------------------------------------------
+// DEFINITION
+//-----------------------------------------------
+typedef enum
+{
+    SDCR_SHM_COMMAND_START_INF,
+    SDCR_SHM_COMMAND_START_FOR_N_CYCLES,
+    SDCR_SHM_COMMAND_STOP,
+} sdcr_shm_command_type;
+
+/* A cell of the command queue.
+ * The queue is a bounded multi-producer single-consumer ring. Each cell
+ * has its own sequence, so producers only compete on `enqueuePosition`:
+ *      sequence == position            - the cell is free for the producer at `position`.
+ *      sequence == position + SIZE / 2 - the producer at `position` is writing the command.
+ *      sequence == position + 1        - the cell holds the command at `position`.
+ * A producer reserves its cell before writing it: the consumer only skips
+ * a cell claimed and not reserved yet, so a skipped cell is never written.
+ */
+typedef struct
+{
+    atomic_uint sequence;
+    uint16_t type;   //< A `sdcr_shm_command_type`.
+    uint16_t cycles; //< The number of cycles, for `SDCR_SHM_COMMAND_START_FOR_N_CYCLES`.
+    char id[SDCR_SHM_ID_SIZE];
+} sdcr_shm_command;
+
+typedef struct
+{
+    bool isUsed;
+    bool isEnable;
+    bool isInfinite;
+    int32_t cyclesLeft;
+    uint32_t timestampLastAction;
+    uint32_t cursorPosition;
+    char id[SDCR_SHM_ID_SIZE];
+} sdcr_shm_status_data;
+
+/* A routine of the status table. */
+typedef struct
+{
+    atomic_uint sequence; //< Seqlock: odd while the status is being written.
+    sdcr_shm_status_data data;
+} sdcr_shm_status;
+
+/* The shared memory segment: the part every process writes.
+ * Its layout depends on the user config: `size` is checked when opened.
+ */
+typedef struct
+{
+    atomic_uint magic; //< Written last: the segment is initialized.
+    uint32_t size;     //< Of the whole segment, with the status table.
+    atomic_uint enqueuePosition;
+    sdcr_shm_command commands[SDCR_SHM_COMMAND_QUEUE_SIZE];
+} sdcr_shm_segment;
+
+/* The status table, after the segment on its own pages.
+ * Only the process running `sdcr_task` writes it: the others map it read-only.
+ */
+typedef struct
+{
+    sdcr_shm_status statuses[SDCR_MAX_NUMBER_OF_ROUTINE];
+} sdcr_shm_table;
+
+//-----------------------------------------------
+// MACROS
+//-----------------------------------------------
+#define ARRAY_LENGTH(arr) (sizeof(arr) / sizeof((arr)[0])) //< Wont work with ptr.
+#define SDCR_SHM_MAGIC 0x53444352u //< "SDCR"
+#define SDCR_SHM_NAME_SIZE 256
+#define SDCR_SHM_WRITING(position) ((position) + SDCR_SHM_COMMAND_QUEUE_SIZE / 2) //< Sequence of a cell being written.
+
+_Static_assert((SDCR_SHM_COMMAND_QUEUE_SIZE & (SDCR_SHM_COMMAND_QUEUE_SIZE - 1)) == 0,
+               "SDCR_SHM_COMMAND_QUEUE_SIZE must be a power of 2");
+_Static_assert(SDCR_SHM_COMMAND_QUEUE_SIZE >= 4,
+               "The sequence of a cell being written must differ from the other sequences");
+_Static_assert(ATOMIC_INT_LOCK_FREE == 2,
+               "The shared memory segment needs address-free atomics");
+
+//-----------------------------------------------
+// GLOBAL VARIABLES
+//-----------------------------------------------
+static struct
+{
+    sdcr_shm_segment *segment;
+    sdcr_shm_table *table;
+    unsigned dequeuePosition;
+    bool isStuck;          //< Waiting for the producer of the next command,
+    uint32_t stuckSinceMs; //< since this monotonic time.
+    char name[SDCR_SHM_NAME_SIZE];
+} gOwner = {0};
+
+static struct
+{
+    sdcr_shm_segment *segment;
+    const sdcr_shm_table *table;
+} gClient = {0};
+
+//-----------------------------------------------
+// INTERNAL PROTOTYPES
+//-----------------------------------------------
+static size_t sdcr_shm_table_offset();
+static sdcr_shm_segment *sdcr_shm_map(const char *name, bool isCreating, const sdcr_shm_table **table);
+static void sdcr_shm_perform(const sdcr_shm_command *command, const sdcr_routine_state *states, size_t count);
+static void sdcr_shm_publish();
+static uint32_t sdcr_shm_now_ms();
+static sdcr_status sdcr_shm_send(sdcr_shm_command_type type, const char *id, uint16_t cycles);
+static bool sdcr_shm_find_status(const char *id, sdcr_shm_status_data *data);
+
+//-----------------------------------------------
+// API FUNCTIONS
+//-----------------------------------------------
+sdcr_status sdcr_shm_create(const char *name)
+{
+    if (name == NULL)
+        return SDCR_ERROR_NULL_PTR;
+    if (gOwner.segment != NULL || strlen(name) >= sizeof(gOwner.name))
+        return SDCR_ERROR_INVALID_API_USAGE;
+
+    const sdcr_shm_table *table = NULL;
+    sdcr_shm_segment *segment = sdcr_shm_map(name, true, &table);
+    if (segment == NULL)
+        return SDCR_ERROR_SHARED_MEMORY;
+    gOwner.table = (sdcr_shm_table *)table; //< mapped read-write by the owner
+
+    // initialize, then publish the magic
+    atomic_store_explicit(&segment->magic, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    segment->size = (uint32_t)(sdcr_shm_table_offset() + sizeof(sdcr_shm_table));
+    atomic_store_explicit(&segment->enqueuePosition, 0, memory_order_relaxed);
+    for (size_t i = 0; i < ARRAY_LENGTH(segment->commands); i++)
+    {
+        atomic_store_explicit(&segment->commands[i].sequence, (unsigned)i, memory_order_relaxed);
+    }
+    for (size_t i = 0; i < ARRAY_LENGTH(gOwner.table->statuses); i++)
+    {
+        atomic_store_explicit(&gOwner.table->statuses[i].sequence, 0, memory_order_relaxed);
+        memset(&gOwner.table->statuses[i].data, 0, sizeof(gOwner.table->statuses[i].data));
+    }
+    atomic_store_explicit(&segment->magic, SDCR_SHM_MAGIC, memory_order_release);
+
+    gOwner.segment = segment;
+    gOwner.dequeuePosition = 0;
+    gOwner.isStuck = false;
+    strcpy(gOwner.name, name);
+    sdcr_shm_publish();
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_shm_update()
+{
+    sdcr_shm_segment *segment = gOwner.segment;
+    if (segment == NULL)
+        return SDCR_ERROR_INVALID_API_USAGE;
+
+    // drain the command queue
+    sdcr_routine_state states[SDCR_MAX_NUMBER_OF_ROUTINE];
+    size_t count = 0;
+    sdcr_routine_get_state_all(states, ARRAY_LENGTH(states), &count);
+    for (size_t i = 0; i < SDCR_SHM_COMMAND_QUEUE_SIZE; i++)
+    {
+        const unsigned position = gOwner.dequeuePosition;
+        sdcr_shm_command *command = &segment->commands[position & (SDCR_SHM_COMMAND_QUEUE_SIZE - 1)];
+        unsigned sequence = atomic_load_explicit(&command->sequence, memory_order_acquire);
+        if (sequence != position + 1)
+        {
+            // A producer claimed the cell and didn't reserve it yet: it may have died.
+            // A reserved cell is being written: it is never skipped.
+            const bool isClaimed = (sequence == position &&
+                                    atomic_load_explicit(&segment->enqueuePosition, memory_order_relaxed) != position);
+            if (!isClaimed)
+            {
+                gOwner.isStuck = false;
+                break; //< empty, or being written
+            }
+            const uint32_t nowMs = sdcr_shm_now_ms();
+            if (!gOwner.isStuck)
+            {
+                gOwner.isStuck = true;
+                gOwner.stuckSinceMs = nowMs;
+            }
+            if ((uint32_t)(nowMs - gOwner.stuckSinceMs) < SDCR_SHM_STUCK_MS)
+                break; //< may still reserve it
+            if (atomic_compare_exchange_strong_explicit(&command->sequence, &sequence, position + SDCR_SHM_COMMAND_QUEUE_SIZE,
+                                                        memory_order_acq_rel, memory_order_acquire))
+            {
+                gOwner.dequeuePosition = position + 1; //< skipped: the producer will fail to reserve it
+                gOwner.isStuck = false;
+            }
+            continue; //< or reserved just now
+        }
+
+        sdcr_shm_perform(command, states, count);
+        atomic_store_explicit(&command->sequence, position + SDCR_SHM_COMMAND_QUEUE_SIZE, memory_order_release);
+        gOwner.dequeuePosition = position + 1;
+        gOwner.isStuck = false;
+    }
+
+    sdcr_shm_publish();
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_shm_destroy()
+{
+    if (gOwner.segment == NULL)
+        return SDCR_ERROR_INVALID_API_USAGE;
+
+    munmap(gOwner.segment, sdcr_shm_table_offset() + sizeof(sdcr_shm_table));
+    shm_unlink(gOwner.name);
+    gOwner.segment = NULL;
+    gOwner.table = NULL;
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_shm_open(const char *name)
+{
+    if (name == NULL)
+        return SDCR_ERROR_NULL_PTR;
+    if (gClient.segment != NULL)
+        return SDCR_ERROR_INVALID_API_USAGE;
+
+    const sdcr_shm_table *table = NULL;
+    sdcr_shm_segment *segment = sdcr_shm_map(name, false, &table);
+    if (segment == NULL)
+        return SDCR_ERROR_SHARED_MEMORY;
+
+    const bool isInitialized = (atomic_load_explicit(&segment->magic, memory_order_acquire) == SDCR_SHM_MAGIC);
+    if (!isInitialized || segment->size != sdcr_shm_table_offset() + sizeof(sdcr_shm_table))
+    {
+        munmap(segment, sdcr_shm_table_offset());
+        munmap((void *)table, sizeof(sdcr_shm_table));
+        return SDCR_ERROR_SHARED_MEMORY;
+    }
+    gClient.segment = segment;
+    gClient.table = table;
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_shm_close()
+{
+    if (gClient.segment == NULL)
+        return SDCR_ERROR_INVALID_API_USAGE;
+
+    munmap(gClient.segment, sdcr_shm_table_offset());
+    munmap((void *)gClient.table, sizeof(sdcr_shm_table));
+    gClient.segment = NULL;
+    gClient.table = NULL;
+    return SDCR_SUCCESS;
+}
+
+sdcr_status sdcr_shm_routine_start_inf(const char *id)
+{
+    return sdcr_shm_send(SDCR_SHM_COMMAND_START_INF, id, 0);
+}
+
+sdcr_status sdcr_shm_routine_start_for_n_cycles(const char *id, uint16_t n)
+{
+    return sdcr_shm_send(SDCR_SHM_COMMAND_START_FOR_N_CYCLES, id, n);
+}
+
+sdcr_status sdcr_shm_routine_stop(const char *id)
+{
+    return sdcr_shm_send(SDCR_SHM_COMMAND_STOP, id, 0);
+}
+
+sdcr_status sdcr_shm_routine_get_state(const char *id, sdcr_routine_state *state)
+{
+    if (id == NULL || state == NULL)
+        return SDCR_ERROR_NULL_PTR;
+    if (gClient.segment == NULL)
+        return SDCR_ERROR_INVALID_API_USAGE;
+
+    sdcr_shm_status_data data;
+    if (!sdcr_shm_find_status(id, &data))
+        return SDCR_ERROR_ID_DOESNT_EXIST;
+
+    *state = (sdcr_routine_state){
+        .id = id,
+        .isEnable = data.isEnable,
+        .isInfinite = data.isInfinite,
+        .cyclesLeft = data.cyclesLeft,
+        .timestampLastAction = data.timestampLastAction,
+        .cursorPosition = data.cursorPosition,
+    };
+    return SDCR_SUCCESS;
+}
+
+//-----------------------------------------------
+// INTERNAL FUNCTIONS
+//-----------------------------------------------
+/* return: Where the status table starts in the segment: after the commands, on a page boundary. */
+static size_t sdcr_shm_table_offset()
+{
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    const size_t page = (pageSize > 0) ? (size_t)pageSize : 4096u;
+    return (sizeof(sdcr_shm_segment) + page - 1u) / page * page;
+}
+
+/* Will map the segment and its status table.
+ * The process running `sdcr_task` maps it all read-write. The others map the
+ * commands read-write, and the status table read-only: they can't damage it.
+ * param: table - where to write the status table address.
+ */
+static sdcr_shm_segment *sdcr_shm_map(const char *name, bool isCreating, const sdcr_shm_table **table)
+{
+    const int fd = shm_open(name, isCreating ? (O_RDWR | O_CREAT) : O_RDWR, 0660);
+    if (fd < 0)
+        return NULL;
+
+    const size_t offset = sdcr_shm_table_offset();
+    const size_t size = offset + sizeof(sdcr_shm_table);
+    bool isValid = true;
+    if (isCreating)
+    {
+        isValid = (ftruncate(fd, (off_t)size) == 0);
+    }
+    else
+    {
+        struct stat info;
+        isValid = (fstat(fd, &info) == 0 && (size_t)info.st_size == size);
+    }
+
+    void *address = MAP_FAILED;
+    void *tableAddress = MAP_FAILED;
+    if (isValid && isCreating)
+    {
+        address = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (address != MAP_FAILED)
+            tableAddress = (char *)address + offset;
+    }
+    else if (isValid)
+    {
+        address = mmap(NULL, offset, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        tableAddress = mmap(NULL, sizeof(sdcr_shm_table), PROT_READ, MAP_SHARED, fd, (off_t)offset);
+        if (address != MAP_FAILED && tableAddress == MAP_FAILED)
+        {
+            munmap(address, offset);
+            address = MAP_FAILED;
+        }
+        else if (address == MAP_FAILED && tableAddress != MAP_FAILED)
+        {
+            munmap(tableAddress, sizeof(sdcr_shm_table));
+        }
+    }
+    close(fd); //< the mapping stays valid
+
+    if (address == MAP_FAILED)
+        return NULL;
+    *table = (const sdcr_shm_table *)tableAddress;
+    return (sdcr_shm_segment *)address;
+}
+
+/* Will perform a command with the routine of the same ID.
+ * The library compares IDs by address: the ID is looked up by value.
+ */
+static void sdcr_shm_perform(const sdcr_shm_command *command, const sdcr_routine_state *states, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (strncmp(states[i].id, command->id, sizeof(command->id)) != 0)
+            continue;
+
+        switch (command->type)
+        {
+        case SDCR_SHM_COMMAND_START_INF:
+            sdcr_routine_start_inf(states[i].id);
+            break;
+        case SDCR_SHM_COMMAND_START_FOR_N_CYCLES:
+            sdcr_routine_start_for_n_cycles(states[i].id, command->cycles);
+            break;
+        case SDCR_SHM_COMMAND_STOP:
+            sdcr_routine_stop(states[i].id);
+            break;
+        default:
+            break;
+        }
+        return;
+    }
+}
+
+static void sdcr_shm_publish()
+{
+    sdcr_routine_state states[SDCR_MAX_NUMBER_OF_ROUTINE];
+    size_t count = 0;
+    sdcr_routine_get_state_all(states, ARRAY_LENGTH(states), &count);
+
+    size_t published = 0;
+    for (size_t i = 0; i < ARRAY_LENGTH(gOwner.table->statuses); i++)
+    {
+        // routines with an ID too long for the segment are not published
+        while (published < count && strlen(states[published].id) >= SDCR_SHM_ID_SIZE)
+        {
+            published++;
+        }
+
+        sdcr_shm_status_data data = {0};
+        if (published < count)
+        {
+            const sdcr_routine_state *state = &states[published++];
+            data.isUsed = true;
+            data.isEnable = state->isEnable;
+            data.isInfinite = state->isInfinite;
+            data.cyclesLeft = state->cyclesLeft;
+            data.timestampLastAction = state->timestampLastAction;
+            data.cursorPosition = state->cursorPosition;
+            strcpy(data.id, state->id);
+        }
+
+        sdcr_shm_status *status = &gOwner.table->statuses[i];
+        const unsigned sequence = atomic_load_explicit(&status->sequence, memory_order_relaxed);
+        atomic_store_explicit(&status->sequence, sequence + 1, memory_order_relaxed); //< odd: write in progress
+        atomic_thread_fence(memory_order_release);
+        status->data = data;
+        atomic_store_explicit(&status->sequence, sequence + 2, memory_order_release); //< even: status is stable
+    }
+}
+
+/* Read only while a command is late: it is a vDSO call, not a syscall, on Linux. */
+static uint32_t sdcr_shm_now_ms()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((uint64_t)now.tv_sec * 1000u + (uint64_t)now.tv_nsec / 1000000u);
+}
+
+static sdcr_status sdcr_shm_send(sdcr_shm_command_type type, const char *id, uint16_t cycles)
+{
+    if (id == NULL)
+        return SDCR_ERROR_NULL_PTR;
+    sdcr_shm_segment *segment = gClient.segment;
+    if (segment == NULL || strlen(id) >= SDCR_SHM_ID_SIZE)
+        return SDCR_ERROR_INVALID_API_USAGE;
+
+    sdcr_shm_status_data data;
+    if (!sdcr_shm_find_status(id, &data))
+        return SDCR_ERROR_ID_DOESNT_EXIST;
+
+    // claim a cell
+    sdcr_shm_command *command = NULL;
+    unsigned position = atomic_load_explicit(&segment->enqueuePosition, memory_order_relaxed);
+    while (command == NULL)
+    {
+        sdcr_shm_command *cell = &segment->commands[position & (SDCR_SHM_COMMAND_QUEUE_SIZE - 1)];
+        const unsigned sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        const int difference = (int)(sequence - position);
+        if (difference == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&segment->enqueuePosition, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                command = cell;
+            }
+        }
+        else if (difference < 0)
+        {
+            return SDCR_ERROR_COMMAND_QUEUE_IS_FULL; //< the cell wasn't consumed yet
+        }
+        else
+        {
+            position = atomic_load_explicit(&segment->enqueuePosition, memory_order_relaxed);
+        }
+    }
+
+    // reserve it, unless the consumer skipped the cell meanwhile, then write it and hand it
+    unsigned expected = position;
+    if (!atomic_compare_exchange_strong_explicit(&command->sequence, &expected, SDCR_SHM_WRITING(position),
+                                                 memory_order_acquire, memory_order_relaxed))
+        return SDCR_ERROR_COMMAND_QUEUE_IS_FULL;
+    command->type = (uint16_t)type;
+    command->cycles = cycles;
+    strcpy(command->id, id);
+    atomic_store_explicit(&command->sequence, position + 1, memory_order_release);
+    return SDCR_SUCCESS;
+}
+
+static bool sdcr_shm_find_status(const char *id, sdcr_shm_status_data *data)
+{
+    for (size_t i = 0; i < ARRAY_LENGTH(gClient.table->statuses); i++)
+    {
+        const sdcr_shm_status *status = &gClient.table->statuses[i];
+        unsigned sequenceBefore;
+        unsigned sequenceAfter;
+        do
+        {
+            sequenceBefore = atomic_load_explicit(&status->sequence, memory_order_acquire);
+            if (sequenceBefore & 1u)
+            {
+                sequenceAfter = sequenceBefore + 1; //< write in progress, try again
+                continue;
+            }
+            *data = status->data;
+            atomic_thread_fence(memory_order_acquire);
+            sequenceAfter = atomic_load_explicit(&status->sequence, memory_order_relaxed);
+        } while (sequenceBefore != sequenceAfter);
+
+        data->id[SDCR_SHM_ID_SIZE - 1] = '\0';
+        if (data->isUsed && strcmp(data->id, id) == 0)
+            return true;
+    }
+    return false;
+}
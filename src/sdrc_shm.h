@@ -0,0 +1,148 @@
+/*
+ * sdrc_shm.h
+ * String Defined Call Routine library - shared memory control plane
+ *
+ * Lets other local processes start and stop the routines of the process
+ * running `sdcr_task`, and read their state, through a POSIX shared memory
+ * segment. The segment holds a lock-free command queue and a routine
+ * status table: no syscall is made after the segment is mapped.
+ *
+ * The other processes map the status table read-only: they can send any
+ * command, but can't change the published states. A process which dies
+ * while sending a command only loses its command (see `SDCR_SHM_STUCK_MS`).
+ *
+ * USAGE:
+ *      // In the process running `sdcr_task`, create the segment
+ *      // and update it in the infinite loop.
+ *      sdcr_shm_create("/my-leds");
+ *      while (1)
+ *      {
+ *           sdcr_task(get_tick_count_ms);
+ *           sdcr_shm_update();
+ *      }
+ *
+ *      // In any other process, open the segment and send commands.
+ *      sdcr_shm_open("/my-leds");
+ *      sdcr_shm_routine_start_inf("red led");
+ *
+ *      sdcr_routine_state state;
+ *      sdcr_shm_routine_get_state("red led", &state);
+ *
+ * Copyright (c) 2019 G.Berthiaume, All rights reserved.
+ * BSD 3-Clause License
+ */
+#ifndef _SDCR_SHM_H_
+#define _SDCR_SHM_H_
+
+//-----------------------------------------------
+// INCLUDES
+//-----------------------------------------------
+#include <stdint.h>
+
+#include "sdrc.h"
+
+//-----------------------------------------------
+// USER CONFIG
+//-----------------------------------------------
+
+/* The number of commands that can wait for `sdcr_shm_update`.
+ * Must be a power of 2.
+ */
+#ifndef SDCR_SHM_COMMAND_QUEUE_SIZE
+#define SDCR_SHM_COMMAND_QUEUE_SIZE 64
+#endif
+
+/* The time, in ms, `sdcr_shm_update` waits for a command being sent.
+ * A process which dies while sending a command leaves its cell claimed:
+ * past this time, on the monotonic clock, the cell is skipped and the queue moves on.
+ * It doesn't depend on how often `sdcr_shm_update` is called.
+ * A process paused longer than that before reserving its cell loses its command.
+ * A reserved cell is waited for: the process only writes the command in it,
+ * so one dying in these few stores blocks the queue.
+ */
+#ifndef SDCR_SHM_STUCK_MS
+#define SDCR_SHM_STUCK_MS 100
+#endif
+
+/* The maximal size of a routine ID in the segment, with its NUL.
+ * Routines with a longer ID can't be controlled by other processes.
+ */
+#ifndef SDCR_SHM_ID_SIZE
+#define SDCR_SHM_ID_SIZE 32
+#endif
+
+//-----------------------------------------------
+// API - Process running `sdcr_task`
+//-----------------------------------------------
+
+/* Will create the shared memory segment and map it.
+ * note: A segment left by a previous process with the same name is reused.
+ * param: name - the segment name. Ex: "/my-leds". See `shm_open`.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_shm_create(const char *name);
+
+/* Will perform the commands sent by the other processes,
+ * then publish the state of every routine in the segment.
+ * note: Should be called periodically, in the same thread as `sdcr_task`.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_shm_update();
+
+/* Will unmap the shared memory segment and remove its name.
+ * note: Processes which opened the segment keep their mapping.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_shm_destroy();
+
+//-----------------------------------------------
+// API - Other processes
+//-----------------------------------------------
+
+/* Will map an existing shared memory segment.
+ * param: name - the segment name, as given to `sdcr_shm_create`.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_shm_open(const char *name);
+
+/* Will unmap the shared memory segment.
+ * note: This function complementaty to `sdcr_shm_open`.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_shm_close();
+
+/* Will send a command to start a routine that will cycle infinitely.
+ * note: Commands are lock-free and can be sent by many processes, or threads,
+ *       at the same time. They are performed by the next `sdcr_shm_update`.
+ * note: The routine must be published by `sdcr_shm_update` first.
+ * param: The routine id, a string compared by value.
+ * return: A sdcr status. 0 is success. `SDCR_ERROR_COMMAND_QUEUE_IS_FULL`
+ *         if the queue is full, or the command was skipped (see `SDCR_SHM_STUCK_MS`).
+ */
+sdcr_status sdcr_shm_routine_start_inf(const char *id);
+
+/* Will send a command to start a routine for a specific number of cycle.
+ * note: See `sdcr_shm_routine_start_inf`.
+ * param: The routine id, a string compared by value.
+ * param: The number of cycle.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_shm_routine_start_for_n_cycles(const char *id, uint16_t n);
+
+/* Will send a command to stop a routine.
+ * note: See `sdcr_shm_routine_start_inf`.
+ * param: The routine id, a string compared by value.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_shm_routine_stop(const char *id);
+
+/* Will copy the state of a routine, as published by the last `sdcr_shm_update`.
+ * note: This function is lock-free. If the state is published during
+ *       the copy, the copy is retried.
+ * param: The routine id, a string compared by value. It is the `id` of the copy.
+ * param: state - where to copy the routine state.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_shm_routine_get_state(const char *id, sdcr_routine_state *state);
+
+#endif // _SDCR_SHM_H_
@@ -0,0 +1,186 @@
+/* 
+ * srdc_trace.c
+ * String Defined Call Routine library - trace exporter
+ * 
+ * Copyright (c) 2019 G.Berthiaume , All rights reserved.
+ * BSD 3-Clause License (Revised)
+ */
+
+//-----------------------------------------------
+// INCLUDES
+//-----------------------------------------------
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "sdrc_trace.h"
+
+//-----------------------------------------------
+// DEFINITION
+//-----------------------------------------------
+typedef struct
+{
+    sdcr_trace_write_function write;
+    void *context;
+    double usPerTick;
+    bool isFirstEvent;
+    const char *threadIDs[SDCR_MAX_NUMBER_OF_ROUTINE * 2]; //< Chrome thread id is the index + 1.
+} sdcr_trace_exporter;
+
+//-----------------------------------------------
+// MACROS
+//-----------------------------------------------
+#define ARRAY_LENGTH(arr) (sizeof(arr) / sizeof((arr)[0])) //< Wont work with ptr.
+#define SDCR_TRACE_READ_CHUNK 32
+
+//-----------------------------------------------
+// INTERNAL PROTOTYPES
+//-----------------------------------------------
+static void sdcr_trace_write_text(sdcr_trace_exporter *exporter, const char *text);
+static void sdcr_trace_write_string(sdcr_trace_exporter *exporter, const char *text);
+static size_t sdcr_trace_get_thread(sdcr_trace_exporter *exporter, const char *id);
+static void sdcr_trace_write_event(sdcr_trace_exporter *exporter, const sdcr_trace_event *event);
+
+//-----------------------------------------------
+// API FUNCTIONS
+//-----------------------------------------------
+sdcr_status sdcr_trace_export_chrome(sdcr_trace_write_function write, void *context, double usPerTick)
+{
+    if (write == NULL)
+        return SDCR_ERROR_NULL_PTR;
+    if (usPerTick <= 0.0)
+        return SDCR_ERROR_INVALID_API_USAGE;
+
+    sdcr_trace_exporter exporter = {
+        .write = write,
+        .context = context,
+        .usPerTick = usPerTick,
+        .isFirstEvent = true,
+    };
+    sdcr_trace_write_text(&exporter, "{\"traceEvents\":[");
+
+    sdcr_trace_event events[SDCR_TRACE_READ_CHUNK];
+    size_t count = 0;
+    do
+    {
+        const sdcr_status res = sdcr_trace_read(events, ARRAY_LENGTH(events), &count, NULL);
+        if (res != SDCR_SUCCESS)
+            return res;
+        for (size_t i = 0; i < count; i++)
+        {
+            sdcr_trace_write_event(&exporter, &events[i]);
+        }
+    } while (count == ARRAY_LENGTH(events));
+
+    sdcr_trace_write_text(&exporter, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    return SDCR_SUCCESS;
+}
+
+//-----------------------------------------------
+// INTERNAL FUNCTIONS
+//-----------------------------------------------
+static void sdcr_trace_write_text(sdcr_trace_exporter *exporter, const char *text)
+{
+    size_t length = 0;
+    while (text[length] != '\0')
+    {
+        length++;
+    }
+    exporter->write(exporter->context, text, length);
+}
+
+/* Will write a JSON string, with its quotes. */
+static void sdcr_trace_write_string(sdcr_trace_exporter *exporter, const char *text)
+{
+    char escaped[8];
+    sdcr_trace_write_text(exporter, "\"");
+    for (const char *c = (text != NULL) ? text : "?"; *c != '\0'; c++)
+    {
+        const unsigned char unit = (unsigned char)*c;
+        if (unit == '"' || unit == '\\')
+            snprintf(escaped, sizeof(escaped), "\\%c", unit);
+        else if (unit < 0x20)
+            snprintf(escaped, sizeof(escaped), "\\u%04x", unit);
+        else
+            snprintf(escaped, sizeof(escaped), "%c", unit);
+        sdcr_trace_write_text(exporter, escaped);
+    }
+    sdcr_trace_write_text(exporter, "\"");
+}
+
+/* Will give the Chrome thread id of a routine.
+ * The thread is named after the routine ID the first time it is seen.
+ */
+static size_t sdcr_trace_get_thread(sdcr_trace_exporter *exporter, const char *id)
+{
+    for (size_t i = 0; i < ARRAY_LENGTH(exporter->threadIDs); i++)
+    {
+        if (exporter->threadIDs[i] == id)
+            return i + 1;
+        if (exporter->threadIDs[i] == NULL)
+        {
+            char text[96];
+            exporter->threadIDs[i] = id;
+            snprintf(text, sizeof(text),
+                     "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":",
+                     exporter->isFirstEvent ? "" : ",",
+                     i + 1);
+            exporter->isFirstEvent = false;
+            sdcr_trace_write_text(exporter, text);
+            sdcr_trace_write_string(exporter, id);
+            sdcr_trace_write_text(exporter, "}}");
+            return i + 1;
+        }
+    }
+    return 0; //< Too many routines: they share the thread 0.
+}
+
+static void sdcr_trace_write_event(sdcr_trace_exporter *exporter, const sdcr_trace_event *event)
+{
+    static const char *const names[] = {
+        [SDCR_TRACE_STEP] = "step",
+        [SDCR_TRACE_CALLBACK_BEGIN] = "callback",
+        [SDCR_TRACE_CALLBACK_END] = "callback",
+        [SDCR_TRACE_START] = "start",
+        [SDCR_TRACE_STOP] = "stop",
+        [SDCR_TRACE_CYCLE_WRAP] = "cycle wrap",
+        [SDCR_TRACE_DEADLINE_MISSED] = "deadline missed",
+    };
+    static const char *const argNames[] = {
+        [SDCR_TRACE_STEP] = "lateness",
+        [SDCR_TRACE_CALLBACK_BEGIN] = NULL,
+        [SDCR_TRACE_CALLBACK_END] = NULL,
+        [SDCR_TRACE_START] = "cycles",
+        [SDCR_TRACE_STOP] = NULL,
+        [SDCR_TRACE_CYCLE_WRAP] = "cycles left",
+        [SDCR_TRACE_DEADLINE_MISSED] = "lateness",
+    };
+    if (event->type >= ARRAY_LENGTH(names))
+        return;
+
+    const size_t thread = sdcr_trace_get_thread(exporter, event->id);
+    const char *phase = "i";
+    if (event->type == SDCR_TRACE_CALLBACK_BEGIN)
+        phase = "B";
+    else if (event->type == SDCR_TRACE_CALLBACK_END)
+        phase = "E";
+
+    char text[192];
+    int length = snprintf(text, sizeof(text),
+                          "%s\n{\"name\":\"%s\",\"ph\":\"%s\",%s\"ts\":%.3f,\"pid\":1,\"tid\":%zu",
+                          exporter->isFirstEvent ? "" : ",",
+                          names[event->type],
+                          phase,
+                          (phase[0] == 'i') ? "\"s\":\"t\"," : "",
+                          (double)event->timestamp * exporter->usPerTick,
+                          thread);
+    if (argNames[event->type] != NULL && length > 0 && (size_t)length < sizeof(text))
+    {
+        snprintf(&text[length], sizeof(text) - (size_t)length,
+                 ",\"args\":{\"%s\":%u}",
+                 argNames[event->type],
+                 (unsigned)event->arg);
+    }
+    exporter->isFirstEvent = false;
+    sdcr_trace_write_text(exporter, text);
+    sdcr_trace_write_text(exporter, "}");
+}
@@ -0,0 +1,59 @@
+/* 
+ * sdrc_trace.h
+ * String Defined Call Routine library - trace exporter
+ * 
+ * USAGE:
+ *      // Build the library with `SDCR_ENABLE_TRACE` defined.
+ *      // Start recording, with a µs clock for example.
+ *      sdcr_trace_enable(get_tick_count_us);
+ *
+ *      // ... run `sdcr_task` ...
+ *
+ *      // Export the recorded events in the Chrome trace JSON format.
+ *      // Open the file in `chrome://tracing` or `ui.perfetto.dev`.
+ *      sdcr_trace_export_chrome(write_to_file, file, 1.0);
+ * 
+ * Copyright (c) 2019 G.Berthiaume, All rights reserved.
+ * BSD 3-Clause License
+ */
+#ifndef _SDCR_TRACE_H_
+#define _SDCR_TRACE_H_
+
+//-----------------------------------------------
+// INCLUDES
+//-----------------------------------------------
+#include <stddef.h>
+
+#include "sdrc.h"
+
+#ifdef SDCR_ENABLE_TRACE
+
+//-----------------------------------------------
+// DEFINITIONS
+//-----------------------------------------------
+
+/* User defined callback function to write the exported trace.
+ * param: context - the user context given to the exporter.
+ * param: text - the text to write. Not NUL-terminated.
+ * param: length - the number of char in `text`.
+ */
+typedef void (*sdcr_trace_write_function)(void *context, const char *text, size_t length);
+
+//-----------------------------------------------
+// API
+//-----------------------------------------------
+
+/* Will move the recorded events out of the ring buffer and write them
+ * in the Chrome trace JSON format (also opened by Perfetto).
+ * Each routine is shown as a thread: callbacks are slices, the other
+ * events are instants.
+ * param: write - function_ptr to a function that write the text.
+ * param: context - a user context given to `write`.
+ * param: usPerTick - the duration of a trace clock tick in µs.
+ *                    Ex: 1000.0 for a ms clock.
+ * return: A sdcr status. 0 is success.
+ */
+sdcr_status sdcr_trace_export_chrome(sdcr_trace_write_function write, void *context, double usPerTick);
+
+#endif // SDCR_ENABLE_TRACE
+#endif // _SDCR_TRACE_H_
@@ -0,0 +1,1025 @@
+/*
+ * differential testing SDCR scheduling engines
+ * Runs random scenarios of routines through each scheduling engine, and
+ * checks every pass against a reference implementation: an interpreter of
+ * the expanded routines, which checks every routine at every pass. The
+ * callbacks and completions of each pass must also be called in the same
+ * order as the reference: the order of both is hashed and compared.
+ * Then prints the throughput of each engine.
+ *
+ * A scenario creates up to 8 routines: plain routines of up to 8 steps,
+ * compact routines (counts, step times, nested repeated groups) of up to 64
+ * steps, and stream routines. It starts them (for ever, for n cycles, at a
+ * time, many at once), stops them (a stop then a start is a pause: the
+ * routine resumes from its phase), gives them a slack, chains them, and
+ * clears them, one by one or many at once.
+ * Its time moves by 0 to 3 ms per pass, jumps, goes back sometimes, and
+ * crosses the tick wrap around sometimes.
+ *
+ * USAGE:
+ *      ./difftest_engines [--scenarios N] [--ticks T] [--seed S] [--bench-ticks B]
+ */
+#define _POSIX_C_SOURCE 200809L //< clock_gettime
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/sdrc.h"        //< library to test
+#include "../src/sdrc_engine.h" //< library to test
+
+//-----------------------------------------------
+// DEFINITIONS
+//-----------------------------------------------
+#define DIFF_MAX_ROUTINES 8
+#define DIFF_MAX_LENGTH 32 //< chars of a routine string
+#define DIFF_MAX_STEPS 64  //< steps of an expanded routine
+#define DIFF_MAX_STREAM_EVENTS 20
+#define DIFF_BENCH_MAX_ROUTINES 1024
+
+typedef struct
+{
+    size_t scenarios;    //< Number of scenarios, for each engine.
+    size_t ticks;        //< Number of passes of each scenario.
+    uint64_t seed;       //< Seed of the first scenario.
+    uint32_t benchTicks; //< Number of passes of each throughput run, 1 ms apart.
+} diff_config;
+
+/* Reference step: a char of the expanded routine string. */
+typedef struct
+{
+    uint32_t holdMs;
+    bool isCall;
+} diff_step;
+
+/* Reference routine.
+ * The original interpreter, on the expanded routine: a cursor in its steps.
+ */
+typedef struct
+{
+    bool isUsed;
+    bool isStream;
+    diff_step steps[DIFF_MAX_STEPS];
+    size_t stepCount;
+    size_t cursor;
+    uint32_t routineStepTimeMs;
+    bool isEnable;
+    bool isInfinite;
+    int32_t cyclesLeft;
+    uint32_t timestampLastAction;
+    uint32_t holdMs;            //< The time to wait since the last step.
+    uint32_t slackMs;
+    bool hasOnComplete;
+    size_t chainNext;           //< The chained routine + 1, 0 if none.
+    uint16_t chainCycles;
+    uint32_t chainOffsetMs;
+    size_t slot; //< Where the library stores it: the first free slot. The routines are checked in this order.
+} diff_reference;
+
+/* Stream source: random events, a random part of the capacity at a time. */
+typedef struct
+{
+    uint64_t random;
+    uint32_t eventsLeft;
+} diff_stream;
+
+/* Routine string being generated. */
+typedef struct
+{
+    char *text;
+    size_t length;
+    bool isFull;
+} diff_text;
+
+/* The first operation whose status differs from the reference. */
+typedef struct
+{
+    const char *operation;
+    sdcr_status status;
+    sdcr_status expected;
+} diff_failure;
+
+//-----------------------------------------------
+// GLOBAL VARIABLES
+//-----------------------------------------------
+static diff_config gConfig = {
+    .scenarios = 100000,
+    .ticks = 200,
+    .seed = 1,
+    .benchTicks = 20000,
+};
+static const char *const gIds[DIFF_MAX_ROUTINES] = {"r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7"};
+static char gPatterns[DIFF_MAX_ROUTINES][DIFF_MAX_LENGTH + 1];
+static diff_stream gStreams[DIFF_MAX_ROUTINES];
+static diff_reference gReference[DIFF_MAX_ROUTINES];
+static diff_failure gFailure;
+static uint32_t gCalls[DIFF_MAX_ROUTINES];          //< Library callbacks in the current pass.
+static uint32_t gReferenceCalls[DIFF_MAX_ROUTINES]; //< Reference callbacks in the current pass.
+static uint32_t gOrderHash;                         //< Hash of the library callbacks order in the current pass.
+static uint32_t gReferenceOrderHash;                //< Hash of the reference callbacks order in the current pass.
+static char gBenchIds[DIFF_BENCH_MAX_ROUTINES][24];
+static uint32_t gBenchCalls;
+
+//-----------------------------------------------
+// prototype
+//-----------------------------------------------
+static void diff_on_callback(size_t index);
+static void reference_perform_step(size_t i, uint32_t now, uint32_t elapsed);
+static void diff_write_sequence(diff_text *text, uint64_t *random, unsigned depth);
+static void diff_write(diff_text *text, const char *format, uint32_t value);
+static uint64_t diff_random(uint64_t *state);
+static uint32_t diff_random_below(uint64_t *state, uint32_t bound);
+static uint32_t diff_hash(uint32_t hash, uint32_t value);
+static uint64_t get_time_ns();
+
+//-----------------------------------------------
+// CALLBACKS
+// Callbacks don't have a context: generate one per routine.
+//-----------------------------------------------
+#define DIFF_ALL(M) M(0) M(1) M(2) M(3) M(4) M(5) M(6) M(7)
+#define DIFF_CALLBACK(i) \
+    static void diff_callback_##i(void) { diff_on_callback(i); }
+#define DIFF_CALLBACK_PTR(i) diff_callback_##i,
+
+DIFF_ALL(DIFF_CALLBACK)
+static const sdcr_callback_function gCallbacks[DIFF_MAX_ROUTINES] = {DIFF_ALL(DIFF_CALLBACK_PTR)};
+
+static void diff_callback_bench(void)
+{
+    gBenchCalls++;
+}
+
+/* A completion is hashed after the callbacks values. */
+static void diff_on_complete(const char *id)
+{
+    for (size_t i = 0; i < DIFF_MAX_ROUTINES; i++)
+    {
+        if (id == gIds[i])
+            gOrderHash = diff_hash(gOrderHash, (uint32_t)(DIFF_MAX_ROUTINES + i));
+    }
+}
+
+static size_t diff_stream_source(void *context, sdcr_stream_event *events, size_t capacity)
+{
+    diff_stream *stream = context;
+    const size_t wanted = 1u + diff_random_below(&stream->random, (uint32_t)capacity);
+    size_t count = 0;
+    while (count < wanted && stream->eventsLeft > 0)
+    {
+        events[count] = (sdcr_stream_event){
+            .holdMs = diff_random_below(&stream->random, 4),         //< 0 for the step time
+            .steps = (uint16_t)diff_random_below(&stream->random, 3), //< 0 counts as 1
+            .isCall = (diff_random_below(&stream->random, 2) == 0),
+        };
+        count++;
+        stream->eventsLeft--;
+    }
+    return count;
+}
+
+//-----------------------------------------------
+// REFERENCE
+// The original `sdcr_task`, with the tick given, on expanded routines.
+//-----------------------------------------------
+static bool reference_append(diff_reference *routine, uint32_t holdMs, bool isCall)
+{
+    if (routine->stepCount == DIFF_MAX_STEPS)
+        return false;
+    routine->steps[routine->stepCount++] = (diff_step){.holdMs = holdMs, .isCall = isCall};
+    return true;
+}
+
+/* Will read the suffixes of an item: a count ("{n}" or "*n") and a step time ("@ms"). */
+static void reference_expand_suffixes(const char **input, uint32_t *count, uint32_t *holdMs)
+{
+    for (;;)
+    {
+        while (**input == ' ')
+        {
+            (*input)++;
+        }
+        const char suffix = **input;
+        if (suffix != '{' && suffix != '*' && suffix != '@')
+            return;
+        char *end;
+        const uint32_t value = (uint32_t)strtoul(*input + 1, &end, 10);
+        *input = (suffix == '{') ? end + 1 : end;
+        if (suffix == '@')
+            *holdMs = value;
+        else
+            *count = value;
+    }
+}
+
+/* Will expand a routine string in its steps: "(C.@5){2}" is "C", ".@5", "C", ".@5".
+ * return: false if the routine has more than `DIFF_MAX_STEPS` steps.
+ */
+static bool reference_expand_sequence(const char **input, uint32_t stepTimeMs, diff_reference *routine)
+{
+    while (**input != '\0' && **input != ')')
+    {
+        const char unit = *(*input)++;
+        uint32_t count = 1;
+        uint32_t holdMs = stepTimeMs;
+        if (unit == ' ')
+            continue;
+        if (unit == '(')
+        {
+            const size_t begin = routine->stepCount;
+            if (!reference_expand_sequence(input, stepTimeMs, routine))
+                return false;
+            (*input)++; //< ')'
+            reference_expand_suffixes(input, &count, &holdMs);
+            const size_t end = routine->stepCount;
+            for (uint32_t copy = 1; copy < count; copy++)
+            {
+                for (size_t step = begin; step < end; step++)
+                {
+                    if (!reference_append(routine, routine->steps[step].holdMs, routine->steps[step].isCall))
+                        return false;
+                }
+            }
+            continue;
+        }
+        reference_expand_suffixes(input, &count, &holdMs);
+        if (unit == '.')
+        {
+            if (!reference_append(routine, holdMs * count, false)) //< a counted wait is a single step
+                return false;
+            continue;
+        }
+        for (uint32_t step = 0; step < count; step++)
+        {
+            if (!reference_append(routine, holdMs, true))
+                return false;
+        }
+    }
+    return true;
+}
+
+static bool reference_get_action(diff_reference *routine)
+{
+    const bool routineNeedToLoop = (routine->cursor == routine->stepCount);
+    if (routineNeedToLoop)
+    {
+        routine->cursor = 0; //< return to the begining
+        if (!routine->isInfinite)
+        {
+            routine->cyclesLeft--;
+
+            const bool isThisTheLastCycle = (routine->cyclesLeft <= 1);
+            if (isThisTheLastCycle)
+            {
+                routine->isEnable = false;
+            }
+        }
+    }
+    const diff_step *step = &routine->steps[routine->cursor];
+    routine->cursor++; //< Advance the cursor
+    routine->holdMs = step->holdMs;
+    if (routine->isStream && routine->cursor == routine->stepCount)
+        routine->isEnable = false; //< a stream plays once
+    return step->isCall;
+}
+
+/* A step performed within the slack keeps the routine timeline:
+ * the next step is due one hold after the deadline of this one.
+ */
+static void reference_keep_deadline(diff_reference *routine, uint32_t deadlineMs, uint32_t elapsed)
+{
+    if (elapsed < deadlineMs && deadlineMs - elapsed <= routine->slackMs)
+    {
+        routine->holdMs += deadlineMs - elapsed;
+    }
+    else if (elapsed >= deadlineMs && elapsed - deadlineMs <= routine->slackMs)
+    {
+        const uint32_t lateness = elapsed - deadlineMs;
+        if (routine->holdMs < lateness)
+        {
+            routine->timestampLastAction -= lateness - routine->holdMs;
+            routine->holdMs = 0;
+        }
+        else
+        {
+            routine->holdMs -= lateness;
+        }
+    }
+}
+
+static void reference_complete(size_t i, uint32_t now)
+{
+    const diff_reference *routine = &gReference[i];
+    if (routine->hasOnComplete)
+        gReferenceOrderHash = diff_hash(gReferenceOrderHash, (uint32_t)(DIFF_MAX_ROUTINES + i));
+    if (routine->chainNext == 0)
+        return;
+
+    const size_t nextIndex = routine->chainNext - 1u;
+    diff_reference *next = &gReference[nextIndex];
+    next->isEnable = true;
+    next->isInfinite = (routine->chainCycles == 0);
+    next->cyclesLeft = routine->chainCycles;
+    next->cursor = 0;
+    next->timestampLastAction = now;
+    next->holdMs = routine->chainOffsetMs;
+    if (next->holdMs == 0)
+        reference_perform_step(nextIndex, now, 0);
+}
+
+static void reference_perform_step(size_t i, uint32_t now, uint32_t elapsed)
+{
+    diff_reference *routine = &gReference[i];
+    const uint32_t deadlineMs = routine->holdMs;
+    const bool isCall = reference_get_action(routine);
+    routine->timestampLastAction = now;
+    if (routine->slackMs != 0)
+        reference_keep_deadline(routine, deadlineMs, elapsed);
+    if (isCall)
+    {
+        gReferenceCalls[i]++;
+        gReferenceOrderHash = diff_hash(gReferenceOrderHash, (uint32_t)i);
+    }
+    if (!routine->isEnable)
+        reference_complete(i, now); //< the last cycle started
+}
+
+static void reference_task(uint32_t now)
+{
+    size_t order[DIFF_MAX_ROUTINES] = {0};
+    for (size_t i = 0; i < DIFF_MAX_ROUTINES; i++)
+    {
+        if (gReference[i].isUsed)
+            order[gReference[i].slot] = i + 1u;
+    }
+    bool isAwake = false;
+    for (size_t slot = 0; slot < DIFF_MAX_ROUTINES; slot++)
+    {
+        if (order[slot] == 0)
+            continue;
+        const size_t i = order[slot] - 1u;
+        const diff_reference *routine = &gReference[i];
+        const uint32_t elapsed = now - routine->timestampLastAction;
+        if (routine->isEnable && elapsed >= routine->holdMs)
+        {
+            reference_perform_step(i, now, elapsed);
+            isAwake = true;
+        }
+    }
+
+    // Something woke us up: perform the steps due soon, within their slack.
+    for (size_t slot = 0; slot < DIFF_MAX_ROUTINES && isAwake; slot++)
+    {
+        if (order[slot] == 0)
+            continue;
+        const size_t i = order[slot] - 1u;
+        const diff_reference *routine = &gReference[i];
+        const uint32_t elapsed = now - routine->timestampLastAction;
+        const bool isWithinSlack = (routine->isEnable && routine->slackMs != 0 &&
+                                    routine->timestampLastAction != now &&
+                                    elapsed < routine->holdMs && routine->holdMs - elapsed <= routine->slackMs);
+        if (isWithinSlack)
+            reference_perform_step(i, now, elapsed);
+    }
+}
+
+static size_t reference_free_slot()
+{
+    bool isFree[DIFF_MAX_ROUTINES];
+    memset(isFree, true, sizeof(isFree));
+    for (size_t other = 0; other < DIFF_MAX_ROUTINES; other++)
+    {
+        if (gReference[other].isUsed)
+            isFree[gReference[other].slot] = false;
+    }
+    size_t slot = 0;
+    while (!isFree[slot])
+    {
+        slot++;
+    }
+    return slot;
+}
+
+/* Will create the reference of a routine, from its string in `gPatterns`.
+ * return: false if the routine has more than `DIFF_MAX_STEPS` steps.
+ */
+static bool reference_new(size_t i, uint32_t stepTimeMs)
+{
+    diff_reference routine = {
+        .isUsed = true,
+        .routineStepTimeMs = stepTimeMs,
+        .holdMs = stepTimeMs,
+        .slot = reference_free_slot(),
+    };
+    const char *input = gPatterns[i];
+    if (!reference_expand_sequence(&input, stepTimeMs, &routine))
+        return false;
+    gReference[i] = routine;
+    return true;
+}
+
+/* Will create the reference of a stream routine: its source played once, from a copy. */
+static void reference_new_stream(size_t i, uint32_t stepTimeMs)
+{
+    diff_reference *routine = &gReference[i];
+    *routine = (diff_reference){
+        .isUsed = true,
+        .isStream = true,
+        .routineStepTimeMs = stepTimeMs,
+        .holdMs = stepTimeMs,
+        .slot = reference_free_slot(),
+    };
+    diff_stream source = gStreams[i];
+    sdcr_stream_event events[SDCR_STREAM_CHUNK_SIZE];
+    size_t count;
+    while ((count = diff_stream_source(&source, events, SDCR_STREAM_CHUNK_SIZE)) != 0)
+    {
+        for (size_t event = 0; event < count; event++)
+        {
+            const uint32_t holdMs = (events[event].holdMs != 0) ? events[event].holdMs : stepTimeMs;
+            const uint16_t steps = (events[event].steps != 0) ? events[event].steps : 1u;
+            for (uint16_t step = 0; step < steps; step++)
+            {
+                reference_append(routine, holdMs, events[event].isCall);
+            }
+        }
+    }
+}
+
+static void reference_clear(size_t i)
+{
+    gReference[i] = (diff_reference){0};
+    for (size_t other = 0; other < DIFF_MAX_ROUTINES; other++)
+    {
+        if (gReference[other].chainNext == i + 1u)
+            gReference[other].chainNext = 0; //< unchained
+    }
+}
+
+/* return: the status of a start, and the routine can be started. */
+static sdcr_status reference_can_start(size_t i, bool isFromBeginning)
+{
+    const diff_reference *routine = &gReference[i];
+    if (!routine->isUsed)
+        return SDCR_ERROR_ID_DOESNT_EXIST;
+    // a stream can't rewind, and can't start again once played
+    if (routine->isStream && (isFromBeginning || routine->cursor == routine->stepCount))
+        return SDCR_ERROR_INVALID_API_USAGE;
+    return SDCR_SUCCESS;
+}
+
+static void reference_start(size_t i, uint16_t n, const uint32_t *startMs)
+{
+    diff_reference *routine = &gReference[i];
+    routine->isEnable = true;
+    routine->isInfinite = (n == 0);
+    routine->cyclesLeft = n;
+    if (startMs != NULL)
+    {
+        routine->cursor = 0;
+        routine->timestampLastAction = *startMs;
+        routine->holdMs = routine->routineStepTimeMs;
+    }
+}
+
+//-----------------------------------------------
+// DIFFERENTIAL
+//-----------------------------------------------
+static bool diff_check_pass(const sdcr_engine *engine, size_t scenario, size_t tick)
+{
+    for (size_t i = 0; i < DIFF_MAX_ROUTINES; i++)
+    {
+        const diff_reference *expected = &gReference[i];
+        bool isSame = (gCalls[i] == gReferenceCalls[i]);
+        if (expected->isUsed)
+        {
+            sdcr_routine_state state;
+            isSame = isSame && sdcr_routine_get_state(gIds[i], &state) == SDCR_SUCCESS &&
+                     state.isEnable == expected->isEnable &&
+                     state.isInfinite == expected->isInfinite &&
+                     (state.isInfinite || state.cyclesLeft == expected->cyclesLeft) && //< only meaningful for n cycles
+                     state.timestampLastAction == expected->timestampLastAction &&
+                     (expected->isStream || state.cursorPosition == expected->cursor); //< a stream counts its pulled chunks
+        }
+        if (!isSame)
+        {
+            printf("error, engine %s, scenario %zu, pass %zu: routine \"%s\" (%s) differs from the reference\n",
+                   engine->name, scenario, tick, gIds[i], expected->isStream ? "stream" : gPatterns[i]);
+            return false;
+        }
+        gCalls[i] = 0;
+        gReferenceCalls[i] = 0;
+    }
+    if (gOrderHash != gReferenceOrderHash)
+    {
+        printf("error, engine %s, scenario %zu, pass %zu: the callbacks order differs from the reference\n",
+               engine->name, scenario, tick);
+        return false;
+    }
+    return true;
+}
+
+/* return: false if the library status differs from the reference one. */
+static bool diff_expect(const char *operation, sdcr_status status, sdcr_status expected)
+{
+    if (status == expected)
+        return true;
+    if (gFailure.operation == NULL)
+        gFailure = (diff_failure){.operation = operation, .status = status, .expected = expected};
+    return false;
+}
+
+/* Will generate a routine string in `gPatterns`, and its reference.
+ * Half are plain, half use the compact syntax.
+ */
+static void diff_generate(uint64_t *random, size_t i, uint32_t stepTimeMs)
+{
+    if (diff_random_below(random, 2) == 0)
+    {
+        const size_t length = 1u + diff_random_below(random, 8);
+        for (size_t step = 0; step < length; step++)
+        {
+            gPatterns[i][step] = ".Cc"[diff_random_below(random, 3)];
+        }
+        gPatterns[i][length] = '\0';
+        reference_new(i, stepTimeMs);
+        return;
+    }
+    for (;;)
+    {
+        diff_text text = {.text = gPatterns[i]};
+        diff_write_sequence(&text, random, 0);
+        if (!text.isFull && reference_new(i, stepTimeMs))
+            return;
+    }
+}
+
+static bool diff_apply_new(uint64_t *random, size_t i)
+{
+    const uint32_t stepTimeMs = 1u + diff_random_below(random, 4);
+    if (diff_random_below(random, 6) != 0)
+    {
+        diff_generate(random, i, stepTimeMs);
+        const sdcr_status status = sdcr_routine_new(.id = gIds[i],
+                                                    .routine = gPatterns[i],
+                                                    .callbackFunction = gCallbacks[i],
+                                                    .routineStepTimeMs = stepTimeMs);
+        return diff_expect("new", status, SDCR_SUCCESS);
+    }
+
+    size_t streams = 0;
+    for (size_t other = 0; other < DIFF_MAX_ROUTINES; other++)
+    {
+        streams += (gReference[other].isUsed && gReference[other].isStream);
+    }
+    gStreams[i] = (diff_stream){
+        .random = diff_random(random),
+        .eventsLeft = 1u + diff_random_below(random, DIFF_MAX_STREAM_EVENTS),
+    };
+    sdcr_status expected = SDCR_ERROR_ROUTINE_MEMORY_IS_FULL;
+    if (streams < SDCR_MAX_NUMBER_OF_STREAM)
+    {
+        reference_new_stream(i, stepTimeMs);
+        expected = SDCR_SUCCESS;
+    }
+    const sdcr_status status = sdcr_routine_new_stream(.id = gIds[i],
+                                                       .source = diff_stream_source,
+                                                       .context = &gStreams[i],
+                                                       .callbackFunction = gCallbacks[i],
+                                                       .routineStepTimeMs = stepTimeMs);
+    return diff_expect("new stream", status, expected);
+}
+
+static bool diff_apply(uint64_t *random, size_t i, uint32_t now)
+{
+    diff_reference *expected = &gReference[i];
+    const uint32_t operation = diff_random_below(random, 16);
+    if (!expected->isUsed)
+        return (operation >= 6) || diff_apply_new(random, i);
+
+    switch (operation)
+    {
+    case 0:
+        reference_clear(i);
+        return diff_expect("clear", sdcr_routine_clear(gIds[i]), SDCR_SUCCESS);
+    case 1:
+    case 2:
+    {
+        const sdcr_status status = reference_can_start(i, false);
+        if (status == SDCR_SUCCESS)
+            reference_start(i, 0, NULL);
+        return diff_expect("start_inf", sdcr_routine_start_inf(gIds[i]), status);
+    }
+    case 3:
+    case 4:
+    {
+        const uint16_t n = (uint16_t)(1u + diff_random_below(random, 3));
+        const sdcr_status status = reference_can_start(i, false);
+        if (status == SDCR_SUCCESS)
+            reference_start(i, n, NULL);
+        return diff_expect("start_for_n_cycles", sdcr_routine_start_for_n_cycles(gIds[i], n), status);
+    }
+    case 5:
+    case 6:
+        expected->isEnable = false;
+        return diff_expect("stop", sdcr_routine_stop(gIds[i]), SDCR_SUCCESS);
+    case 7:
+    case 8:
+    {
+        const uint16_t n = (uint16_t)diff_random_below(random, 4);
+        const uint32_t startMs = now - diff_random_below(random, 5);
+        const sdcr_status status = reference_can_start(i, true);
+        if (status == SDCR_SUCCESS)
+            reference_start(i, n, &startMs);
+        return diff_expect("start_at", sdcr_routine_start_at(gIds[i], n, startMs), status);
+    }
+    case 9:
+        expected->slackMs = diff_random_below(random, 4);
+        return diff_expect("set_slack", sdcr_routine_set_slack(gIds[i], expected->slackMs), SDCR_SUCCESS);
+    case 10:
+    {
+        const size_t next = diff_random_below(random, DIFF_MAX_ROUTINES);
+        const uint16_t n = (uint16_t)diff_random_below(random, 4);
+        const uint32_t phaseOffsetMs = diff_random_below(random, 4);
+        if (!gReference[next].isUsed)
+        {
+            expected->chainNext = 0;
+            return diff_expect("unchain", sdcr_routine_chain(gIds[i], NULL, 0, 0), SDCR_SUCCESS);
+        }
+        sdcr_status status = SDCR_ERROR_INVALID_API_USAGE; //< a chain starts from the begining
+        if (!gReference[next].isStream)
+        {
+            expected->chainNext = next + 1u;
+            expected->chainCycles = n;
+            expected->chainOffsetMs = phaseOffsetMs;
+            status = SDCR_SUCCESS;
+        }
+        return diff_expect("chain", sdcr_routine_chain(gIds[i], gIds[next], n, phaseOffsetMs), status);
+    }
+    case 11:
+        expected->hasOnComplete = (diff_random_below(random, 2) == 0);
+        return diff_expect("on_complete",
+                           sdcr_routine_on_complete(gIds[i], expected->hasOnComplete ? diff_on_complete : NULL),
+                           SDCR_SUCCESS);
+    default:
+        return true;
+    }
+}
+
+/* Will apply an operation on many routines at once: a random subset of them. */
+static bool diff_apply_many(uint64_t *random, uint32_t now)
+{
+    const char *ids[DIFF_MAX_ROUTINES];
+    size_t indexes[DIFF_MAX_ROUTINES];
+    sdcr_status statuses[DIFF_MAX_ROUTINES];
+    sdcr_status expected[DIFF_MAX_ROUTINES];
+    size_t count = 0;
+    const uint32_t subset = diff_random_below(random, 1u << DIFF_MAX_ROUTINES);
+    for (size_t i = 0; i < DIFF_MAX_ROUTINES; i++)
+    {
+        if (subset & (1u << i))
+        {
+            ids[count] = gIds[i];
+            indexes[count] = i;
+            count++;
+        }
+    }
+
+    const char *operation;
+    sdcr_status result;
+    const uint32_t kind = diff_random_below(random, 8);
+    if (kind < 3)
+    {
+        operation = "start_many";
+        const uint16_t n = (uint16_t)diff_random_below(random, 4);
+        const uint32_t startMs = now - diff_random_below(random, 5);
+        const uint32_t *start = (diff_random_below(random, 2) == 0) ? &startMs : NULL;
+        for (size_t k = 0; k < count; k++)
+        {
+            expected[k] = reference_can_start(indexes[k], start != NULL);
+            if (expected[k] == SDCR_SUCCESS)
+                reference_start(indexes[k], n, start);
+        }
+        result = sdcr_routine_start_many(ids, count, n, start, statuses);
+    }
+    else if (kind < 5)
+    {
+        operation = "stop_many";
+        for (size_t k = 0; k < count; k++)
+        {
+            expected[k] = gReference[indexes[k]].isUsed ? SDCR_SUCCESS : SDCR_ERROR_ID_DOESNT_EXIST;
+            if (expected[k] == SDCR_SUCCESS)
+                gReference[indexes[k]].isEnable = false;
+        }
+        result = sdcr_routine_stop_many(ids, count, statuses);
+    }
+    else if (kind < 7)
+    {
+        operation = "new_many";
+        sdcr_routine_configuration configs[DIFF_MAX_ROUTINES];
+        for (size_t k = 0; k < count; k++)
+        {
+            const size_t i = indexes[k];
+            const uint32_t stepTimeMs = 1u + diff_random_below(random, 4);
+            expected[k] = SDCR_ERROR_ID_ALREADY_EXIST;
+            if (!gReference[i].isUsed)
+            {
+                diff_generate(random, i, stepTimeMs); //< in order: the first free slots
+                expected[k] = SDCR_SUCCESS;
+            }
+            configs[k] = (sdcr_routine_configuration){
+                .id = gIds[i],
+                .routine = gPatterns[i],
+                .routineStepTimeMs = stepTimeMs,
+                .callbackFunction = gCallbacks[i],
+            };
+        }
+        result = sdcr_routine_new_many(configs, count, statuses);
+    }
+    else if (diff_random_below(random, 4) == 0)
+    {
+        for (size_t i = 0; i < DIFF_MAX_ROUTINES; i++)
+        {
+            reference_clear(i);
+        }
+        return diff_expect("clear_all", sdcr_routine_clear_all(), SDCR_SUCCESS);
+    }
+    else
+    {
+        return true;
+    }
+
+    // the result is the first error, the unknown IDs are found first
+    sdcr_status expectedResult = SDCR_SUCCESS;
+    bool isSame = true;
+    for (size_t k = 0; k < count; k++)
+    {
+        isSame = diff_expect(operation, statuses[k], expected[k]) && isSame;
+        if (expectedResult == SDCR_SUCCESS || (expected[k] == SDCR_ERROR_ID_DOESNT_EXIST &&
+                                               expectedResult != SDCR_ERROR_ID_DOESNT_EXIST))
+            expectedResult = expected[k];
+    }
+    return diff_expect(operation, result, expectedResult) && isSame;
+}
+
+/* Will run a scenario through the engine in use, and the reference.
+ * return: false at the first difference.
+ */
+static bool diff_run_scenario(const sdcr_engine *engine, size_t scenario, uint64_t seed)
+{
+    uint64_t random = seed;
+    uint32_t now = (diff_random_below(&random, 8) == 0) ? UINT32_MAX - gConfig.ticks //< crosses the wrap around
+                                                        : diff_random_below(&random, 100000);
+    bool isSame = true;
+    for (size_t tick = 0; tick < gConfig.ticks && isSame; tick++)
+    {
+        const uint32_t operations = diff_random_below(&random, 3);
+        for (uint32_t operation = 0; operation < operations && isSame; operation++)
+        {
+            const size_t i = diff_random_below(&random, DIFF_MAX_ROUTINES + 1u); //< the last one is many routines
+            gFailure = (diff_failure){0};
+            isSame = (i < DIFF_MAX_ROUTINES) ? diff_apply(&random, i, now) : diff_apply_many(&random, now);
+            if (!isSame)
+            {
+                printf("error, engine %s, scenario %zu, pass %zu: routine \"%s\" %s status %d, expected %d\n",
+                       engine->name, scenario, tick, (i < DIFF_MAX_ROUTINES) ? gIds[i] : "many",
+                       gFailure.operation, gFailure.status, gFailure.expected);
+            }
+        }
+
+        const uint32_t move = diff_random_below(&random, 16);
+        if (move == 15 && diff_random_below(&random, 4) == 0)
+            now -= diff_random_below(&random, 10); //< the time goes back
+        else if (move >= 13)
+            now += 5u + diff_random_below(&random, 36); //< a late pass
+        else if (move != 0)
+            now += 1u + diff_random_below(&random, 3);
+
+        gOrderHash = 2166136261u;
+        gReferenceOrderHash = 2166136261u;
+        sdcr_task_at(now);
+        reference_task(now);
+        isSame = isSame && diff_check_pass(engine, scenario, tick);
+    }
+
+    // leave the library empty
+    for (size_t i = 0; i < DIFF_MAX_ROUTINES; i++)
+    {
+        if (gReference[i].isUsed)
+            sdcr_routine_clear(gIds[i]);
+        gReference[i] = (diff_reference){0};
+        gCalls[i] = 0;
+        gReferenceCalls[i] = 0;
+    }
+    return isSame;
+}
+
+static bool diff_run_engine(const sdcr_engine *engine)
+{
+    sdcr_engine_select(engine);
+    uint64_t seeds = gConfig.seed;
+    for (size_t scenario = 0; scenario < gConfig.scenarios; scenario++)
+    {
+        const uint64_t seed = diff_random(&seeds);
+        if (!diff_run_scenario(engine, scenario, seed))
+            return false;
+    }
+    printf("%-10s %10zu scenarios %12zu passes: same as the reference\n",
+           engine->name, gConfig.scenarios, gConfig.scenarios * gConfig.ticks);
+    return true;
+}
+
+//-----------------------------------------------
+// THROUGHPUT
+//-----------------------------------------------
+static bool bench_run(const sdcr_engine *engine, size_t routines)
+{
+    sdcr_engine_select(engine);
+    for (size_t i = 0; i < routines; i++)
+    {
+        snprintf(gBenchIds[i], sizeof(gBenchIds[i]), "b%zu", i);
+        // unrelated step times, from 1 ms to 250 ms
+        const uint32_t stepTimeMs = 1u + (uint32_t)((i * 7919u) % 250u);
+        sdcr_status res = sdcr_routine_new(.id = gBenchIds[i],
+                                           .routine = "C..",
+                                           .callbackFunction = diff_callback_bench,
+                                           .routineStepTimeMs = stepTimeMs);
+        res += sdcr_routine_start_inf(gBenchIds[i]);
+        if (res != SDCR_SUCCESS)
+        {
+            printf("error, cannot create routine %zu (status %d)\n", i, res);
+            return false;
+        }
+    }
+
+    sdcr_clear_stats();
+    const uint64_t start = get_time_ns();
+    for (uint32_t now = 1; now <= gConfig.benchTicks; now++)
+    {
+        sdcr_task_at(now);
+    }
+    const uint64_t elapsedNs = get_time_ns() - start;
+
+    sdcr_stats stats;
+    sdcr_get_stats(&stats);
+    const double seconds = (elapsedNs != 0) ? (double)elapsedNs / 1e9 : 1e-9;
+    printf("%-10s %9zu %10u %10u %10.1f %10.2f\n",
+           engine->name,
+           routines,
+           gConfig.benchTicks,
+           stats.steps,
+           (double)elapsedNs / gConfig.benchTicks,
+           (double)stats.steps / seconds / 1e6);
+    return true;
+}
+
+//-----------------------------------------------
+// MAIN
+//-----------------------------------------------
+static int parse_arguments(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+            return -1;
+        const unsigned long long value = strtoull(argv[i + 1], NULL, 0);
+        if (strcmp(argv[i], "--scenarios") == 0)
+            gConfig.scenarios = (size_t)value;
+        else if (strcmp(argv[i], "--ticks") == 0)
+            gConfig.ticks = (size_t)value;
+        else if (strcmp(argv[i], "--seed") == 0)
+            gConfig.seed = value;
+        else if (strcmp(argv[i], "--bench-ticks") == 0)
+            gConfig.benchTicks = (uint32_t)value;
+        else
+            return -1;
+        i++;
+    }
+    const bool configIsValid = (gConfig.ticks > 0 && gConfig.ticks < 1000000 &&
+                                gConfig.benchTicks > 0 &&
+                                DIFF_BENCH_MAX_ROUTINES <= SDCR_MAX_NUMBER_OF_ROUTINE);
+    return configIsValid ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    if (parse_arguments(argc, argv) != 0)
+    {
+        printf("usage: %s [--scenarios N] [--ticks T] [--seed S] [--bench-ticks B]\n", argv[0]);
+        return 1;
+    }
+    printf("scenarios=%zu ticks=%zu seed=%llu bench-ticks=%u\n",
+           gConfig.scenarios, gConfig.ticks, (unsigned long long)gConfig.seed, gConfig.benchTicks);
+
+    const sdcr_engine *engines[] = {&sdcr_engine_linear, &sdcr_engine_heap, &sdcr_engine_wheel};
+    const size_t engineCount = sizeof(engines) / sizeof(engines[0]);
+    bool isSame = true;
+    for (size_t i = 0; i < engineCount && isSame; i++)
+    {
+        isSame = diff_run_engine(engines[i]);
+    }
+    if (!isSame)
+        return 1;
+
+    printf("\n%-10s %9s %10s %10s %10s %10s\n",
+           "engine", "routines", "passes", "steps", "ns/pass", "Msteps/s");
+    const size_t routineCounts[] = {16, 128, DIFF_BENCH_MAX_ROUTINES};
+    for (size_t r = 0; r < sizeof(routineCounts) / sizeof(routineCounts[0]); r++)
+    {
+        for (size_t i = 0; i < engineCount; i++)
+        {
+            if (!bench_run(engines[i], routineCounts[r]))
+                return 1;
+        }
+    }
+    sdcr_routine_clear_all();
+    return 0;
+}
+
+static void diff_on_callback(size_t index)
+{
+    gCalls[index]++;
+    gOrderHash = diff_hash(gOrderHash, (uint32_t)index);
+}
+
+/* Will write a compact routine: 1 to 3 items, steps with a step time and a
+ * count, and repeated groups nested twice at most.
+ */
+static void diff_write_sequence(diff_text *text, uint64_t *random, unsigned depth)
+{
+    const uint32_t items = 1u + diff_random_below(random, 3);
+    for (uint32_t item = 0; item < items; item++)
+    {
+        if (depth < 2 && diff_random_below(random, 3) == 0)
+        {
+            diff_write(text, "(", 0);
+            diff_write_sequence(text, random, depth + 1);
+            diff_write(text, (diff_random_below(random, 2) == 0) ? ")*%u" : "){%u}", 1u + diff_random_below(random, 3));
+        }
+        else
+        {
+            static const char *const units[] = {".", "C", "c"};
+            diff_write(text, units[diff_random_below(random, 3)], 0);
+            const bool hasHold = (diff_random_below(random, 3) == 0);
+            const bool hasCount = (diff_random_below(random, 3) == 0);
+            const bool isHoldFirst = (diff_random_below(random, 2) == 0);
+            if (hasHold && isHoldFirst)
+                diff_write(text, "@%u", 1u + diff_random_below(random, 6));
+            if (hasCount)
+                diff_write(text, "{%u}", 1u + diff_random_below(random, 3));
+            if (hasHold && !isHoldFirst)
+                diff_write(text, "@%u", 1u + diff_random_below(random, 6));
+        }
+        if (diff_random_below(random, 4) == 0)
+            diff_write(text, " ", 0); //< spaces are ignored
+    }
+}
+
+/* Will append to a routine string, or mark it full. */
+static void diff_write(diff_text *text, const char *format, uint32_t value)
+{
+    if (text->isFull)
+        return;
+    const size_t room = DIFF_MAX_LENGTH + 1u - text->length;
+    const int written = snprintf(text->text + text->length, room, format, value);
+    if (written < 0 || (size_t)written >= room)
+        text->isFull = true;
+    else
+        text->length += (size_t)written;
+}
+
+/* xorshift64* */
+static uint64_t diff_random(uint64_t *state)
+{
+    uint64_t x = (*state != 0) ? *state : 0x9E3779B97F4A7C15u;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1Du;
+}
+
+static uint32_t diff_random_below(uint64_t *state, uint32_t bound)
+{
+    return (uint32_t)((diff_random(state) >> 32) % bound);
+}
+
+/* FNV-1a, on 32 bits values */
+static uint32_t diff_hash(uint32_t hash, uint32_t value)
+{
+    for (size_t i = 0; i < 4; i++)
+    {
+        hash ^= (value >> (8 * i)) & 0xFFu;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint64_t get_time_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
@@ -0,0 +1,342 @@
+/*
+ * soak testing SDCR
+ * Measure how late the callbacks fire against a real clock (CLOCK_MONOTONIC)
+ * under a synthetic load, with each scheduling engine and each driver.
+ *
+ * The library tick is in microseconds here: `routineStepTimeMs` is used as a
+ * step time in microseconds. The library doesn't care about the time unit.
+ *
+ * Lateness of a callback = (time the callback runs) - (time it should run).
+ * The time it should run is the previous callback decision time plus the
+ * number of steps between the two callbacks. Intermediate '.' steps are
+ * invisible, so their own lateness is accumulated in the next callback.
+ *
+ * USAGE:
+ *      ./soaktest_latency [--routines N] [--length L] [--density D]
+ *                         [--step-us S] [--cost-us C] [--stress T]
+ *                         [--sleep-us P] [--duration-ms M]
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "../src/sdrc.h"        //< library to test
+#include "../src/sdrc_engine.h" //< library to test
+
+//-----------------------------------------------
+// DEFINITIONS
+//-----------------------------------------------
+#define SOAK_MAX_ROUTINES 256
+#define SOAK_MAX_LENGTH 64
+#define SOAK_MAX_SAMPLES (1u << 20)
+
+typedef struct
+{
+    size_t routines;     //< Number of routines.
+    size_t length;       //< Number of steps in each routine.
+    uint32_t density;    //< Percentage of 'C' steps in each routine.
+    uint32_t stepUs;     //< Base step time. Each routine gets a slightly different one.
+    uint32_t costUs;     //< Time spent in each callback.
+    size_t stressThreads;//< Number of CPU-stress background threads.
+    uint32_t sleepUs;    //< Sleep between two `sdcr_task` for the sleep-based driver.
+    uint32_t durationMs; //< Duration of each run.
+} soak_config;
+
+typedef struct
+{
+    char id[8];
+    char pattern[SOAK_MAX_LENGTH + 1];
+    uint32_t stepUs;
+    bool hasFired;
+    uint32_t lastDecision; //< Tick of the previous callback step.
+    uint32_t lastStep;     //< Index of the previous callback step.
+} soak_routine;
+
+typedef enum
+{
+    SOAK_DRIVER_BUSY_POLL,
+    SOAK_DRIVER_SLEEP,
+} soak_driver;
+
+//-----------------------------------------------
+// GLOBAL VARIABLES
+//-----------------------------------------------
+static soak_config gConfig = {
+    .routines = 64,
+    .length = 16,
+    .density = 25,
+    .stepUs = 1000,
+    .costUs = 0,
+    .stressThreads = 0,
+    .sleepUs = 100,
+    .durationMs = 2000,
+};
+static soak_routine gRoutines[SOAK_MAX_ROUTINES];
+static int32_t gSamples[SOAK_MAX_SAMPLES];
+static size_t gSampleCount = 0;
+static atomic_bool gStressStop;
+
+//-----------------------------------------------
+// prototype
+//-----------------------------------------------
+static uint32_t get_tick_us();
+static void soak_on_callback(size_t index);
+static void soak_spin_us(uint32_t us);
+
+//-----------------------------------------------
+// CALLBACKS
+// Callbacks don't have a context: generate one per routine.
+//-----------------------------------------------
+#define SOAK_ROW(M, hi) \
+    M(hi, 0) M(hi, 1) M(hi, 2) M(hi, 3) M(hi, 4) M(hi, 5) M(hi, 6) M(hi, 7) \
+    M(hi, 8) M(hi, 9) M(hi, A) M(hi, B) M(hi, C) M(hi, D) M(hi, E) M(hi, F)
+#define SOAK_ALL(M) \
+    SOAK_ROW(M, 0) SOAK_ROW(M, 1) SOAK_ROW(M, 2) SOAK_ROW(M, 3) \
+    SOAK_ROW(M, 4) SOAK_ROW(M, 5) SOAK_ROW(M, 6) SOAK_ROW(M, 7) \
+    SOAK_ROW(M, 8) SOAK_ROW(M, 9) SOAK_ROW(M, A) SOAK_ROW(M, B) \
+    SOAK_ROW(M, C) SOAK_ROW(M, D) SOAK_ROW(M, E) SOAK_ROW(M, F)
+#define SOAK_CALLBACK(hi, lo) \
+    static void soak_callback_##hi##lo(void) { soak_on_callback(0x##hi##lo); }
+#define SOAK_CALLBACK_PTR(hi, lo) soak_callback_##hi##lo,
+
+SOAK_ALL(SOAK_CALLBACK)
+static const sdcr_callback_function gCallbacks[SOAK_MAX_ROUTINES] = {SOAK_ALL(SOAK_CALLBACK_PTR)};
+
+//-----------------------------------------------
+// SOAK
+//-----------------------------------------------
+static void *stress_thread(void *arg)
+{
+    (void)arg;
+    volatile uint64_t sink = 1;
+    while (!atomic_load_explicit(&gStressStop, memory_order_relaxed))
+    {
+        sink = sink * 6364136223846793005u + 1442695040888963407u;
+    }
+    return NULL;
+}
+
+static void soak_build_routines()
+{
+    for (size_t i = 0; i < gConfig.routines; i++)
+    {
+        soak_routine *routine = &gRoutines[i];
+        *routine = (soak_routine){0};
+        snprintf(routine->id, sizeof(routine->id), "r%zu", i);
+
+        // spread the 'C' steps evenly
+        for (size_t step = 0; step < gConfig.length; step++)
+        {
+            const bool isCall = ((step + 1) * gConfig.density / 100) > (step * gConfig.density / 100);
+            routine->pattern[step] = isCall ? 'C' : '.';
+        }
+        routine->pattern[0] = 'C'; //< at least one callback per cycle
+        routine->pattern[gConfig.length] = '\0';
+
+        // unrelated step times, so the deadlines don't line up
+        routine->stepUs = gConfig.stepUs + (uint32_t)(i % 7) * (gConfig.stepUs / 7);
+    }
+}
+
+static int soak_run(soak_driver driver)
+{
+    sdcr_routine_clear_all();
+    gSampleCount = 0;
+    for (size_t i = 0; i < gConfig.routines; i++)
+    {
+        soak_routine *routine = &gRoutines[i];
+        routine->hasFired = false;
+        sdcr_status res = sdcr_routine_new(.id = routine->id,
+                                           .routine = routine->pattern,
+                                           .callbackFunction = gCallbacks[i],
+                                           .routineStepTimeMs = routine->stepUs);
+        res += sdcr_routine_start_inf(routine->id);
+        if (res != SDCR_SUCCESS)
+        {
+            printf("error, cannot create routine %zu (status %d)\n", i, res);
+            return -1;
+        }
+    }
+
+    const uint32_t start = get_tick_us();
+    const uint32_t duration = gConfig.durationMs * 1000u;
+    const struct timespec pause = {.tv_sec = 0, .tv_nsec = (long)gConfig.sleepUs * 1000};
+    while ((get_tick_us() - start) < duration)
+    {
+        sdcr_task(get_tick_us);
+        if (driver == SOAK_DRIVER_SLEEP)
+        {
+            clock_nanosleep(CLOCK_MONOTONIC, 0, &pause, NULL);
+        }
+    }
+    return 0;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+    const int32_t lhs = *(const int32_t *)a;
+    const int32_t rhs = *(const int32_t *)b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+static int32_t soak_percentile(double percentile)
+{
+    if (gSampleCount == 0)
+        return 0;
+    size_t rank = (size_t)(percentile / 100.0 * (double)(gSampleCount - 1) + 0.5);
+    return gSamples[rank];
+}
+
+static void soak_report(const char *scheduler, const char *driver)
+{
+    qsort(gSamples, gSampleCount, sizeof(gSamples[0]), compare_samples);
+    printf("%-10s %-10s %10zu %9d %9d %9d %9d\n",
+           scheduler,
+           driver,
+           gSampleCount,
+           soak_percentile(50.0),
+           soak_percentile(99.0),
+           soak_percentile(99.9),
+           soak_percentile(100.0));
+}
+
+//-----------------------------------------------
+// MAIN
+//-----------------------------------------------
+static int parse_arguments(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+            return -1;
+        const unsigned long value = strtoul(argv[i + 1], NULL, 0);
+        if (strcmp(argv[i], "--routines") == 0)
+            gConfig.routines = value;
+        else if (strcmp(argv[i], "--length") == 0)
+            gConfig.length = value;
+        else if (strcmp(argv[i], "--density") == 0)
+            gConfig.density = (uint32_t)value;
+        else if (strcmp(argv[i], "--step-us") == 0)
+            gConfig.stepUs = (uint32_t)value;
+        else if (strcmp(argv[i], "--cost-us") == 0)
+            gConfig.costUs = (uint32_t)value;
+        else if (strcmp(argv[i], "--stress") == 0)
+            gConfig.stressThreads = value;
+        else if (strcmp(argv[i], "--sleep-us") == 0)
+            gConfig.sleepUs = (uint32_t)value;
+        else if (strcmp(argv[i], "--duration-ms") == 0)
+            gConfig.durationMs = (uint32_t)value;
+        else
+            return -1;
+        i++;
+    }
+    const bool configIsValid = (gConfig.routines > 0 && gConfig.routines <= SOAK_MAX_ROUTINES &&
+                                gConfig.routines <= SDCR_MAX_NUMBER_OF_ROUTINE &&
+                                gConfig.length > 0 && gConfig.length <= SOAK_MAX_LENGTH &&
+                                gConfig.density <= 100 && gConfig.stepUs > 0 &&
+                                gConfig.sleepUs < 1000000);
+    return configIsValid ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    if (parse_arguments(argc, argv) != 0)
+    {
+        printf("usage: %s [--routines N] [--length L] [--density D] [--step-us S]\n"
+               "       [--cost-us C] [--stress T] [--sleep-us P] [--duration-ms M]\n",
+               argv[0]);
+        return 1;
+    }
+    printf("routines=%zu length=%zu density=%u%% step=%uus cost=%uus stress=%zu sleep=%uus duration=%ums\n",
+           gConfig.routines, gConfig.length, gConfig.density, gConfig.stepUs,
+           gConfig.costUs, gConfig.stressThreads, gConfig.sleepUs, gConfig.durationMs);
+
+    pthread_t stress[64];
+    size_t stressCount = 0;
+    atomic_store(&gStressStop, false);
+    for (; stressCount < gConfig.stressThreads && stressCount < sizeof(stress) / sizeof(stress[0]); stressCount++)
+    {
+        if (pthread_create(&stress[stressCount], NULL, stress_thread, NULL) != 0)
+            break;
+    }
+
+    soak_build_routines();
+    printf("%-10s %-10s %10s %9s %9s %9s %9s\n",
+           "scheduler", "driver", "samples", "p50(us)", "p99(us)", "p99.9(us)", "max(us)");
+
+    const struct
+    {
+        soak_driver driver;
+        const char *name;
+    } drivers[] = {
+        {SOAK_DRIVER_BUSY_POLL, "busy-poll"},
+        {SOAK_DRIVER_SLEEP, "sleep"},
+    };
+    const sdcr_engine *engines[] = {&sdcr_engine_linear, &sdcr_engine_heap, &sdcr_engine_wheel};
+    int result = 0;
+    for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]) && result == 0; e++)
+    {
+        sdcr_engine_select(engines[e]);
+        for (size_t i = 0; i < sizeof(drivers) / sizeof(drivers[0]) && result == 0; i++)
+        {
+            result = soak_run(drivers[i].driver);
+            soak_report(engines[e]->name, drivers[i].name);
+        }
+    }
+
+    atomic_store(&gStressStop, true);
+    for (size_t i = 0; i < stressCount; i++)
+    {
+        pthread_join(stress[i], NULL);
+    }
+    sdcr_routine_clear_all();
+    return result != 0;
+}
+
+static uint32_t get_tick_us()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u);
+}
+
+static void soak_on_callback(size_t index)
+{
+    const uint32_t now = get_tick_us();
+    soak_routine *routine = &gRoutines[index];
+
+    // The library updates the state before calling back: this is the current step.
+    sdcr_routine_state state;
+    if (sdcr_routine_get_state(routine->id, &state) != SDCR_SUCCESS)
+        return;
+    const uint32_t step = (state.cursorPosition + (uint32_t)gConfig.length - 1) % (uint32_t)gConfig.length;
+
+    if (routine->hasFired && gSampleCount < SOAK_MAX_SAMPLES)
+    {
+        uint32_t stepsBetween = (step + (uint32_t)gConfig.length - routine->lastStep) % (uint32_t)gConfig.length;
+        if (stepsBetween == 0)
+            stepsBetween = (uint32_t)gConfig.length;
+        const uint32_t deadline = routine->lastDecision + stepsBetween * routine->stepUs;
+        gSamples[gSampleCount++] = (int32_t)(now - deadline);
+    }
+    routine->hasFired = true;
+    routine->lastDecision = state.timestampLastAction;
+    routine->lastStep = step;
+
+    soak_spin_us(gConfig.costUs);
+}
+
+static void soak_spin_us(uint32_t us)
+{
+    const uint32_t start = get_tick_us();
+    while ((get_tick_us() - start) < us)
+    {
+    }
+}
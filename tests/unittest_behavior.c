@@ -2,6 +2,7 @@
  * testing SDCR
  */
 #include <stdio.h>
+#include <string.h>
 
 #include "minunit.h"     //< Test framewok
 #include "../src/sdrc.h" //< library to test
@@ -13,11 +14,33 @@ int mu_tests_run = 0;
 static uint32_t g_fakeTick = 0;
 static uint32_t g_callbackCounter = 0;
 
+static uint32_t g_secondCallbackTick = 0;
+static uint32_t g_secondCallbackCounter = 0;
+static const char *g_completedId = NULL;
+static uint32_t g_completedTick = 0;
+static char g_order[16] = "";
+
 //-----------------------------------------------
 // prototype
 //-----------------------------------------------
 static uint32_t get_fake_tick();
 static void callback_counter();
+static void callback_second();
+static void on_complete(const char *id);
+static void callback_order_a();
+static void callback_order_b();
+static void callback_order_c();
+static void on_complete_order(const char *id);
+static size_t stream_source(void *context, sdcr_stream_event *events, size_t capacity);
+
+/* A stream of `length` one step events, calling on even events. */
+typedef struct
+{
+    uint32_t length;
+    uint32_t next;
+    uint32_t pulls;
+    uint32_t pullSecondCalls; //< `g_secondCallbackCounter` at the last pull.
+} test_stream;
 
 //-----------------------------------------------
 // MAIN
@@ -172,6 +195,1092 @@ static char *test_blink_pattern_for_n_cylce()
     return 0;
 }
 
+static char *test_state_snapshot_follows_the_routine()
+{
+    // init
+    g_fakeTick = 0;        //< reset global flag
+    g_callbackCounter = 0; //< reset global flag
+    sdcr_routine_clear_all();
+
+    sdcr_status res = 0;
+    sdcr_routine_state state = {0};
+    char *pattern = "C...";
+    res = sdcr_routine_new(.id = "green led",
+                           .routine = pattern,
+                           .callbackFunction = callback_counter,
+                           .routineStepTimeMs = 10);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    res = sdcr_routine_get_state("green led", &state);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    mu_assert("error, routine should not be enabled", state.isEnable == false);
+
+    res = sdcr_routine_start_for_n_cycles("green led", 3);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // tests
+    for (size_t i = 0; i < 25; i++)
+    {
+        g_fakeTick++; //< 1 tick pass every time
+        sdcr_task(get_fake_tick);
+    }
+    res = sdcr_routine_get_state("green led", &state);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    mu_assert("error, state.id != green led", state.id != NULL);
+    mu_assert("error, routine should be enabled", state.isEnable == true);
+    mu_assert("error, routine should not be infinite", state.isInfinite == false);
+    mu_assert("error, state.cyclesLeft != 3", state.cyclesLeft == 3);
+    mu_assert("error, state.timestampLastAction != 20", state.timestampLastAction == 20);
+    mu_assert("error, state.cursorPosition != 2", state.cursorPosition == 2);
+
+    sdcr_routine_state states[SDCR_MAX_NUMBER_OF_ROUTINE] = {0};
+    size_t count = 0;
+    res = sdcr_routine_get_state_all(states, SDCR_MAX_NUMBER_OF_ROUTINE, &count);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    mu_assert("error, count != 1", count == 1);
+    mu_assert("error, states[0].cursorPosition != 2", states[0].cursorPosition == 2);
+
+    sdcr_routine_clear("green led");
+    res = sdcr_routine_get_state("green led", &state);
+    mu_assert("error, res != SDCR_ERROR_ID_DOESNT_EXIST", res == SDCR_ERROR_ID_DOESNT_EXIST);
+    return 0;
+}
+
+static char *test_compact_routine_syntax()
+{
+    struct
+    {
+        char *pattern;
+        uint32_t expectedCalls;
+    } cases[] = {
+        {"C.........", 10},  //< plain routine, 100 ms cycle
+        {"C.{9}", 10},       //< same timeline with a count
+        {"C .@90", 10},      //< same timeline with a duration
+        {"(C.)*5", 50},      //< a group
+        {"(C{2}.)*2 .{4}", 40}, //< nested suffixes
+        {"C@5 .@15", 50},    //< a 20 ms cycle
+        {"(C)*10", 100},     //< a repeated run
+        {"(C.C)*3 .", 60},   //< a group played again from its events
+        {"((C.)*2 .)*2", 40}, //< nested groups
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        // init
+        g_fakeTick = 0;        //< reset global flag
+        g_callbackCounter = 0; //< reset global flag
+        sdcr_routine_clear_all();
+
+        sdcr_status res = sdcr_routine_new(.id = "green led",
+                                           .routine = cases[i].pattern,
+                                           .callbackFunction = callback_counter,
+                                           .routineStepTimeMs = 10);
+        mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+        res = sdcr_routine_start_inf("green led");
+        mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+        // tests: the first call happens at 10 ms, then one cycle every 100 ms
+        for (size_t tick = 0; tick < 1000; tick++)
+        {
+            g_fakeTick++; //< 1 tick pass every time
+            sdcr_task(get_fake_tick);
+        }
+        mu_assert("error, compact routine callback count", g_callbackCounter == cases[i].expectedCalls);
+    }
+    return 0;
+}
+
+static char *test_plain_routines_always_fit()
+{
+    // init: more events than the memory can hold
+    static char ids[SDCR_MAX_NUMBER_OF_ROUTINE][16];
+    char routine[] = "C.C.C.C.C.C.C.C.C.C.C.C.C.C.C.C.C.C.C.C.";
+    g_callbackCounter = 0; //< reset global flag
+    sdcr_routine_clear_all();
+    for (size_t i = 0; i < SDCR_MAX_NUMBER_OF_ROUTINE; i++)
+    {
+        snprintf(ids[i], sizeof(ids[i]), "led %zu", i);
+        sdcr_status res = sdcr_routine_new(.id = ids[i],
+                                           .routine = routine,
+                                           .callbackFunction = callback_counter,
+                                           .routineStepTimeMs = 10);
+        mu_assert("error, a plain routine should always fit", res == SDCR_SUCCESS);
+        res = sdcr_routine_start_at(ids[i], 3, 1000);
+        mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    }
+
+    // tests: compiled or played from the string, every routine has the same timeline
+    for (uint32_t now = 1000; now < 2000; now++)
+    {
+        sdcr_task_at(now);
+        sdcr_routine_state first;
+        sdcr_routine_get_state(ids[0], &first);
+        for (size_t i = 0; i < SDCR_MAX_NUMBER_OF_ROUTINE; i++)
+        {
+            sdcr_routine_state state;
+            sdcr_routine_query_result query;
+            sdcr_routine_get_state(ids[i], &state);
+            sdcr_status res = sdcr_routine_query(ids[i], now, &query);
+            mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+            mu_assert("error, cursor differs", state.cursorPosition == first.cursorPosition);
+            mu_assert("error, cycles differs", state.cyclesLeft == first.cyclesLeft);
+            mu_assert("error, query cursor differs", query.cursorPosition == state.cursorPosition);
+            mu_assert("error, query isEnable differs", query.isEnable == state.isEnable);
+        }
+    }
+    mu_assert("error, g_callbackCounter", g_callbackCounter == SDCR_MAX_NUMBER_OF_ROUTINE * 41);
+
+    // tests: the routines played from the string can't be copied, it is on the stack here
+    size_t size;
+    sdcr_status res = sdcr_snapshot(2000, NULL, 0, &size);
+    mu_assert("error, res != SDCR_ERROR_INVALID_API_USAGE", res == SDCR_ERROR_INVALID_API_USAGE);
+    return 0;
+}
+
+static char *test_compact_routine_cursor_counts_compiled_steps()
+{
+    // init
+    g_fakeTick = 0;        //< reset global flag
+    g_callbackCounter = 0; //< reset global flag
+    sdcr_routine_clear_all();
+
+    sdcr_status res = sdcr_routine_new(.id = "green led",
+                                       .routine = "C.{999}C",
+                                       .callbackFunction = callback_counter,
+                                       .routineStepTimeMs = 1);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_routine_start_inf("green led");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    for (size_t tick = 0; tick < 500; tick++)
+    {
+        g_fakeTick++; //< 1 tick pass every time
+        sdcr_task(get_fake_tick);
+    }
+    sdcr_routine_state state = {0};
+    res = sdcr_routine_get_state("green led", &state);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    mu_assert("error, the wait should be a single step", state.cursorPosition == 2);
+    mu_assert("error, g_callbackCounter != 1", g_callbackCounter == 1);
+    return 0;
+}
+
+static char *test_render_toggles_frame_bits()
+{
+    // init
+    g_fakeTick = 0;        //< reset global flag
+    g_callbackCounter = 0; //< reset global flag
+    sdcr_routine_clear_all();
+
+    sdcr_status res = 0;
+    uint8_t frame[2] = {0};
+    res += sdcr_routine_new(.id = "led 0",
+                            .routine = "C",
+                            .callbackFunction = sdcr_callback_none,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_new(.id = "led 9",
+                            .routine = "C.",
+                            .callbackFunction = sdcr_callback_none,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_new(.id = "not bound",
+                            .routine = "C",
+                            .callbackFunction = callback_counter,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_new(.id = "outside",
+                            .routine = "C",
+                            .callbackFunction = callback_counter,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_bind_output("led 0", 0);
+    res += sdcr_routine_bind_output("led 9", 9);
+    res += sdcr_routine_bind_output("outside", 16);
+    res += sdcr_routine_start_inf("led 0");
+    res += sdcr_routine_start_inf("led 9");
+    res += sdcr_routine_start_inf("not bound");
+    res += sdcr_routine_start_inf("outside");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // tests
+    res = sdcr_render(10, frame, sizeof(frame));
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    mu_assert("error, frame[0] != 0x01", frame[0] == 0x01);
+    mu_assert("error, frame[1] != 0x02", frame[1] == 0x02);
+    mu_assert("error, g_callbackCounter != 1", g_callbackCounter == 1); //< bound routines don't call back
+
+    sdcr_render(20, frame, sizeof(frame)); //< led 9 is waiting
+    mu_assert("error, frame[0] != 0x00", frame[0] == 0x00);
+    mu_assert("error, frame[1] != 0x02", frame[1] == 0x02);
+
+    sdcr_render(30, frame, sizeof(frame));
+    mu_assert("error, frame[0] != 0x01", frame[0] == 0x01);
+    mu_assert("error, frame[1] != 0x00", frame[1] == 0x00);
+
+    // without a frame, outputs are ignored
+    res = sdcr_routine_unbind_output("outside");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    g_callbackCounter = 0;
+    sdcr_task_at(40);
+    mu_assert("error, g_callbackCounter != 2", g_callbackCounter == 2);
+    mu_assert("error, frame[0] != 0x01", frame[0] == 0x01);
+
+    res = sdcr_render(50, NULL, 0);
+    mu_assert("error, res != SDCR_ERROR_NULL_PTR", res == SDCR_ERROR_NULL_PTR);
+    return 0;
+}
+
+static char *test_chain_starts_next_routine_without_gap()
+{
+    // init
+    g_fakeTick = 0;        //< reset global flag
+    g_callbackCounter = 0; //< reset global flag
+    g_secondCallbackTick = 0;
+    g_completedId = NULL;
+    sdcr_routine_clear_all();
+
+    sdcr_status res = 0;
+    res += sdcr_routine_new(.id = "second",
+                            .routine = "C...",
+                            .callbackFunction = callback_second,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_new(.id = "first",
+                            .routine = "C.",
+                            .callbackFunction = callback_counter,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_on_complete("first", on_complete);
+    res += sdcr_routine_chain("first", "second", 0, 0);
+    res += sdcr_routine_start_for_n_cycles("first", 3);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // tests
+    for (size_t i = 0; i < 100; i++)
+    {
+        g_fakeTick++; //< 1 tick pass every time
+        sdcr_task(get_fake_tick);
+    }
+    // "first" steps at 10, 20, 30 (wrap), 40, 50 (wrap, last cycle)
+    mu_assert("error, g_callbackCounter != 3", g_callbackCounter == 3);
+    mu_assert("error, on_complete not called", g_completedId != NULL);
+    mu_assert("error, wrong completed id", strcmp(g_completedId, "first") == 0);
+    mu_assert("error, completed at the wrong time", g_completedTick == 50);
+    // "second" is before "first" in memory, and still starts in the same pass
+    mu_assert("error, second routine should start at 50", g_secondCallbackTick == 50);
+
+    sdcr_routine_state state;
+    sdcr_routine_get_state("second", &state);
+    mu_assert("error, second routine should cycle infinitely", state.isEnable && state.isInfinite);
+    return 0;
+}
+
+static char *test_chain_with_phase_offset()
+{
+    // init
+    g_fakeTick = 0;        //< reset global flag
+    g_callbackCounter = 0; //< reset global flag
+    g_secondCallbackTick = 0;
+    sdcr_routine_clear_all();
+
+    sdcr_status res = 0;
+    res += sdcr_routine_new(.id = "first",
+                            .routine = "C",
+                            .callbackFunction = callback_counter,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_new(.id = "second",
+                            .routine = "C",
+                            .callbackFunction = callback_second,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_chain("first", "second", 1, 5);
+    res += sdcr_routine_start_for_n_cycles("first", 2);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // tests: "first" completes at 20, "second" starts at 25
+    for (size_t i = 0; i < 25; i++)
+    {
+        g_fakeTick++; //< 1 tick pass every time
+        sdcr_task(get_fake_tick);
+        if (g_secondCallbackTick != 0)
+            break;
+    }
+    mu_assert("error, second routine should start at 25", g_secondCallbackTick == 25);
+
+    // a cleared routine is unchained
+    g_secondCallbackTick = 0;
+    res = sdcr_routine_clear("second");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_routine_start_for_n_cycles("first", 1);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    for (size_t i = 0; i < 100; i++)
+    {
+        g_fakeTick++; //< 1 tick pass every time
+        sdcr_task(get_fake_tick);
+    }
+    mu_assert("error, cleared routine should not start", g_secondCallbackTick == 0);
+    return 0;
+}
+
+static char *test_completions_are_given_back()
+{
+    // init
+    sdcr_routine_clear_all();
+    static char ids[SDCR_MAX_NUMBER_OF_COMPLETION + 1][8];
+    sdcr_status res = 0;
+    for (size_t i = 0; i < SDCR_MAX_NUMBER_OF_COMPLETION + 1; i++)
+    {
+        snprintf(ids[i], sizeof(ids[i]), "r%zu", i);
+        res += sdcr_routine_new(.id = ids[i],
+                                .routine = "C",
+                                .callbackFunction = callback_counter,
+                                .routineStepTimeMs = 10);
+    }
+    for (size_t i = 0; i < SDCR_MAX_NUMBER_OF_COMPLETION; i++)
+    {
+        res += sdcr_routine_on_complete(ids[i], on_complete);
+    }
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // tests: the completions are full, until a routine has none
+    const char *last = ids[SDCR_MAX_NUMBER_OF_COMPLETION];
+    res = sdcr_routine_on_complete(last, on_complete);
+    mu_assert("error, res != SDCR_ERROR_ROUTINE_MEMORY_IS_FULL", res == SDCR_ERROR_ROUTINE_MEMORY_IS_FULL);
+    res = sdcr_routine_chain(last, ids[0], 1, 0);
+    mu_assert("error, res != SDCR_ERROR_ROUTINE_MEMORY_IS_FULL", res == SDCR_ERROR_ROUTINE_MEMORY_IS_FULL);
+    res = sdcr_routine_on_complete(ids[0], NULL);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_routine_chain(last, ids[0], 1, 0);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_routine_on_complete(ids[0], on_complete);
+    mu_assert("error, res != SDCR_ERROR_ROUTINE_MEMORY_IS_FULL", res == SDCR_ERROR_ROUTINE_MEMORY_IS_FULL);
+
+    // a cleared routine gives its completion back, and is unchained
+    res = sdcr_routine_clear(ids[1]);
+    res += sdcr_routine_on_complete(ids[0], on_complete);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_routine_clear(ids[0]);
+    res += sdcr_routine_new(.id = ids[1],
+                            .routine = "C",
+                            .callbackFunction = callback_counter,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_on_complete(ids[1], on_complete);
+    res += sdcr_routine_on_complete(last, on_complete);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // the slack is up to 65535 ms
+    res = sdcr_routine_set_slack(last, UINT16_MAX + 1u);
+    mu_assert("error, res != SDCR_ERROR_INVALID_API_USAGE", res == SDCR_ERROR_INVALID_API_USAGE);
+    res = sdcr_routine_set_slack(last, UINT16_MAX);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    return 0;
+}
+
+static void run_until(uint32_t tick)
+{
+    while (g_fakeTick < tick)
+    {
+        g_fakeTick++; //< 1 tick pass every time
+        sdcr_task(get_fake_tick);
+    }
+}
+
+static char *test_identical_routines_share_a_timeline()
+{
+    // init
+    g_fakeTick = 0;        //< reset global flag
+    g_callbackCounter = 0; //< reset global flag
+    g_secondCallbackCounter = 0;
+    sdcr_routine_clear_all();
+
+    sdcr_status res = 0;
+    res += sdcr_routine_new(.id = "first",
+                            .routine = "C.",
+                            .callbackFunction = callback_counter,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_new(.id = "second",
+                            .routine = "(C.)*1",
+                            .callbackFunction = callback_second,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_start_inf("first");
+    res += sdcr_routine_start_inf("second");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // tests: both routines are called
+    run_until(40);
+    mu_assert("error, g_callbackCounter != 2", g_callbackCounter == 2);
+    mu_assert("error, g_secondCallbackCounter != 2", g_secondCallbackCounter == 2);
+
+    sdcr_routine_state first;
+    sdcr_routine_state second;
+    sdcr_routine_get_state("first", &first);
+    sdcr_routine_get_state("second", &second);
+    mu_assert("error, second routine state is not updated",
+              second.isEnable && second.timestampLastAction == 40 && second.cursorPosition == 2);
+    mu_assert("error, routine states differ",
+              first.timestampLastAction == second.timestampLastAction &&
+                  first.cursorPosition == second.cursorPosition);
+
+    // stopping one routine doesn't stop the other
+    res = sdcr_routine_stop("first");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    run_until(80);
+    mu_assert("error, g_callbackCounter != 2", g_callbackCounter == 2);
+    mu_assert("error, g_secondCallbackCounter != 4", g_secondCallbackCounter == 4);
+    sdcr_routine_get_state("first", &first);
+    mu_assert("error, stopped routine state changed",
+              !first.isEnable && first.timestampLastAction == 40 && first.cursorPosition == 2);
+
+    // restarted out of phase, the routines run on their own
+    res = sdcr_routine_start_inf("first");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    run_until(100);
+    mu_assert("error, g_callbackCounter != 3", g_callbackCounter == 3);
+    mu_assert("error, g_secondCallbackCounter != 5", g_secondCallbackCounter == 5);
+
+    // clearing one routine doesn't stop the other
+    res = sdcr_routine_clear("second");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    run_until(120);
+    mu_assert("error, g_callbackCounter != 4", g_callbackCounter == 4);
+    mu_assert("error, g_secondCallbackCounter != 5", g_secondCallbackCounter == 5);
+    return 0;
+}
+
+static char *test_shared_timeline_leader_can_stop()
+{
+    // init
+    g_fakeTick = 0;        //< reset global flag
+    g_callbackCounter = 0; //< reset global flag
+    g_secondCallbackCounter = 0;
+    sdcr_routine_clear_all();
+
+    sdcr_status res = 0;
+    res += sdcr_routine_new(.id = "first",
+                            .routine = "C",
+                            .callbackFunction = callback_counter,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_new(.id = "second",
+                            .routine = "C",
+                            .callbackFunction = callback_second,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_start_for_n_cycles("first", 6);
+    res += sdcr_routine_start_for_n_cycles("second", 6);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // tests: whichever routine leads the timeline, the other one keeps going
+    run_until(20);
+    res = sdcr_routine_stop("first");
+    res += sdcr_routine_stop("second");
+    res += sdcr_routine_start_for_n_cycles("second", 6);
+    res += sdcr_routine_start_for_n_cycles("first", 6);
+    res += sdcr_routine_stop("second");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    run_until(100);
+    mu_assert("error, g_callbackCounter != 7", g_callbackCounter == 7);
+    mu_assert("error, g_secondCallbackCounter != 2", g_secondCallbackCounter == 2);
+
+    sdcr_routine_state state;
+    sdcr_routine_get_state("first", &state);
+    mu_assert("error, routine should be complete", !state.isEnable);
+    return 0;
+}
+
+static char *test_repeated_group_costs_its_events_once()
+{
+    // init
+    g_fakeTick = 0;        //< reset global flag
+    g_callbackCounter = 0; //< reset global flag
+    g_secondCallbackCounter = 0;
+    sdcr_routine_clear_all();
+
+    // tests: a group is compiled once, whatever its number of copies (60 events each unrolled, out of 40)
+    sdcr_status res = 0;
+    res += sdcr_routine_new(.id = "first",
+                            .routine = "(C.)*30",
+                            .callbackFunction = callback_counter,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_new(.id = "second",
+                            .routine = "(C.)*30",
+                            .callbackFunction = callback_second,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_new(.id = "nested",
+                            .routine = "((C.)*1000 .)*1000",
+                            .callbackFunction = sdcr_callback_none,
+                            .routineStepTimeMs = 10);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // tests: the copies are played, in a shared timeline too
+    res += sdcr_routine_start_inf("first");
+    res += sdcr_routine_start_inf("second");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    run_until(455);
+    sdcr_routine_state state;
+    sdcr_routine_get_state("second", &state);
+    mu_assert("error, g_callbackCounter != 23", g_callbackCounter == 23);
+    mu_assert("error, g_secondCallbackCounter != 23", g_secondCallbackCounter == 23);
+    mu_assert("error, cursor should count the copies played", state.cursorPosition == 45);
+
+    // tests: a routine leaving the timeline keeps its place in the copies
+    res = sdcr_routine_stop("first");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    run_until(1255);
+    sdcr_routine_get_state("second", &state);
+    mu_assert("error, g_callbackCounter != 23", g_callbackCounter == 23);
+    mu_assert("error, g_secondCallbackCounter != 63", g_secondCallbackCounter == 63);
+    mu_assert("error, cursor should be in the third cycle", state.cursorPosition == 5);
+    return 0;
+}
+
+static char *test_shared_timeline_keeps_the_routines_order()
+{
+    // init
+    g_fakeTick = 0; //< reset global flag
+    g_order[0] = '\0';
+    sdcr_routine_clear_all();
+
+    sdcr_status res = 0;
+    res += sdcr_routine_new(.id = "a",
+                            .routine = "C.",
+                            .callbackFunction = callback_order_a,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_new(.id = "b",
+                            .routine = "C",
+                            .callbackFunction = callback_order_b,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_new(.id = "c",
+                            .routine = "C.",
+                            .callbackFunction = callback_order_c,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_on_complete("a", on_complete_order);
+    res += sdcr_routine_on_complete("b", on_complete_order);
+    res += sdcr_routine_on_complete("c", on_complete_order);
+    res += sdcr_routine_start_for_n_cycles("c", 1);
+    res += sdcr_routine_start_for_n_cycles("b", 1);
+    res += sdcr_routine_start_for_n_cycles("a", 1); //< joins the timeline of "c"
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // tests: callbacks (lowercase) and completions (uppercase) in the routines order, at each pass
+    run_until(30);
+    mu_assert("error, the routines are not performed in order", strcmp(g_order, "abcbBaAcC") == 0);
+    return 0;
+}
+
+static char *test_slack_coalesces_nearby_deadlines()
+{
+    // init
+    g_fakeTick = 0;        //< reset global flag
+    g_callbackCounter = 0; //< reset global flag
+    g_secondCallbackCounter = 0;
+    sdcr_routine_clear_all();
+    sdcr_clear_stats();
+
+    sdcr_status res = 0;
+    res += sdcr_routine_new(.id = "first",
+                            .routine = "C",
+                            .callbackFunction = callback_counter,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_new(.id = "second",
+                            .routine = "C",
+                            .callbackFunction = callback_second,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_set_slack("second", 5);
+    res += sdcr_routine_start_inf("first");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    run_until(3);
+    res = sdcr_routine_start_at("second", 0, 3);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // tests: "second" is due 3 ms after "first" and is performed with it, without drifting
+    run_until(100);
+    mu_assert("error, g_callbackCounter != 10", g_callbackCounter == 10);
+    mu_assert("error, g_secondCallbackCounter != 10", g_secondCallbackCounter == 10);
+
+    sdcr_stats stats;
+    res = sdcr_get_stats(&stats);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    mu_assert("error, stats.wakeups != 10", stats.wakeups == 10);
+    mu_assert("error, stats.steps != 20", stats.steps == 20);
+    mu_assert("error, stats.coalescedSteps != 10", stats.coalescedSteps == 10);
+    mu_assert("error, stats.savedWakeups != 10", stats.savedWakeups == 10);
+    return 0;
+}
+
+static char *test_next_wakeup_uses_the_slack()
+{
+    // init
+    sdcr_routine_clear_all();
+    sdcr_status res = 0;
+    uint32_t delay = 0;
+    res = sdcr_get_next_wakeup(0, &delay);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    mu_assert("error, no routine should never wake up", delay == UINT32_MAX);
+
+    res += sdcr_routine_new(.id = "first",
+                            .routine = "C",
+                            .callbackFunction = callback_counter,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_new(.id = "second",
+                            .routine = "C",
+                            .callbackFunction = callback_second,
+                            .routineStepTimeMs = 13);
+    res += sdcr_routine_set_slack("second", 5);
+    res += sdcr_routine_start_inf("first");
+    res += sdcr_routine_start_inf("second");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // tests
+    sdcr_get_next_wakeup(0, &delay);
+    mu_assert("error, delay != 10", delay == 10);
+    sdcr_routine_set_slack("first", 4);
+    sdcr_get_next_wakeup(0, &delay);
+    mu_assert("error, delay != 13", delay == 13); //< "first" is late, to be performed with "second"
+    sdcr_get_next_wakeup(12, &delay);
+    mu_assert("error, delay != 1", delay == 1);
+    sdcr_get_next_wakeup(20, &delay);
+    mu_assert("error, delay != 0", delay == 0);
+
+    // a lone deadline is not delayed
+    res = sdcr_routine_stop("second");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    sdcr_get_next_wakeup(0, &delay);
+    mu_assert("error, delay != 10", delay == 10);
+    return 0;
+}
+
+static char *test_slack_routine_keeps_its_period()
+{
+    // init
+    g_callbackCounter = 0; //< reset global flag
+    sdcr_routine_clear_all();
+    sdcr_clear_stats();
+    sdcr_status res = 0;
+    res += sdcr_routine_new(.id = "first",
+                            .routine = "C",
+                            .callbackFunction = callback_counter,
+                            .routineStepTimeMs = 100);
+    res += sdcr_routine_set_slack("first", 10);
+    res += sdcr_routine_start_at("first", 0, 0);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // tests: a tickless host sleeps until the next wakeup, sometimes a bit late
+    uint32_t now = 0;
+    uint32_t wakeups = 0;
+    while (now < 10000)
+    {
+        uint32_t delay = 0;
+        sdcr_get_next_wakeup(now, &delay);
+        now += delay + (wakeups++ % 3); //< 0 to 2 ms late
+        sdcr_task_at(now);
+    }
+    mu_assert("error, g_callbackCounter != 100", g_callbackCounter == 100);
+
+    sdcr_stats stats;
+    sdcr_get_stats(&stats);
+    mu_assert("error, a lone routine has nothing to coalesce", stats.coalescedSteps == 0 && stats.savedWakeups == 0);
+    return 0;
+}
+
+static char *test_query_matches_the_scheduler()
+{
+    char *routines[] = {"C..C@5.{3}", "(C.)*2 c@3 .@7", "C", "((C.)*3 c@3)*2 .@7"};
+    const uint16_t cycles[] = {0, 1, 2, 3, 4};
+    for (size_t r = 0; r < sizeof(routines) / sizeof(routines[0]); r++)
+    {
+        for (size_t c = 0; c < sizeof(cycles) / sizeof(cycles[0]); c++)
+        {
+            // init
+            sdcr_routine_clear_all();
+            uint8_t frame[1] = {0};
+            sdcr_status res = 0;
+            res += sdcr_routine_new(.id = "red led",
+                                    .routine = routines[r],
+                                    .callbackFunction = sdcr_callback_none,
+                                    .routineStepTimeMs = 10);
+            res += sdcr_routine_bind_output("red led", 0);
+            res += sdcr_routine_start_at("red led", cycles[c], 1000);
+            mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+            // tests: the scheduler and the query agree at any time
+            for (uint32_t now = 1000; now < 1500; now++)
+            {
+                sdcr_render(now, frame, sizeof(frame));
+                sdcr_routine_state state;
+                sdcr_routine_query_result query;
+                sdcr_routine_get_state("red led", &state);
+                res = sdcr_routine_query("red led", now, &query);
+                mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+                mu_assert("error, query isEnable differs", query.isEnable == state.isEnable);
+                mu_assert("error, query cursor differs", query.cursorPosition == state.cursorPosition);
+                mu_assert("error, query output differs", query.isOutputOn == (frame[0] & 1u));
+                const bool isStep = (state.timestampLastAction == now && now != 1000);
+                if (state.isEnable && isStep)
+                {
+                    sdcr_routine_query_result before;
+                    sdcr_routine_query("red led", now - 1, &before);
+                    mu_assert("error, query transition differs", before.nextTransitionMs == now);
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static char *test_query_without_start_time()
+{
+    // init
+    sdcr_routine_clear_all();
+    sdcr_status res = sdcr_routine_new(.id = "red led",
+                                       .routine = "C.",
+                                       .callbackFunction = callback_counter,
+                                       .routineStepTimeMs = 10);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    sdcr_routine_query_result query;
+
+    // tests
+    res = sdcr_routine_query("red led", 0, &query);
+    mu_assert("error, res != SDCR_ERROR_INVALID_API_USAGE", res == SDCR_ERROR_INVALID_API_USAGE);
+    sdcr_routine_start_at("red led", 0, 100);
+    res = sdcr_routine_query("red led", 135, &query);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    mu_assert("error, wrong query",
+              query.isEnable && query.isCall && !query.isOutputOn && query.cursorPosition == 1 &&
+                  query.cyclesCompleted == 1 && query.nextTransitionMs == 140);
+    sdcr_routine_stop("red led");
+    res = sdcr_routine_query("red led", 135, &query);
+    mu_assert("error, res != SDCR_ERROR_INVALID_API_USAGE", res == SDCR_ERROR_INVALID_API_USAGE);
+    return 0;
+}
+
+static char *test_bulk_start_is_phase_locked()
+{
+    // init
+    g_fakeTick = 0;        //< reset global flag
+    g_callbackCounter = 0; //< reset global flag
+    g_secondCallbackCounter = 0;
+    sdcr_routine_clear_all();
+
+    const sdcr_routine_configuration configs[] = {
+        {.id = "first", .routine = "C.", .callbackFunction = callback_counter, .routineStepTimeMs = 10},
+        {.id = "second", .routine = "C.", .callbackFunction = callback_second, .routineStepTimeMs = 10},
+        {.id = "first", .routine = "C.", .callbackFunction = callback_second, .routineStepTimeMs = 10},
+        {.id = "third", .routine = "C.", .callbackFunction = callback_counter, .routineStepTimeMs = 10},
+    };
+    sdcr_status statuses[4];
+    sdcr_status res = sdcr_routine_new_many(configs, 4, statuses);
+    mu_assert("error, res != SDCR_ERROR_ID_ALREADY_EXIST", res == SDCR_ERROR_ID_ALREADY_EXIST);
+    mu_assert("error, wrong statuses",
+              statuses[0] == SDCR_SUCCESS && statuses[1] == SDCR_SUCCESS &&
+                  statuses[2] == SDCR_ERROR_ID_ALREADY_EXIST && statuses[3] == SDCR_SUCCESS);
+
+    // "first" is out of phase before the bulk start
+    res = sdcr_routine_start_inf("first");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    run_until(15);
+
+    // tests: every routine starts from the same tick
+    const char *const ids[] = {"first", "second", "third"};
+    const uint32_t startMs = 15;
+    res = sdcr_routine_start_many(ids, 3, 0, &startMs, statuses);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    g_callbackCounter = 0;
+    run_until(65);
+    mu_assert("error, g_callbackCounter != 6", g_callbackCounter == 6);
+    mu_assert("error, g_secondCallbackCounter != 3", g_secondCallbackCounter == 3);
+
+    sdcr_routine_state states[3];
+    for (size_t i = 0; i < 3; i++)
+    {
+        sdcr_routine_get_state(ids[i], &states[i]);
+        mu_assert("error, routines are not phase-locked",
+                  states[i].isEnable && states[i].timestampLastAction == 65 && states[i].cursorPosition == 1);
+    }
+
+    // stopping with bad ids still stops the good ones
+    const char *const stopIds[] = {"third", NULL, "I dont really exist.", "first"};
+    res = sdcr_routine_stop_many(stopIds, 4, statuses);
+    mu_assert("error, res != SDCR_ERROR_NULL_PTR", res == SDCR_ERROR_NULL_PTR);
+    mu_assert("error, wrong statuses",
+              statuses[0] == SDCR_SUCCESS && statuses[1] == SDCR_ERROR_NULL_PTR &&
+                  statuses[2] == SDCR_ERROR_ID_DOESNT_EXIST && statuses[3] == SDCR_SUCCESS);
+    run_until(105);
+    mu_assert("error, g_callbackCounter != 6", g_callbackCounter == 6);
+    mu_assert("error, g_secondCallbackCounter != 5", g_secondCallbackCounter == 5);
+    return 0;
+}
+
+static char *test_cleared_ids_can_be_reused()
+{
+    // init
+    sdcr_routine_clear_all();
+    static char ids[SDCR_MAX_NUMBER_OF_ROUTINE][8];
+    sdcr_routine_configuration configs[SDCR_MAX_NUMBER_OF_ROUTINE];
+    for (size_t i = 0; i < SDCR_MAX_NUMBER_OF_ROUTINE; i++)
+    {
+        snprintf(ids[i], sizeof(ids[i]), "%zu", i);
+        configs[i] = (sdcr_routine_configuration){.id = ids[i],
+                                                  .routine = "C.",
+                                                  .callbackFunction = callback_counter,
+                                                  .routineStepTimeMs = 10};
+    }
+    sdcr_status res = sdcr_routine_new_many(configs, SDCR_MAX_NUMBER_OF_ROUTINE, NULL);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // tests: clear every other routine, then create them again
+    for (size_t i = 0; i < SDCR_MAX_NUMBER_OF_ROUTINE; i += 2)
+    {
+        res = sdcr_routine_clear(ids[i]);
+        mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    }
+    for (size_t i = 0; i < SDCR_MAX_NUMBER_OF_ROUTINE; i++)
+    {
+        sdcr_routine_state state;
+        res = sdcr_routine_get_state(ids[i], &state);
+        mu_assert("error, wrong routine cleared",
+                  res == (i % 2 == 0 ? SDCR_ERROR_ID_DOESNT_EXIST : SDCR_SUCCESS));
+        res = sdcr_routine_start_inf(ids[i]);
+        mu_assert("error, wrong routine found",
+                  res == (i % 2 == 0 ? SDCR_ERROR_ID_DOESNT_EXIST : SDCR_SUCCESS));
+    }
+    sdcr_status statuses[SDCR_MAX_NUMBER_OF_ROUTINE];
+    res = sdcr_routine_new_many(configs, SDCR_MAX_NUMBER_OF_ROUTINE, statuses);
+    mu_assert("error, res != SDCR_ERROR_ID_ALREADY_EXIST", res == SDCR_ERROR_ID_ALREADY_EXIST);
+    for (size_t i = 0; i < SDCR_MAX_NUMBER_OF_ROUTINE; i++)
+    {
+        mu_assert("error, wrong status",
+                  statuses[i] == (i % 2 == 0 ? SDCR_SUCCESS : SDCR_ERROR_ID_ALREADY_EXIST));
+    }
+
+    // tests: clear every routine at once, the started ones too
+    sdcr_task_at(2000);
+    res = sdcr_routine_set_slack(ids[1], 5);
+    res += sdcr_routine_start_at(ids[3], 0, 3000); //< in the future
+    res += sdcr_routine_on_complete(ids[5], on_complete);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_routine_clear_all();
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    g_callbackCounter = 0;
+    for (uint32_t now = 2001; now <= 2100; now++)
+    {
+        sdcr_task_at(now);
+    }
+    mu_assert("error, a cleared routine was called", g_callbackCounter == 0);
+    res = sdcr_routine_new_many(configs, 2, NULL);
+    res += sdcr_routine_start_inf(ids[1]);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    for (uint32_t now = 2101; now <= 2120; now++)
+    {
+        sdcr_task_at(now);
+    }
+    mu_assert("error, g_callbackCounter != 1", g_callbackCounter == 1);
+    return 0;
+}
+
+static char *test_restore_continues_every_routine()
+{
+    // init
+    g_fakeTick = 0;        //< reset global flag
+    g_callbackCounter = 0; //< reset global flag
+    g_secondCallbackCounter = 0;
+    sdcr_routine_clear_all();
+
+    const sdcr_routine_configuration configs[] = {
+        {.id = "first", .routine = "C..", .callbackFunction = callback_counter, .routineStepTimeMs = 10},
+        {.id = "second", .routine = "C.", .callbackFunction = callback_second, .routineStepTimeMs = 10},
+        {.id = "third", .routine = "C.", .callbackFunction = callback_counter, .routineStepTimeMs = 10},
+    };
+    sdcr_status res = sdcr_routine_new_many(configs, 3, NULL);
+    const char *const ids[] = {"second", "third"};
+    const uint32_t startMs = 5;
+    res += sdcr_routine_start_for_n_cycles("first", 5);
+    res += sdcr_routine_start_many(ids, 2, 0, &startMs, NULL);
+    res += sdcr_routine_on_complete("first", on_complete);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    run_until(37);
+
+    static uint8_t blob[4096];
+    size_t size = 0;
+    res = sdcr_snapshot(37, NULL, 0, &size);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS && size > 0 && size <= sizeof(blob));
+    res = sdcr_snapshot(37, blob, size - 1, &size);
+    mu_assert("error, res != SDCR_ERROR_INVALID_API_USAGE", res == SDCR_ERROR_INVALID_API_USAGE);
+    res = sdcr_snapshot(37, blob, sizeof(blob), &size);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // reference: what happens without a restart
+    g_callbackCounter = 0;
+    g_secondCallbackCounter = 0;
+    g_completedId = NULL;
+    run_until(237);
+    const uint32_t callbackCounter = g_callbackCounter;
+    const uint32_t secondCallbackCounter = g_secondCallbackCounter;
+    mu_assert("error, first routine not completed", g_completedId != NULL);
+    sdcr_routine_state expected[3];
+    for (size_t i = 0; i < 3; i++)
+    {
+        sdcr_routine_get_state(configs[i].id, &expected[i]);
+    }
+
+    // tests: restart in another time base, 37 is now 1037
+    sdcr_routine_clear_all();
+    res = sdcr_restore(1037, blob, size);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    sdcr_routine_query_result query;
+    res = sdcr_routine_query("second", 1037, &query);
+    mu_assert("error, query not restored", res == SDCR_SUCCESS && query.nextTransitionMs == 1045);
+
+    g_fakeTick = 1037;
+    g_callbackCounter = 0;
+    g_secondCallbackCounter = 0;
+    g_completedId = NULL;
+    run_until(1237);
+    mu_assert("error, wrong callbacks after restore",
+              g_callbackCounter == callbackCounter && g_secondCallbackCounter == secondCallbackCounter);
+    mu_assert("error, first routine not completed", g_completedId != NULL && strcmp(g_completedId, "first") == 0);
+    for (size_t i = 0; i < 3; i++)
+    {
+        sdcr_routine_state state;
+        res = sdcr_routine_get_state(configs[i].id, &state);
+        mu_assert("error, wrong state after restore",
+                  res == SDCR_SUCCESS &&
+                      state.isEnable == expected[i].isEnable &&
+                      state.cyclesLeft == expected[i].cyclesLeft &&
+                      state.cursorPosition == expected[i].cursorPosition &&
+                      state.timestampLastAction == expected[i].timestampLastAction + 1000);
+    }
+
+    // a damaged blob is rejected, and nothing changes
+    blob[size - 1] ^= 1;
+    res = sdcr_restore(0, blob, size);
+    mu_assert("error, res != SDCR_ERROR_INVALID_SNAPSHOT", res == SDCR_ERROR_INVALID_SNAPSHOT);
+    res = sdcr_restore(0, blob, 3);
+    mu_assert("error, res != SDCR_ERROR_INVALID_SNAPSHOT", res == SDCR_ERROR_INVALID_SNAPSHOT);
+    res = sdcr_routine_start_inf("first");
+    mu_assert("error, routines changed by a damaged blob", res == SDCR_SUCCESS);
+    return 0;
+}
+
+static char *test_stream_pulls_a_chunk_ahead()
+{
+    // init
+    g_fakeTick = 0;        //< reset global flag
+    g_callbackCounter = 0; //< reset global flag
+    g_completedId = NULL;
+    sdcr_routine_clear_all();
+
+    test_stream stream = {.length = 25};
+    sdcr_status res = sdcr_routine_new_stream(.id = "stream",
+                                              .source = stream_source,
+                                              .context = &stream,
+                                              .callbackFunction = callback_counter,
+                                              .routineStepTimeMs = 10);
+    res += sdcr_routine_on_complete("stream", on_complete);
+    res += sdcr_routine_start_inf("stream");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    mu_assert("error, stream not pulled two chunks ahead", stream.pulls == 2 && stream.next == 2 * SDCR_STREAM_CHUNK_SIZE);
+
+    // tests: one event every 10 ms, the last one at 250 ms
+    run_until(10);
+    mu_assert("error, g_callbackCounter != 1", g_callbackCounter == 1);
+    mu_assert("error, stream pulled too early", stream.pulls == 2);
+    run_until(400);
+    mu_assert("error, g_callbackCounter != 13", g_callbackCounter == 13);
+    mu_assert("error, stream not completed", g_completedId != NULL && strcmp(g_completedId, "stream") == 0);
+    mu_assert("error, stream not completed with its last step", g_completedTick == 250);
+    mu_assert("error, stream pulled after its end", stream.pulls == (25 + SDCR_STREAM_CHUNK_SIZE - 1) / SDCR_STREAM_CHUNK_SIZE + 1);
+
+    sdcr_routine_state state;
+    sdcr_routine_get_state("stream", &state);
+    mu_assert("error, stream still running", state.isEnable == false && state.timestampLastAction == 250);
+
+    // a stream can't rewind
+    res = sdcr_routine_start_inf("stream");
+    mu_assert("error, res != SDCR_ERROR_INVALID_API_USAGE", res == SDCR_ERROR_INVALID_API_USAGE);
+    return 0;
+}
+
+static char *test_stream_is_pulled_after_the_pass()
+{
+    // init
+    g_fakeTick = 0;              //< reset global flag
+    g_secondCallbackCounter = 0; //< reset global flag
+    sdcr_routine_clear_all();
+
+    test_stream stream = {.length = 25};
+    sdcr_status res = sdcr_routine_new_stream(.id = "stream",
+                                              .source = stream_source,
+                                              .context = &stream,
+                                              .callbackFunction = callback_counter,
+                                              .routineStepTimeMs = 10);
+    res += sdcr_routine_new(.id = "green led",
+                            .routine = "C",
+                            .callbackFunction = callback_second,
+                            .routineStepTimeMs = 10);
+    res += sdcr_routine_start_inf("stream");
+    res += sdcr_routine_start_inf("green led");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // tests: the first half is played at 80 ms, and pulled once the later routines stepped
+    run_until(80);
+    mu_assert("error, stream not pulled", stream.pulls == 3);
+    mu_assert("error, stream pulled before the step of a later routine", stream.pullSecondCalls == 8);
+    return 0;
+}
+
+static char *test_stream_is_not_a_routine_string()
+{
+    // init
+    sdcr_routine_clear_all();
+    test_stream empty = {.length = 0};
+    test_stream stream = {.length = 1000};
+
+    // tests
+    sdcr_status res = sdcr_routine_new_stream(.id = "empty",
+                                              .source = stream_source,
+                                              .context = &empty,
+                                              .callbackFunction = callback_counter,
+                                              .routineStepTimeMs = 10);
+    mu_assert("error, res != SDCR_ERROR_INVALID_ROUTINE_CONFIG", res == SDCR_ERROR_INVALID_ROUTINE_CONFIG);
+    res = sdcr_routine_new_stream(.id = "no source",
+                                  .callbackFunction = callback_counter,
+                                  .routineStepTimeMs = 10);
+    mu_assert("error, res != SDCR_ERROR_INVALID_ROUTINE_CONFIG", res == SDCR_ERROR_INVALID_ROUTINE_CONFIG);
+
+    res = sdcr_routine_new_stream(.id = "stream",
+                                  .source = stream_source,
+                                  .context = &stream,
+                                  .callbackFunction = callback_counter,
+                                  .routineStepTimeMs = 10);
+    res += sdcr_routine_new(.id = "first",
+                            .routine = "C.",
+                            .callbackFunction = callback_counter,
+                            .routineStepTimeMs = 10);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_routine_start_at("stream", 0, 0);
+    mu_assert("error, res != SDCR_ERROR_INVALID_API_USAGE", res == SDCR_ERROR_INVALID_API_USAGE);
+    res = sdcr_routine_chain("first", "stream", 0, 0);
+    mu_assert("error, res != SDCR_ERROR_INVALID_API_USAGE", res == SDCR_ERROR_INVALID_API_USAGE);
+
+    const char *const ids[] = {"first", "stream"};
+    const uint32_t startMs = 0;
+    sdcr_status statuses[2];
+    res = sdcr_routine_start_many(ids, 2, 0, &startMs, statuses);
+    mu_assert("error, wrong statuses", res == SDCR_ERROR_INVALID_API_USAGE &&
+                                           statuses[0] == SDCR_SUCCESS &&
+                                           statuses[1] == SDCR_ERROR_INVALID_API_USAGE);
+
+    size_t size;
+    res = sdcr_snapshot(0, NULL, 0, &size);
+    mu_assert("error, res != SDCR_ERROR_INVALID_API_USAGE", res == SDCR_ERROR_INVALID_API_USAGE);
+
+    // clearing the stream frees its memory
+    for (size_t i = 0; i < SDCR_MAX_NUMBER_OF_STREAM * 2; i++)
+    {
+        res = sdcr_routine_clear("stream");
+        res += sdcr_routine_new_stream(.id = "stream",
+                                       .source = stream_source,
+                                       .context = &stream,
+                                       .callbackFunction = callback_counter,
+                                       .routineStepTimeMs = 10);
+        mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    }
+    return 0;
+}
+
 static char *all_tests()
 {
     mu_run_test(test_blink_pattern_call_everytime);
@@ -179,6 +1288,29 @@ static char *all_tests()
     mu_run_test(test_blink_pattern_checkcursor);
     mu_run_test(test_blink_pattern_cddd);
     mu_run_test(test_blink_pattern_for_n_cylce);
+    mu_run_test(test_state_snapshot_follows_the_routine);
+    mu_run_test(test_compact_routine_syntax);
+    mu_run_test(test_plain_routines_always_fit);
+    mu_run_test(test_compact_routine_cursor_counts_compiled_steps);
+    mu_run_test(test_repeated_group_costs_its_events_once);
+    mu_run_test(test_render_toggles_frame_bits);
+    mu_run_test(test_chain_starts_next_routine_without_gap);
+    mu_run_test(test_chain_with_phase_offset);
+    mu_run_test(test_completions_are_given_back);
+    mu_run_test(test_identical_routines_share_a_timeline);
+    mu_run_test(test_shared_timeline_leader_can_stop);
+    mu_run_test(test_shared_timeline_keeps_the_routines_order);
+    mu_run_test(test_slack_coalesces_nearby_deadlines);
+    mu_run_test(test_next_wakeup_uses_the_slack);
+    mu_run_test(test_slack_routine_keeps_its_period);
+    mu_run_test(test_query_matches_the_scheduler);
+    mu_run_test(test_query_without_start_time);
+    mu_run_test(test_bulk_start_is_phase_locked);
+    mu_run_test(test_cleared_ids_can_be_reused);
+    mu_run_test(test_restore_continues_every_routine);
+    mu_run_test(test_stream_pulls_a_chunk_ahead);
+    mu_run_test(test_stream_is_pulled_after_the_pass);
+    mu_run_test(test_stream_is_not_a_routine_string);
     return 0;
 }
 
@@ -209,4 +1341,61 @@ static uint32_t get_fake_tick()
 static void callback_counter()
 {
     ++g_callbackCounter;
-}
\ No newline at end of file
+}
+
+static void callback_second()
+{
+    ++g_secondCallbackCounter;
+    if (g_secondCallbackTick == 0)
+        g_secondCallbackTick = g_fakeTick;
+}
+
+static void on_complete(const char *id)
+{
+    g_completedId = id;
+    g_completedTick = g_fakeTick;
+}
+
+static void order_append(char c)
+{
+    const size_t length = strlen(g_order);
+    if (length + 1 < sizeof(g_order))
+    {
+        g_order[length] = c;
+        g_order[length + 1] = '\0';
+    }
+}
+
+static void callback_order_a()
+{
+    order_append('a');
+}
+
+static void callback_order_b()
+{
+    order_append('b');
+}
+
+static void callback_order_c()
+{
+    order_append('c');
+}
+
+static void on_complete_order(const char *id)
+{
+    order_append((char)(id[0] - 'a' + 'A'));
+}
+
+static size_t stream_source(void *context, sdcr_stream_event *events, size_t capacity)
+{
+    test_stream *stream = context;
+    stream->pulls++;
+    stream->pullSecondCalls = g_secondCallbackCounter;
+    size_t count = 0;
+    while (count < capacity && stream->next < stream->length)
+    {
+        events[count++] = (sdcr_stream_event){.isCall = (stream->next % 2 == 0)};
+        stream->next++;
+    }
+    return count;
+}
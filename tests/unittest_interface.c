@@ -4,7 +4,9 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "../src/sdrc.h" //< library to test
 #include "minunit.h"     //< Test framewok
@@ -13,11 +15,15 @@
 // TESTS "FRAMEWORK"
 //-----------------------------------------------
 int mu_tests_run = 0;
+static atomic_bool g_isReading = false;
+static atomic_uint g_reads = 0;
+static atomic_uint g_inconsistentReads = 0;
 
 //-----------------------------------------------
 // prototype
 //-----------------------------------------------
 static void dummy_callback();
+static void *read_state_thread(void *argument);
 
 //-----------------------------------------------
 // TESTS
@@ -171,6 +177,53 @@ static char *test_id_are_null()
     res = sdcr_routine_stop(badId);
     mu_assert("error in sdcr_routine_stop, res != SDCR_ERROR_NULL_PTR", res == SDCR_ERROR_NULL_PTR);
 
+    sdcr_routine_state state;
+    res = sdcr_routine_get_state(badId, &state);
+    mu_assert("error in sdcr_routine_get_state, res != SDCR_ERROR_NULL_PTR", res == SDCR_ERROR_NULL_PTR);
+
+    res = sdcr_routine_bind_output(badId, 0);
+    mu_assert("error in sdcr_routine_bind_output, res != SDCR_ERROR_NULL_PTR", res == SDCR_ERROR_NULL_PTR);
+
+    res = sdcr_routine_on_complete(badId, NULL);
+    mu_assert("error in sdcr_routine_on_complete, res != SDCR_ERROR_NULL_PTR", res == SDCR_ERROR_NULL_PTR);
+
+    res = sdcr_routine_chain(badId, NULL, 0, 0);
+    mu_assert("error in sdcr_routine_chain, res != SDCR_ERROR_NULL_PTR", res == SDCR_ERROR_NULL_PTR);
+
+    res = sdcr_routine_set_slack(badId, 1);
+    mu_assert("error in sdcr_routine_set_slack, res != SDCR_ERROR_NULL_PTR", res == SDCR_ERROR_NULL_PTR);
+
+    res = sdcr_get_next_wakeup(0, NULL);
+    mu_assert("error in sdcr_get_next_wakeup, res != SDCR_ERROR_NULL_PTR", res == SDCR_ERROR_NULL_PTR);
+
+    res = sdcr_get_stats(NULL);
+    mu_assert("error in sdcr_get_stats, res != SDCR_ERROR_NULL_PTR", res == SDCR_ERROR_NULL_PTR);
+
+    res = sdcr_routine_start_at(badId, 0, 0);
+    mu_assert("error in sdcr_routine_start_at, res != SDCR_ERROR_NULL_PTR", res == SDCR_ERROR_NULL_PTR);
+
+    sdcr_routine_query_result query;
+    res = sdcr_routine_query(badId, 0, &query);
+    mu_assert("error in sdcr_routine_query, res != SDCR_ERROR_NULL_PTR", res == SDCR_ERROR_NULL_PTR);
+
+    res = sdcr_routine_new_many(NULL, 1, NULL);
+    mu_assert("error in sdcr_routine_new_many, res != SDCR_ERROR_NULL_PTR", res == SDCR_ERROR_NULL_PTR);
+
+    res = sdcr_routine_start_many(NULL, 1, 0, NULL, NULL);
+    mu_assert("error in sdcr_routine_start_many, res != SDCR_ERROR_NULL_PTR", res == SDCR_ERROR_NULL_PTR);
+
+    const char *const badIds[] = {badId};
+    sdcr_status statuses[1];
+    res = sdcr_routine_stop_many(badIds, 1, statuses);
+    mu_assert("error in sdcr_routine_stop_many, res != SDCR_ERROR_NULL_PTR",
+              res == SDCR_ERROR_NULL_PTR && statuses[0] == SDCR_ERROR_NULL_PTR);
+
+    res = sdcr_snapshot(0, NULL, 0, NULL);
+    mu_assert("error in sdcr_snapshot, res != SDCR_ERROR_NULL_PTR", res == SDCR_ERROR_NULL_PTR);
+
+    res = sdcr_restore(0, NULL, 0);
+    mu_assert("error in sdcr_restore, res != SDCR_ERROR_NULL_PTR", res == SDCR_ERROR_NULL_PTR);
+
     return 0;
 }
 
@@ -201,6 +254,54 @@ static char *test_id_doesnt_exist()
     mu_assert(
         "error in sdcr_routine_stop, res != SDCR_ERROR_ID_DOESNT_EXIST",
         res == SDCR_ERROR_ID_DOESNT_EXIST);
+
+    sdcr_routine_state state;
+    res = sdcr_routine_get_state(badId, &state);
+    mu_assert(
+        "error in sdcr_routine_get_state, res != SDCR_ERROR_ID_DOESNT_EXIST",
+        res == SDCR_ERROR_ID_DOESNT_EXIST);
+
+    res = sdcr_routine_bind_output(badId, 0);
+    mu_assert(
+        "error in sdcr_routine_bind_output, res != SDCR_ERROR_ID_DOESNT_EXIST",
+        res == SDCR_ERROR_ID_DOESNT_EXIST);
+
+    res = sdcr_routine_on_complete(badId, NULL);
+    mu_assert(
+        "error in sdcr_routine_on_complete, res != SDCR_ERROR_ID_DOESNT_EXIST",
+        res == SDCR_ERROR_ID_DOESNT_EXIST);
+
+    res = sdcr_routine_chain(badId, NULL, 0, 0);
+    mu_assert(
+        "error in sdcr_routine_chain, res != SDCR_ERROR_ID_DOESNT_EXIST",
+        res == SDCR_ERROR_ID_DOESNT_EXIST);
+
+    res = sdcr_routine_set_slack(badId, 1);
+    mu_assert(
+        "error in sdcr_routine_set_slack, res != SDCR_ERROR_ID_DOESNT_EXIST",
+        res == SDCR_ERROR_ID_DOESNT_EXIST);
+
+    res = sdcr_routine_start_at(badId, 0, 0);
+    mu_assert(
+        "error in sdcr_routine_start_at, res != SDCR_ERROR_ID_DOESNT_EXIST",
+        res == SDCR_ERROR_ID_DOESNT_EXIST);
+
+    sdcr_routine_query_result query;
+    res = sdcr_routine_query(badId, 0, &query);
+    mu_assert(
+        "error in sdcr_routine_query, res != SDCR_ERROR_ID_DOESNT_EXIST",
+        res == SDCR_ERROR_ID_DOESNT_EXIST);
+
+    const char *const badIds[] = {badId};
+    res = sdcr_routine_start_many(badIds, 1, 0, NULL, NULL);
+    mu_assert(
+        "error in sdcr_routine_start_many, res != SDCR_ERROR_ID_DOESNT_EXIST",
+        res == SDCR_ERROR_ID_DOESNT_EXIST);
+
+    res = sdcr_routine_stop_many(badIds, 1, NULL);
+    mu_assert(
+        "error in sdcr_routine_stop_many, res != SDCR_ERROR_ID_DOESNT_EXIST",
+        res == SDCR_ERROR_ID_DOESNT_EXIST);
     return 0;
 }
 
@@ -225,6 +326,105 @@ static char *test_id_is_correctly_cleared()
     return 0;
 }
 
+static char *test_bad_new_config_bad_compact_routine()
+{
+    // init
+    sdcr_status res = 0;
+    const char *badRoutines[] = {
+        "",       //< empty
+        "C{0}",   //< count is 0
+        "C{",     //< count is missing
+        "C{3",    //< unterminated count
+        "(C.",    //< unterminated group
+        "C.)",    //< unbalanced group
+        "C@",     //< duration is missing
+        "(C)@10", //< a group has no duration
+        "C{2}{2}", //< repeated suffix
+        "C.x",    //< invalid char
+        "C{99999999999}", //< count overflow
+        ".@4294967295{2}", //< duration overflow
+        "((((((((((C))))))))))", //< too deep
+        "(C.)*65536", //< too many copies of a group
+    };
+
+    // test
+    for (size_t i = 0; i < sizeof(badRoutines) / sizeof(badRoutines[0]); i++)
+    {
+        sdcr_routine_clear_all();
+        res = sdcr_routine_new(.id = "green led",
+                               .routine = (char *)badRoutines[i],
+                               .callbackFunction = dummy_callback,
+                               .routineStepTimeMs = 1);
+        mu_assert("error, res != SDCR_ERROR_INVALID_ROUTINE_CONFIG", res == SDCR_ERROR_INVALID_ROUTINE_CONFIG);
+    }
+    return 0;
+}
+
+static char *test_bad_new_config_too_much_events()
+{
+    // init
+    sdcr_status res = 0;
+    sdcr_routine_clear_all();
+
+    // test: the copies of a repeated run are merged in a single event
+    res = sdcr_routine_new(.id = "green led",
+                           .routine = "(C)*200 (CC)*500",
+                           .callbackFunction = dummy_callback,
+                           .routineStepTimeMs = 1);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_routine_clear("green led");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // the memory is given back when a routine is cleared: 30 events each, out of 40
+    char *thirtyEvents = "C.C.C.C.C.C.C.C.C.C.C.C.C.C.C.@1"; //< not plain: compiled
+    res = sdcr_routine_new(.id = "green led",
+                           .routine = thirtyEvents,
+                           .callbackFunction = dummy_callback,
+                           .routineStepTimeMs = 1);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_routine_new(.id = "red led",
+                           .routine = thirtyEvents,
+                           .callbackFunction = dummy_callback,
+                           .routineStepTimeMs = 1);
+    mu_assert("error, res != SDCR_ERROR_EVENT_MEMORY_IS_FULL", res == SDCR_ERROR_EVENT_MEMORY_IS_FULL);
+    res = sdcr_routine_clear("green led");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_routine_new(.id = "red led",
+                           .routine = thirtyEvents,
+                           .callbackFunction = dummy_callback,
+                           .routineStepTimeMs = 1);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    return 0;
+}
+
+static char *test_state_is_consistent_while_stepping()
+{
+    // init
+    sdcr_routine_clear_all();
+    sdcr_status res = sdcr_routine_new(.id = "green led",
+                                       .routine = "C.CC...C",
+                                       .callbackFunction = dummy_callback,
+                                       .routineStepTimeMs = 1);
+    res += sdcr_routine_start_at("green led", 0, 0);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // tests: another thread reads the state while `sdcr_task` steps, one step per tick
+    atomic_store(&g_reads, 0);
+    atomic_store(&g_inconsistentReads, 0);
+    atomic_store(&g_isReading, true);
+    pthread_t reader;
+    mu_assert("error, pthread_create failed", pthread_create(&reader, NULL, read_state_thread, NULL) == 0);
+    for (uint32_t tick = 1; tick <= 20000000 && (tick <= 2000000 || atomic_load(&g_reads) < 100000); tick++)
+    {
+        sdcr_task_at(tick);
+    }
+    atomic_store(&g_isReading, false);
+    pthread_join(reader, NULL);
+    mu_assert("error, the state was never read", atomic_load(&g_reads) > 0);
+    mu_assert("error, a read state is not consistent", atomic_load(&g_inconsistentReads) == 0);
+    return 0;
+}
+
 static char *all_tests()
 {
     mu_run_test(test_ok_new_config);
@@ -237,6 +437,9 @@ static char *all_tests()
     mu_run_test(test_id_are_null);
     mu_run_test(test_id_doesnt_exist);
     mu_run_test(test_id_is_correctly_cleared);
+    mu_run_test(test_bad_new_config_bad_compact_routine);
+    mu_run_test(test_bad_new_config_too_much_events);
+    mu_run_test(test_state_is_consistent_while_stepping);
     return 0;
 }
 
@@ -261,4 +464,25 @@ int main()
 
 static void dummy_callback()
 {
-}
\ No newline at end of file
+}
+
+/* Will read the state of "green led" until told to stop.
+ * The routine performs a step at each tick: its cursor follows its last step.
+ */
+static void *read_state_thread(void *argument)
+{
+    (void)argument;
+    while (atomic_load(&g_isReading))
+    {
+        sdcr_routine_state state;
+        if (sdcr_routine_get_state("green led", &state) != SDCR_SUCCESS)
+            continue;
+
+        const bool isConsistent = (state.timestampLastAction == 0) ? (state.cursorPosition == 0)
+                                                                   : (state.cursorPosition == (state.timestampLastAction - 1u) % 8u + 1u);
+        if (!isConsistent || !state.isEnable || !state.isInfinite)
+            atomic_fetch_add(&g_inconsistentReads, 1);
+        atomic_fetch_add(&g_reads, 1);
+    }
+    return NULL;
+}
@@ -0,0 +1,229 @@
+/*
+ * testing SDCR real-time thread
+ */
+#define _POSIX_C_SOURCE 200809L //< nanosleep, getpid, mlock
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "minunit.h"         //< Test framewok
+#include "../src/sdrc.h"     //< library to test
+#include "../src/sdrc_shm.h" //< library to test
+#include "../src/sdrc_rt.h"  //< library to test
+
+//-----------------------------------------------
+// TESTS "FRAMEWORK"
+//-----------------------------------------------
+int mu_tests_run = 0;
+static atomic_uint g_callbackCounter = 0; //< incremented by the real-time thread
+static char g_name[64];
+
+//-----------------------------------------------
+// prototype
+//-----------------------------------------------
+static void callback_counter();
+static void sleep_ms(long ms);
+static uint64_t clock_ms();
+static unsigned long locked_kb();
+
+//-----------------------------------------------
+// TESTS
+//-----------------------------------------------
+static char *test_thread_performs_the_steps()
+{
+    // init
+    atomic_store(&g_callbackCounter, 0); //< reset global flag
+    sdcr_routine_clear_all();
+    sdcr_rt_clear_stats();
+    sdcr_status res = sdcr_routine_new(.id = "red led",
+                                       .routine = "C",
+                                       .callbackFunction = callback_counter,
+                                       .routineStepTimeMs = 2);
+    res += sdcr_routine_start_for_n_cycles("red led", 5);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // tests: no real-time priority, the test can run without privileges
+    res = sdcr_rt_start(.spinUs = 100);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_rt_start(.priority = 0);
+    mu_assert("error, res != SDCR_ERROR_INVALID_API_USAGE", res == SDCR_ERROR_INVALID_API_USAGE);
+
+    sdcr_routine_state state = {.isEnable = true};
+    for (int i = 0; i < 500 && state.isEnable; i++)
+    {
+        sleep_ms(1);
+        sdcr_routine_get_state("red led", &state);
+    }
+    res = sdcr_rt_stop();
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    mu_assert("error, routine not complete", state.isEnable == false);
+    mu_assert("error, g_callbackCounter != 5", atomic_load(&g_callbackCounter) == 5);
+
+    sdcr_rt_stats stats;
+    res = sdcr_rt_get_stats(&stats);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    uint32_t histogramWakeups = 0;
+    for (size_t i = 0; i < SDCR_RT_HISTOGRAM_SIZE; i++)
+    {
+        histogramWakeups += stats.histogram[i];
+    }
+    mu_assert("error, no wakeup", stats.wakeups >= 5);
+    mu_assert("error, histogram doesn't count every wakeup", histogramWakeups == stats.wakeups);
+    return 0;
+}
+
+static char *test_thread_keeps_the_slack_routine_period()
+{
+    // init
+    atomic_store(&g_callbackCounter, 0); //< reset global flag
+    sdcr_routine_clear_all();
+    sdcr_status res = sdcr_routine_new(.id = "red led",
+                                       .routine = "C",
+                                       .callbackFunction = callback_counter,
+                                       .routineStepTimeMs = 20);
+    res += sdcr_routine_set_slack("red led", 5);
+    res += sdcr_routine_start_inf("red led");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // tests: 30 steps of 20 ms, not of 20 ms plus the slack
+    const uint64_t startMs = clock_ms();
+    res = sdcr_rt_start(.maxSleepMs = 50);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    for (int i = 0; i < 2000 && atomic_load(&g_callbackCounter) < 30; i++)
+    {
+        sleep_ms(1);
+    }
+    const uint64_t elapsedMs = clock_ms() - startMs;
+    sdcr_rt_stop();
+    mu_assert("error, the routine didn't perform 30 steps", atomic_load(&g_callbackCounter) >= 30);
+    mu_assert("error, the routine period drifts with its slack", elapsedMs < 30 * 20 + 60);
+    return 0;
+}
+
+static char *test_thread_drains_the_commands()
+{
+    // init
+    atomic_store(&g_callbackCounter, 0); //< reset global flag
+    sdcr_routine_clear_all();
+    sdcr_status res = sdcr_routine_new(.id = "red led",
+                                       .routine = "C.",
+                                       .callbackFunction = callback_counter,
+                                       .routineStepTimeMs = 1);
+    res += sdcr_shm_create(g_name);
+    res += sdcr_shm_open(g_name);
+    res += sdcr_rt_start(.drainSharedMemory = true, .maxSleepMs = 1);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // tests: the routine is started by a command, while idle
+    res = sdcr_shm_routine_start_inf("red led");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    for (int i = 0; i < 500 && atomic_load(&g_callbackCounter) < 3; i++)
+    {
+        sleep_ms(1);
+    }
+    sdcr_rt_stop();
+    sdcr_shm_close();
+    sdcr_shm_destroy();
+    mu_assert("error, command not performed", atomic_load(&g_callbackCounter) >= 3);
+    return 0;
+}
+
+static char *test_memory_locked_before_stays_locked()
+{
+    // init
+    static char page[4096];
+    if (mlock(page, sizeof(page)) != 0)
+        return 0; //< the process can't lock memory: nothing to test
+    sdcr_routine_clear_all();
+
+    // tests: stopping the thread doesn't unlock the memory the process locked
+    sdcr_status res = sdcr_rt_start(.lockMemory = true);
+    if (res == SDCR_SUCCESS)
+        res = sdcr_rt_stop();
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS || res == SDCR_ERROR_REAL_TIME);
+    mu_assert("error, memory locked by the process was unlocked", locked_kb() != 0);
+    munlock(page, sizeof(page));
+    return 0;
+}
+
+static char *test_invalid_configuration()
+{
+    // tests
+    sdcr_status res = sdcr_rt_stop();
+    mu_assert("error, res != SDCR_ERROR_INVALID_API_USAGE", res == SDCR_ERROR_INVALID_API_USAGE);
+    res = sdcr_rt_start(.priority = 100);
+    mu_assert("error, res != SDCR_ERROR_INVALID_API_USAGE", res == SDCR_ERROR_INVALID_API_USAGE);
+    res = sdcr_rt_start(.priority = -1);
+    mu_assert("error, res != SDCR_ERROR_INVALID_API_USAGE", res == SDCR_ERROR_INVALID_API_USAGE);
+    res = sdcr_rt_get_stats(NULL);
+    mu_assert("error, res != SDCR_ERROR_NULL_PTR", res == SDCR_ERROR_NULL_PTR);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(test_thread_performs_the_steps);
+    mu_run_test(test_thread_keeps_the_slack_routine_period);
+    mu_run_test(test_thread_drains_the_commands);
+    mu_run_test(test_memory_locked_before_stays_locked);
+    mu_run_test(test_invalid_configuration);
+    return 0;
+}
+
+//-----------------------------------------------
+// MAIN
+//-----------------------------------------------
+int main()
+{
+    snprintf(g_name, sizeof(g_name), "/sdcr-unittest-rt-%ld", (long)getpid());
+
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf("%s\n", result);
+    }
+    else
+    {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", mu_tests_run);
+
+    return result != 0;
+}
+
+static void callback_counter()
+{
+    atomic_fetch_add(&g_callbackCounter, 1);
+}
+
+static void sleep_ms(long ms)
+{
+    const struct timespec duration = {.tv_sec = 0, .tv_nsec = ms * 1000000};
+    nanosleep(&duration, NULL);
+}
+
+static uint64_t clock_ms()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000u + (uint64_t)now.tv_nsec / 1000000u;
+}
+
+/* return: The memory locked by the process, in kB (`VmLck`). */
+static unsigned long locked_kb()
+{
+    FILE *file = fopen("/proc/self/status", "r");
+    if (file == NULL)
+        return 0;
+
+    unsigned long lockedKb = 0;
+    char line[128];
+    while (fgets(line, sizeof(line), file) != NULL && sscanf(line, "VmLck: %lu", &lockedKb) != 1)
+    {
+    }
+    fclose(file);
+    return lockedKb;
+}
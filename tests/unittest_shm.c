@@ -0,0 +1,412 @@
+/*
+ * testing SDCR shared memory control plane
+ */
+#define _POSIX_C_SOURCE 200809L //< fork, waitpid, nanosleep, shm_open
+
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "minunit.h"         //< Test framewok
+#include "../src/sdrc.h"     //< library to test
+#include "../src/sdrc_shm.h" //< library to test
+
+//-----------------------------------------------
+// TESTS "FRAMEWORK"
+//-----------------------------------------------
+int mu_tests_run = 0;
+static uint32_t g_fakeTick = 0;
+static uint32_t g_callbackCounter = 0;
+static char g_name[64];
+
+/* The segment as a sender sees it (see sdrc_shm.c), to play a stalled sender. */
+typedef struct
+{
+    atomic_uint sequence;
+    uint16_t type;
+    uint16_t cycles;
+    char id[SDCR_SHM_ID_SIZE];
+} test_shm_command;
+
+typedef struct
+{
+    atomic_uint magic;
+    uint32_t size;
+    atomic_uint enqueuePosition;
+    test_shm_command commands[SDCR_SHM_COMMAND_QUEUE_SIZE];
+} test_shm_segment;
+
+//-----------------------------------------------
+// prototype
+//-----------------------------------------------
+static void callback_counter();
+static int run_remote_process();
+static void sleep_us(long us);
+static test_shm_segment *map_segment();
+
+//-----------------------------------------------
+// TESTS
+//-----------------------------------------------
+static char *test_commands_from_the_same_process()
+{
+    // init
+    g_fakeTick = 0;        //< reset global flag
+    g_callbackCounter = 0; //< reset global flag
+    sdcr_routine_clear_all();
+
+    sdcr_status res = sdcr_routine_new(.id = "red led",
+                                       .routine = "C",
+                                       .callbackFunction = callback_counter,
+                                       .routineStepTimeMs = 10);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_shm_create(g_name);
+    mu_assert("error, sdcr_shm_create failed", res == SDCR_SUCCESS);
+    res = sdcr_shm_open(g_name);
+    mu_assert("error, sdcr_shm_open failed", res == SDCR_SUCCESS);
+
+    // tests: the ID is compared by value
+    char id[] = "red led";
+    res = sdcr_shm_routine_start_for_n_cycles(id, 4);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    sdcr_routine_state state;
+    res = sdcr_shm_routine_get_state(id, &state);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    mu_assert("error, command performed before sdcr_shm_update", state.isEnable == false);
+
+    sdcr_shm_update();
+    res = sdcr_shm_routine_get_state(id, &state);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    mu_assert("error, wrong state id", state.id == id);
+    mu_assert("error, routine not started", state.isEnable && !state.isInfinite && state.cyclesLeft == 4);
+
+    for (size_t i = 0; i < 100; i++)
+    {
+        g_fakeTick++; //< 1 tick pass every time
+        sdcr_task_at(g_fakeTick);
+    }
+    sdcr_shm_update();
+    res = sdcr_shm_routine_get_state(id, &state);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    mu_assert("error, routine not complete", state.isEnable == false);
+    mu_assert("error, g_callbackCounter != 4", g_callbackCounter == 4);
+
+    sdcr_shm_close();
+    sdcr_shm_destroy();
+    return 0;
+}
+
+static char *test_invalid_commands()
+{
+    // init
+    sdcr_routine_clear_all();
+    sdcr_status res = sdcr_routine_new(.id = "red led",
+                                       .routine = "C",
+                                       .callbackFunction = callback_counter,
+                                       .routineStepTimeMs = 10);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // tests
+    res = sdcr_shm_open(g_name);
+    mu_assert("error, res != SDCR_ERROR_SHARED_MEMORY", res == SDCR_ERROR_SHARED_MEMORY);
+    res = sdcr_shm_routine_stop("red led");
+    mu_assert("error, res != SDCR_ERROR_INVALID_API_USAGE", res == SDCR_ERROR_INVALID_API_USAGE);
+    res = sdcr_shm_update();
+    mu_assert("error, res != SDCR_ERROR_INVALID_API_USAGE", res == SDCR_ERROR_INVALID_API_USAGE);
+
+    res = sdcr_shm_create(NULL);
+    mu_assert("error, res != SDCR_ERROR_NULL_PTR", res == SDCR_ERROR_NULL_PTR);
+    res = sdcr_shm_create(g_name);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_shm_open(g_name);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    res = sdcr_shm_routine_stop(NULL);
+    mu_assert("error, res != SDCR_ERROR_NULL_PTR", res == SDCR_ERROR_NULL_PTR);
+    res = sdcr_shm_routine_stop("I dont really exist.");
+    mu_assert("error, res != SDCR_ERROR_ID_DOESNT_EXIST", res == SDCR_ERROR_ID_DOESNT_EXIST);
+    res = sdcr_shm_routine_stop("This ID is way too long for the shared memory segment.");
+    mu_assert("error, res != SDCR_ERROR_INVALID_API_USAGE", res == SDCR_ERROR_INVALID_API_USAGE);
+
+    for (size_t i = 0; i < SDCR_SHM_COMMAND_QUEUE_SIZE; i++)
+    {
+        res = sdcr_shm_routine_stop("red led");
+        mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    }
+    res = sdcr_shm_routine_stop("red led");
+    mu_assert("error, res != SDCR_ERROR_COMMAND_QUEUE_IS_FULL", res == SDCR_ERROR_COMMAND_QUEUE_IS_FULL);
+    sdcr_shm_update();
+    res = sdcr_shm_routine_stop("red led");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    sdcr_shm_close();
+    sdcr_shm_destroy();
+    return 0;
+}
+
+static char *test_dead_sender_is_skipped()
+{
+    // init
+    sdcr_routine_clear_all();
+    sdcr_status res = sdcr_routine_new(.id = "red led",
+                                       .routine = "C",
+                                       .callbackFunction = callback_counter,
+                                       .routineStepTimeMs = 10);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_shm_create(g_name);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_shm_open(g_name);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // A sender claims a cell and dies
+    test_shm_segment *segment = map_segment();
+    mu_assert("error, mmap failed", segment != NULL);
+    atomic_fetch_add(&segment->enqueuePosition, 1);
+    munmap(segment, sizeof(*segment));
+
+    // tests: the next command waits for the dead sender, then its cell is skipped
+    res = sdcr_shm_routine_start_inf("red led");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    sdcr_routine_state state;
+    sdcr_shm_update();
+    sdcr_routine_get_state("red led", &state);
+    mu_assert("error, command performed before the cell is skipped", state.isEnable == false);
+    sleep_us((SDCR_SHM_STUCK_MS + 10) * 1000L);
+    sdcr_shm_update();
+    sdcr_routine_get_state("red led", &state);
+    mu_assert("error, command not performed after the cell is skipped", state.isEnable == true);
+
+    sdcr_shm_close();
+    sdcr_shm_destroy();
+    return 0;
+}
+
+static char *test_writing_sender_is_waited_for()
+{
+    // init
+    sdcr_routine_clear_all();
+    sdcr_status res = sdcr_routine_new(.id = "red led",
+                                       .routine = "C",
+                                       .callbackFunction = callback_counter,
+                                       .routineStepTimeMs = 10);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_shm_create(g_name);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_shm_open(g_name);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // A sender claims the first cell, reserves it and is preempted while writing it
+    test_shm_segment *segment = map_segment();
+    mu_assert("error, mmap failed", segment != NULL);
+    const unsigned position = atomic_fetch_add(&segment->enqueuePosition, 1);
+    test_shm_command *command = &segment->commands[position & (SDCR_SHM_COMMAND_QUEUE_SIZE - 1)];
+    atomic_store(&command->sequence, position + SDCR_SHM_COMMAND_QUEUE_SIZE / 2);
+
+    // tests: the reserved cell is never skipped, the next command waits for it
+    res = sdcr_shm_routine_start_inf("red led");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    sdcr_routine_state state;
+    sdcr_shm_update();
+    sleep_us((SDCR_SHM_STUCK_MS + 10) * 1000L);
+    sdcr_shm_update();
+    sdcr_routine_get_state("red led", &state);
+    mu_assert("error, reserved cell skipped", state.isEnable == false);
+
+    // tests: the sender resumes, both commands are performed in order
+    command->type = 1; //< SDCR_SHM_COMMAND_START_FOR_N_CYCLES
+    command->cycles = 7;
+    strcpy(command->id, "red led");
+    atomic_store(&command->sequence, position + 1);
+    munmap(segment, sizeof(*segment));
+    sdcr_shm_update();
+    sdcr_routine_get_state("red led", &state);
+    mu_assert("error, commands not performed", state.isEnable == true);
+    mu_assert("error, commands not performed in order", state.isInfinite == true);
+
+    sdcr_shm_close();
+    sdcr_shm_destroy();
+    return 0;
+}
+
+static char *test_preempted_sender_is_waited_for()
+{
+    // init
+    sdcr_routine_clear_all();
+    sdcr_status res = sdcr_routine_new(.id = "red led",
+                                       .routine = "C",
+                                       .callbackFunction = callback_counter,
+                                       .routineStepTimeMs = 10);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_shm_create(g_name);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_shm_open(g_name);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // A sender claims the first cell and is preempted before reserving it
+    test_shm_segment *segment = map_segment();
+    mu_assert("error, mmap failed", segment != NULL);
+    const unsigned position = atomic_fetch_add(&segment->enqueuePosition, 1);
+    test_shm_command *command = &segment->commands[position & (SDCR_SHM_COMMAND_QUEUE_SIZE - 1)];
+
+    // tests: however often the queue is updated, the cell is waited for until the timeout
+    res = sdcr_shm_routine_start_inf("red led");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    for (size_t i = 0; i < 1000; i++)
+    {
+        sdcr_shm_update();
+    }
+    sdcr_routine_state state;
+    sdcr_routine_get_state("red led", &state);
+    mu_assert("error, claimed cell skipped before the timeout", state.isEnable == false);
+
+    // tests: the sender resumes, both commands are performed in order
+    unsigned expected = position;
+    mu_assert("error, claimed cell not reservable",
+              atomic_compare_exchange_strong(&command->sequence, &expected, position + SDCR_SHM_COMMAND_QUEUE_SIZE / 2));
+    command->type = 2; //< SDCR_SHM_COMMAND_STOP
+    strcpy(command->id, "red led");
+    atomic_store(&command->sequence, position + 1);
+    munmap(segment, sizeof(*segment));
+    sdcr_shm_update();
+    sdcr_routine_get_state("red led", &state);
+    mu_assert("error, commands not performed in order", state.isEnable == true);
+
+    sdcr_shm_close();
+    sdcr_shm_destroy();
+    return 0;
+}
+
+static char *test_commands_from_another_process()
+{
+    // init
+    g_callbackCounter = 0; //< reset global flag
+    sdcr_routine_clear_all();
+    sdcr_status res = sdcr_routine_new(.id = "red led",
+                                       .routine = "C.",
+                                       .callbackFunction = callback_counter,
+                                       .routineStepTimeMs = 1);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_shm_create(g_name);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    const pid_t pid = fork();
+    mu_assert("error, fork failed", pid >= 0);
+    if (pid == 0)
+        _exit(run_remote_process());
+
+    // tests: run the routines until the remote process is done
+    int status = 0;
+    pid_t done = 0;
+    for (uint32_t tick = 1; done == 0 && tick < 1000000; tick++)
+    {
+        sdcr_task_at(tick);
+        sdcr_shm_update();
+        done = waitpid(pid, &status, WNOHANG);
+        sleep_us(10);
+    }
+    if (done == 0)
+    {
+        kill(pid, SIGKILL);
+        waitpid(pid, &status, 0);
+    }
+    sdcr_shm_destroy();
+
+    mu_assert("error, remote process failed", done == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    mu_assert("error, routine never called", g_callbackCounter > 0);
+    sdcr_routine_state state;
+    sdcr_routine_get_state("red led", &state);
+    mu_assert("error, routine not stopped", state.isEnable == false);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(test_commands_from_the_same_process);
+    mu_run_test(test_invalid_commands);
+    mu_run_test(test_dead_sender_is_skipped);
+    mu_run_test(test_writing_sender_is_waited_for);
+    mu_run_test(test_preempted_sender_is_waited_for);
+    mu_run_test(test_commands_from_another_process);
+    return 0;
+}
+
+//-----------------------------------------------
+// MAIN
+//-----------------------------------------------
+int main()
+{
+    snprintf(g_name, sizeof(g_name), "/sdcr-unittest-%ld", (long)getpid());
+
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf("%s\n", result);
+    }
+    else
+    {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", mu_tests_run);
+
+    return result != 0;
+}
+
+static void callback_counter()
+{
+    ++g_callbackCounter;
+}
+
+/* Will start the routine, wait for its steps, then stop it.
+ * return: The process exit code. 0 is success.
+ */
+static int run_remote_process()
+{
+    if (sdcr_shm_open(g_name) != SDCR_SUCCESS)
+        return 1;
+    if (sdcr_shm_routine_start_inf("red led") != SDCR_SUCCESS)
+        return 2;
+
+    sdcr_routine_state state = {0};
+    for (int i = 0; i < 100000 && state.cursorPosition < 1; i++)
+    {
+        sdcr_shm_routine_get_state("red led", &state);
+        sleep_us(10);
+    }
+    if (!state.isEnable || state.timestampLastAction == 0)
+        return 3;
+
+    if (sdcr_shm_routine_stop("red led") != SDCR_SUCCESS)
+        return 4;
+    for (int i = 0; i < 100000 && state.isEnable; i++)
+    {
+        sdcr_shm_routine_get_state("red led", &state);
+        sleep_us(10);
+    }
+    if (state.isEnable)
+        return 5;
+
+    sdcr_shm_close();
+    return 0;
+}
+
+static void sleep_us(long us)
+{
+    const struct timespec duration = {.tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000};
+    nanosleep(&duration, NULL);
+}
+
+static test_shm_segment *map_segment()
+{
+    const int fd = shm_open(g_name, O_RDWR, 0);
+    if (fd < 0)
+        return NULL;
+    test_shm_segment *segment = mmap(NULL, sizeof(test_shm_segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return segment == MAP_FAILED ? NULL : segment;
+}
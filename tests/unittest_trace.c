@@ -0,0 +1,250 @@
+/*
+ * testing SDCR tracing
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "minunit.h"           //< Test framewok
+#include "../src/sdrc.h"       //< library to test
+#include "../src/sdrc_trace.h" //< library to test
+
+//-----------------------------------------------
+// TESTS "FRAMEWORK"
+//-----------------------------------------------
+int mu_tests_run = 0;
+static uint32_t g_fakeTick = 0;
+static uint32_t g_callbackCounter = 0;
+static char g_output[4096];
+static size_t g_outputLength = 0;
+
+//-----------------------------------------------
+// prototype
+//-----------------------------------------------
+static uint32_t get_fake_tick();
+static void callback_counter();
+static void write_output(void *context, const char *text, size_t length);
+
+//-----------------------------------------------
+// TESTS
+//-----------------------------------------------
+static char *test_trace_records_the_routine_life()
+{
+    // init
+    g_fakeTick = 0;        //< reset global flag
+    g_callbackCounter = 0; //< reset global flag
+    sdcr_routine_clear_all();
+    sdcr_trace_event events[64];
+    size_t count = 0;
+    sdcr_trace_read(events, 64, &count, NULL); //< flush previous tests
+
+    sdcr_status res = sdcr_trace_enable(get_fake_tick);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_routine_new(.id = "green led",
+                           .routine = "C.",
+                           .callbackFunction = callback_counter,
+                           .routineStepTimeMs = 10);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    res = sdcr_routine_start_for_n_cycles("green led", 2);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+
+    // tests
+    for (size_t i = 0; i < 40; i++)
+    {
+        g_fakeTick++; //< 1 tick pass every time
+        sdcr_task(get_fake_tick);
+    }
+
+    uint32_t lost = 0;
+    res = sdcr_trace_read(events, 64, &count, &lost);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    mu_assert("error, lost != 0", lost == 0);
+
+    const sdcr_trace_type expected[] = {
+        SDCR_TRACE_START,
+        SDCR_TRACE_STEP, SDCR_TRACE_CALLBACK_BEGIN, SDCR_TRACE_CALLBACK_END, //< 'C' at 10
+        SDCR_TRACE_STEP,                                                     //< '.' at 20
+        SDCR_TRACE_STEP, SDCR_TRACE_STOP, SDCR_TRACE_CYCLE_WRAP,             //< last cycle at 30
+        SDCR_TRACE_CALLBACK_BEGIN, SDCR_TRACE_CALLBACK_END,
+    };
+    mu_assert("error, unexpected number of events", count == sizeof(expected) / sizeof(expected[0]));
+    for (size_t i = 0; i < count; i++)
+    {
+        mu_assert("error, unexpected event", events[i].type == expected[i]);
+        mu_assert("error, unexpected id", strcmp(events[i].id, "green led") == 0);
+    }
+    mu_assert("error, start event should have the cycles", events[0].arg == 2);
+    mu_assert("error, 'C' step should be at 10", events[1].timestamp == 10);
+
+    // a late step records a missed deadline
+    res = sdcr_routine_start_inf("green led");
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    g_fakeTick += 100;
+    sdcr_task(get_fake_tick);
+    res = sdcr_trace_read(events, 64, &count, &lost);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    mu_assert("error, count != 3", count == 3);
+    mu_assert("error, events[2].type != SDCR_TRACE_DEADLINE_MISSED", events[2].type == SDCR_TRACE_DEADLINE_MISSED);
+    mu_assert("error, events[2].arg != 100", events[2].arg == 100); //< last step at 30, due at 40
+
+    sdcr_trace_disable();
+    return 0;
+}
+
+static char *test_trace_overwrites_oldest_events()
+{
+    // init
+    g_fakeTick = 0;
+    sdcr_routine_clear_all();
+    sdcr_trace_event events[SDCR_TRACE_BUFFER_SIZE];
+    size_t count = 0;
+    uint32_t lost = 0;
+    sdcr_trace_read(events, SDCR_TRACE_BUFFER_SIZE, &count, NULL); //< flush previous tests
+
+    sdcr_trace_enable(get_fake_tick);
+    sdcr_routine_new(.id = "green led",
+                     .routine = ".",
+                     .callbackFunction = callback_counter,
+                     .routineStepTimeMs = 1);
+    sdcr_routine_start_inf("green led");
+
+    // tests: 1 step event every tick
+    for (size_t i = 0; i < SDCR_TRACE_BUFFER_SIZE + 10; i++)
+    {
+        g_fakeTick++;
+        sdcr_task(get_fake_tick);
+    }
+    sdcr_trace_disable();
+    sdcr_trace_read(events, SDCR_TRACE_BUFFER_SIZE, &count, &lost);
+    mu_assert("error, count != SDCR_TRACE_BUFFER_SIZE", count == SDCR_TRACE_BUFFER_SIZE);
+    // start, first step, then a step and a cycle wrap on every tick
+    const uint32_t recorded = 2 + 2 * (SDCR_TRACE_BUFFER_SIZE + 10 - 1);
+    mu_assert("error, lost events", lost == recorded - SDCR_TRACE_BUFFER_SIZE);
+    mu_assert("error, the newest event should be kept", events[count - 1].timestamp == g_fakeTick);
+    return 0;
+}
+
+static char *test_trace_shared_timeline_steps_once()
+{
+    // init
+    g_fakeTick = 0;        //< reset global flag
+    g_callbackCounter = 0; //< reset global flag
+    sdcr_routine_clear_all();
+    sdcr_trace_event events[64];
+    size_t count = 0;
+    sdcr_trace_read(events, 64, &count, NULL); //< flush previous tests
+
+    sdcr_trace_enable(get_fake_tick);
+    sdcr_routine_new(.id = "green led",
+                     .routine = "C",
+                     .callbackFunction = callback_counter,
+                     .routineStepTimeMs = 10);
+    sdcr_routine_new(.id = "red led",
+                     .routine = "C",
+                     .callbackFunction = callback_counter,
+                     .routineStepTimeMs = 10);
+    sdcr_routine_start_inf("green led");
+    sdcr_routine_start_inf("red led");
+
+    // tests: one step for both routines, two callbacks
+    for (size_t i = 0; i < 30; i++)
+    {
+        g_fakeTick++;
+        sdcr_task(get_fake_tick);
+    }
+    sdcr_trace_disable();
+    sdcr_trace_read(events, 64, &count, NULL);
+    size_t steps = 0;
+    size_t callbacks = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        steps += (events[i].type == SDCR_TRACE_STEP);
+        callbacks += (events[i].type == SDCR_TRACE_CALLBACK_BEGIN);
+    }
+    mu_assert("error, steps != 3", steps == 3);
+    mu_assert("error, callbacks != 6", callbacks == 6);
+    mu_assert("error, g_callbackCounter != 6", g_callbackCounter == 6);
+    return 0;
+}
+
+static char *test_trace_export_chrome()
+{
+    // init
+    g_fakeTick = 0;
+    g_outputLength = 0;
+    sdcr_routine_clear_all();
+    sdcr_trace_event events[SDCR_TRACE_BUFFER_SIZE];
+    size_t count = 0;
+    sdcr_trace_read(events, SDCR_TRACE_BUFFER_SIZE, &count, NULL); //< flush previous tests
+
+    sdcr_trace_enable(get_fake_tick);
+    sdcr_routine_new(.id = "red \"led\"",
+                     .routine = "C",
+                     .callbackFunction = callback_counter,
+                     .routineStepTimeMs = 1);
+    sdcr_routine_start_inf("red \"led\"");
+    g_fakeTick++;
+    sdcr_task(get_fake_tick);
+    sdcr_trace_disable();
+
+    // tests
+    sdcr_status res = sdcr_trace_export_chrome(write_output, NULL, 1000.0);
+    mu_assert("error, res != SDCR_SUCCESS", res == SDCR_SUCCESS);
+    g_output[g_outputLength] = '\0';
+    mu_assert("error, no trace events", strstr(g_output, "{\"traceEvents\":[") == g_output);
+    mu_assert("error, no thread name", strstr(g_output, "\"args\":{\"name\":\"red \\\"led\\\"\"}") != NULL);
+    mu_assert("error, no callback begin", strstr(g_output, "{\"name\":\"callback\",\"ph\":\"B\",\"ts\":1000.000,\"pid\":1,\"tid\":1}") != NULL);
+    mu_assert("error, no callback end", strstr(g_output, "\"ph\":\"E\"") != NULL);
+    mu_assert("error, no end of trace", strstr(g_output, "]") != NULL);
+
+    res = sdcr_trace_export_chrome(NULL, NULL, 1000.0);
+    mu_assert("error, res != SDCR_ERROR_NULL_PTR", res == SDCR_ERROR_NULL_PTR);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(test_trace_records_the_routine_life);
+    mu_run_test(test_trace_overwrites_oldest_events);
+    mu_run_test(test_trace_shared_timeline_steps_once);
+    mu_run_test(test_trace_export_chrome);
+    return 0;
+}
+
+//-----------------------------------------------
+// MAIN
+//-----------------------------------------------
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf("%s\n", result);
+    }
+    else
+    {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", mu_tests_run);
+
+    return result != 0;
+}
+
+static uint32_t get_fake_tick()
+{
+    return g_fakeTick;
+}
+
+static void callback_counter()
+{
+    ++g_callbackCounter;
+}
+
+static void write_output(void *context, const char *text, size_t length)
+{
+    (void)context;
+    if (g_outputLength + length < sizeof(g_output))
+    {
+        memcpy(&g_output[g_outputLength], text, length);
+        g_outputLength += length;
+    }
+}